@@ -49,6 +49,51 @@ extern diskGeo DiskGeometryList[];
 
 extern const Bit8u freedos_mbr[];
 
+/* Block cache shared by all raw disk images (INT 13h, FAT driver and IDE all go through it) */
+void imageDiskCache_Configure(Bitu size_kb,bool readahead);
+
+/* Enable or disable memory mapping of raw disk images (see imageDiskMapped) */
+void imageDiskMapped_Configure(bool enable);
+
+class imageDisk;
+
+/* Sector transfer run on the disk I/O thread, so that slow host reads (network storage,
+ * cold page cache) overlap with emulation instead of stalling it. The caller owns the
+ * request and the buffer, both must stay valid until DISKIO_Complete() returned true.
+ * With the I/O thread disabled DISKIO_Submit() does the transfer right away. */
+struct DiskIORequest {
+	imageDisk*	disk;
+	void*		data;
+	bool		write;
+	bool		chs;		/* Read/Write_Sector on head/cylinder, sectnum is the first sector on the track */
+	Bit32u		sectnum;	/* first sector (Read/Write_Sectors) */
+	Bit32u		head,cylinder;
+	Bit32u		count;
+	Bit32u		sector_size;	/* stride between sectors in data, chs only */
+	Bit32u		completed;	/* sectors done before the first error (chs only, otherwise 0 or count) */
+	Bit8u		result;		/* 0 or the error code of the failing sector */
+
+	/* owned by the I/O thread */
+	volatile bool	done;
+	bool		busy;
+	DiskIORequest*	next;
+
+	DiskIORequest() : disk(NULL), data(NULL), write(false), chs(false), sectnum(0), head(0), cylinder(0),
+		count(0), sector_size(0), completed(0), result(0), done(false), busy(false), next(NULL) { }
+};
+
+void DISKIO_Configure(bool enable);
+void DISKIO_Submit(DiskIORequest *req);
+bool DISKIO_Complete(DiskIORequest *req);	/* true once finished, the request may then be reused */
+void DISKIO_Wait(DiskIORequest *req);
+/* wait for everything queued. Code that touches an imageDisk directly from the emulation
+ * thread calls this first, imageDisk and the block cache are not thread safe */
+void DISKIO_Sync(void);
+bool DISKIO_Async(void);
+/* called by LOG_MSG: on the I/O thread the message is queued and true returned, it is
+ * logged by the emulation thread once it next looks at the queue */
+bool DISKIO_DeferLog(const char *msg);
+
 class imageDisk {
 public:
 	enum IMAGE_TYPE {
@@ -58,13 +103,19 @@ public:
 		ID_MEMORY,
 		ID_VHD,
 		ID_D88,
-		ID_NFD
+		ID_NFD,
+		ID_HUNK
 	};
 
 	virtual Bit8u Read_Sector(Bit32u head,Bit32u cylinder,Bit32u sector,void * data,unsigned int req_sector_size=0);
 	virtual Bit8u Write_Sector(Bit32u head,Bit32u cylinder,Bit32u sector,void * data,unsigned int req_sector_size=0);
 	virtual Bit8u Read_AbsoluteSector(Bit32u sectnum, void * data);
 	virtual Bit8u Write_AbsoluteSector(Bit32u sectnum, void * data);
+	/* transfer count consecutive sectors in one call. Raw images do a single read or write,
+	 * other formats fall back to one Read/Write_AbsoluteSector per sector unless they override
+	 * these too (subclasses built on the raw constructor that keep ID_BASE must override). */
+	virtual Bit8u Read_Sectors(Bit32u sectnum, Bit32u count, void * data);
+	virtual Bit8u Write_Sectors(Bit32u sectnum, Bit32u count, void * data);
 
 	virtual void Set_Reserved_Cylinders(Bitu resCyl);
 	virtual Bit32u Get_Reserved_Cylinders();
@@ -74,7 +125,7 @@ public:
 	virtual Bit32u getSectSize(void);
 	imageDisk(FILE *imgFile, Bit8u *imgName, Bit32u imgSizeK, bool isHardDisk);
 	imageDisk(FILE* diskimg, const char* diskName, Bit32u cylinders, Bit32u heads, Bit32u sectors, Bit32u sector_size, bool hardDrive);
-	virtual ~imageDisk() { if(diskimg != NULL) { fclose(diskimg); diskimg=NULL; } };
+	virtual ~imageDisk();
 
 	IMAGE_TYPE class_id;
 	std::string diskname;
@@ -84,6 +135,10 @@ public:
 	bool hardDrive;
 	Bit64u diskSizeK;
 
+	/* bumped by writes that bypass the DOS FAT driver (INT 13h, IDE, floppy controller), so that
+	 * a fatDrive on this disk knows its cached FAT and cluster chains may be stale */
+	Bit32u write_generation;
+
 protected:
 	imageDisk(IMAGE_TYPE class_id);
 	FILE *diskimg;
@@ -93,7 +148,12 @@ protected:
     Bit64u image_base;
 	Bit64u image_length;
 
+	/* raw access to the image file, offset is relative to image_base */
+	size_t Read_Raw(Bit64u offset,void *data,size_t len);
+	bool Write_Raw(Bit64u offset,const void *data,size_t len);
+
 private:
+	friend class imageDiskCache;
 	volatile int refcount;
 
 public:
@@ -111,6 +171,47 @@ public:
 	}
 };
 
+/* Raw sector dump mapped into the host address space. Sector access becomes
+ * a memcpy and the host pages the image in on demand. Writable images are
+ * mapped MAP_SHARED so the host page cache is shared with anyone else using
+ * the same file. If the image cannot be mapped this behaves like imageDisk. */
+class imageDiskMapped : public imageDisk {
+public:
+	virtual Bit8u Read_AbsoluteSector(Bit32u sectnum, void * data);
+	virtual Bit8u Write_AbsoluteSector(Bit32u sectnum, void * data);
+	virtual Bit8u Read_Sectors(Bit32u sectnum, Bit32u count, void * data);
+	virtual Bit8u Write_Sectors(Bit32u sectnum, Bit32u count, void * data);
+	imageDiskMapped(FILE *imgFile, Bit8u *imgName, Bit32u imgSizeK, bool isHardDisk);
+	virtual ~imageDiskMapped();
+
+	bool IsMapped(void) const { return map_base != NULL; }
+
+private:
+	void Map(void);
+	void Unmap(void);
+
+	Bit8u *map_base;		/* start of the mapping (file offset 0) */
+	Bit64u map_length;
+	bool map_writable;
+};
+
+class HunkImage;
+
+/* Disk image in a read-only compressed hunk container (see hunk_image.h). Reads go
+ * through the container's cache of decompressed hunks, writes fail as write protected. */
+class imageDiskHunk : public imageDisk {
+public:
+	virtual Bit8u Read_AbsoluteSector(Bit32u sectnum, void * data);
+	virtual Bit8u Write_AbsoluteSector(Bit32u sectnum, void * data);
+	virtual Bit8u Read_Sectors(Bit32u sectnum, Bit32u count, void * data);
+	virtual Bit8u Write_Sectors(Bit32u sectnum, Bit32u count, void * data);
+	imageDiskHunk(HunkImage *image, const char *imgName, bool isHardDisk);
+	virtual ~imageDiskHunk();
+
+private:
+	HunkImage *image;
+};
+
 class imageDiskD88 : public imageDisk {
 	public:
 		virtual Bit8u Read_Sector(Bit32u head,Bit32u cylinder,Bit32u sector,void * data,unsigned int req_sector_size=0);
@@ -214,6 +315,8 @@ class imageDiskMemory : public imageDisk {
 public:
 	virtual Bit8u Read_AbsoluteSector(Bit32u sectnum, void * data);
 	virtual Bit8u Write_AbsoluteSector(Bit32u sectnum, void * data);
+	virtual Bit8u Read_Sectors(Bit32u sectnum, Bit32u count, void * data);
+	virtual Bit8u Write_Sectors(Bit32u sectnum, Bit32u count, void * data);
 	virtual Bit8u GetBiosType(void);
 	virtual void Set_Geometry(Bit32u setHeads, Bit32u setCyl, Bit32u setSect, Bit32u setSectSize);
 	// Parition and format the ramdrive
@@ -270,6 +373,8 @@ public:
 	VHDTypes vhdType;
 	virtual Bit8u Read_AbsoluteSector(Bit32u sectnum, void * data);
 	virtual Bit8u Write_AbsoluteSector(Bit32u sectnum, void * data);
+	virtual Bit8u Read_Sectors(Bit32u sectnum, Bit32u count, void * data);
+	virtual Bit8u Write_Sectors(Bit32u sectnum, Bit32u count, void * data);
 	static ErrorCodes Open(const char* fileName, const bool readOnly, imageDisk** imageDisk);
 	static VHDTypes GetVHDType(const char* fileName);
 	virtual ~imageDiskVHD();
@@ -329,10 +434,20 @@ private:
 		bool IsValid();
 	};
 
-	imageDiskVHD() : imageDisk(ID_VHD), parentDisk(NULL), copiedFooter(false), currentBlock(0xFFFFFFFF), currentBlockAllocated(false), currentBlockDirtyMap(NULL) { }
+	//sector bitmap of an allocated block
+	struct BlockMap {
+		Bit32u block;		/* 0xFFFFFFFF if unused */
+		Bit32u lastUse;
+		std::vector<Bit8u> map;
+	};
+	enum { BLOCK_MAP_CACHE_SIZE = 64 };
+
+	imageDiskVHD() : imageDisk(ID_VHD), parentDisk(NULL), copiedFooter(false), blockMapClock(0), currentBlock(0xFFFFFFFF), currentBlockAllocated(false), currentBlockDirtyMap(NULL) { }
 	static ErrorCodes TryOpenParent(const char* childFileName, const ParentLocatorEntry &entry, Bit8u* data, const Bit32u dataLength, imageDisk** disk, const Bit8u* uniqueId);
 	static ErrorCodes Open(const char* fileName, const bool readOnly, imageDisk** imageDisk, const Bit8u* matchUniqueId);
 	virtual bool loadBlock(const Bit32u blockNumber);
+	BlockMap* getBlockMap(const Bit32u blockNumber, const Bit32u blockSectorOffset, const bool fresh);
+	bool findRun(const Bit32u sectnum, const Bit32u count, Bit32u &run, bool &hasData);
 	static bool convert_UTF16_for_fopen(std::string &string, const void* data, const Bit32u dataLength);
 
 	imageDisk* parentDisk;// = 0;
@@ -344,10 +459,13 @@ private:
 	Bit32u sectorsPerBlock;
 	Bit32u blockMapSectors;
 	Bit32u blockMapSize;
+	std::vector<Bit32u> blockTable;	//the BAT in host byte order: sector of each block's bitmap, or 0xFFFFFFFF
+	std::vector<BlockMap> blockMaps;	//bitmaps of recently used blocks
+	Bit32u blockMapClock;
 	Bit32u currentBlock;// = 0xFFFFFFFF;
 	bool currentBlockAllocated;// = false;
 	Bit32u currentBlockSectorOffset;
-	Bit8u* currentBlockDirtyMap;// = 0;
+	Bit8u* currentBlockDirtyMap;// = 0; points into blockMaps
 };
 
 void updateDPT(void);
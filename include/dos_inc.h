@@ -330,6 +330,8 @@ static INLINE Bit16u DOS_PackDate(Bit16u year,Bit16u mon,Bit16u day) {
 #define DOSERR_NOT_SAME_DEVICE 17
 #define DOSERR_NO_MORE_FILES 18
 #define DOSERR_WRITE_PROTECTED 19
+#define DOSERR_WRITE_FAULT 29
+#define DOSERR_READ_FAULT 30
 #define DOSERR_FILE_ALREADY_EXISTS 80
 
 
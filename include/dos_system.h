@@ -21,6 +21,8 @@
 #define DOSBOX_DOS_SYSTEM_H
 
 #include <vector>
+#include <map>
+#include <string>
 #ifndef DOSBOX_DOSBOX_H
 #include "dosbox.h"
 #endif
@@ -163,6 +165,7 @@ public:
 
 	bool		FindFirst			(char* path, Bit16u& id);
 	bool		FindNext			(Bit16u id, char* &result);
+	bool		FindNext			(Bit16u id, char* &result, const char* &orgname, bool &is_directory);
 
 	void		CacheOut			(const char* path, bool ignoreLastDir = false);
 	void		AddEntry			(const char* path, bool checkExist = false);
@@ -170,23 +173,30 @@ public:
 
 	void		EmptyCache			(void);
 	void		MediaChange			(void);
+	void		UpdateFromHost			(void);
 	void		SetLabel			(const char* name,bool cdrom,bool allowupdate);
 	char*		GetLabel			(void) { return label; };
 
+	class CFileArena;
+	class CNameIndex;
+
+	/* Directory entries and their host names are carved out of the parent directory's
+	 * arena, so a file costs one small record plus its name rather than a CROSS_LEN
+	 * buffer and a heap allocation of its own. Only directories own an arena. */
 	class CFileInfo {
 	public:
-		CFileInfo(void) {
-			orgname[0] = shortname[0] = 0;
+		CFileInfo(void) : orgname(""), names(0), arena(0) {
+			shortname[0] = 0;
 			isDir = false;
 			id = MAX_OPENDIRS;
 			nextEntry = shortNr = 0;
 		}
-		~CFileInfo(void) {
-			for (Bit32u i=0; i<fileList.size(); i++) delete fileList[i];
-			fileList.clear();
-			longNameList.clear();
-		};
-		char		orgname		[CROSS_LEN];
+		~CFileInfo(void) { FreeEntries(); };
+		CFileInfo*	AllocEntry	(const char* name);
+		void		FreeEntry	(CFileInfo* info);
+		void		FreeEntries	(void);
+
+		const char*	orgname;
 		char		shortname	[DOS_NAMELENGTH_ASCII];
 		bool		isDir;
 		Bit16u		id;
@@ -195,6 +205,9 @@ public:
 		// contents
 		std::vector<CFileInfo*>	fileList;
 		std::vector<CFileInfo*>	longNameList;
+		CNameIndex*		names;
+	private:
+		CFileArena*	arena;
 	};
 
 private:
@@ -202,6 +215,7 @@ private:
 	void DeleteFileInfo(CFileInfo *dir);
 
 	bool		RemoveTrailingDot	(char* shortname);
+	static bool	GetShortNameKey		(const char* shortname, char* key);
 	Bits		GetLongName		(CFileInfo* info, char* shortname);
 	void		CreateShortName		(CFileInfo* dir, CFileInfo* info);
 	Bitu		CreateShortNameID	(CFileInfo* dir, const char* name);
@@ -215,6 +229,14 @@ private:
 	void		CopyEntry		(CFileInfo* dir, CFileInfo* from);
 	Bit16u		GetFreeID		(CFileInfo* dir);
 	void		Clear			(void);
+	void		WatchDir		(const char* path);
+	void		UnwatchDirs		(const char* path);
+	void		CacheOutDir		(CFileInfo* dir, const char* expand);
+	void		CheckDirStamp		(CFileInfo* dir, const char* path);
+	void		HostChange		(int wd, Bit32u mask, const char* name);
+	CFileInfo*	FindCachedDir		(const char* path);
+	Bits		FindHostName		(CFileInfo* dir, const char* name);
+	void		RemoveEntry		(CFileInfo* dir, Bitu index);
 
 	CFileInfo*	dirBase;
 	char		dirPath				[CROSS_LEN];
@@ -234,6 +256,13 @@ private:
 
 	char		label				[CROSS_LEN];
 	bool		updatelabel;
+
+	/* host directories watched for changes made outside the emulator (inotify), and the
+	 * modification times (ns) of those that could not be watched */
+	int		watchFd;
+	bool		watchFailed;
+	std::map<int,std::string> watchDirs;
+	std::map<std::string,Bit64u> stampDirs;
 };
 
 class DOS_Drive {
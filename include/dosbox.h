@@ -84,7 +84,17 @@ extern bool				mono_cga;
 
 #ifdef __SSE__
 extern bool				sse1_available;
+# if defined(_M_AMD64)
+#  define sse2_available		(1) /* SSE2 is always available on x86_64 */
+# else
 extern bool				sse2_available;
+# endif
+# if defined(__GNUC__) && !defined(_M_AMD64) && (defined(__clang__) || __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+/* SSSE3 and AVX2 code is built per function with __attribute__((target)) and only run when cpuid reports it */
+#  define C_TARGET_SSSE3_AVX2		1
+extern bool				ssse3_available;
+extern bool				avx2_available;
+# endif
 #endif
 
 void					MSG_Add(const char*,const char*); //add messages to the internal languagefile
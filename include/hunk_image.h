@@ -0,0 +1,121 @@
+/*
+ *  Copyright (C) 2002-2015  The DOSBox Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef DOSBOX_HUNK_IMAGE_H
+#define DOSBOX_HUNK_IMAGE_H
+
+#include <stdio.h>
+#include <vector>
+#include <map>
+#include "config.h"
+
+/* Read-only compressed image container. The image is cut into fixed size hunks that
+ * are compressed one by one, so any byte can be reached by decompressing one hunk.
+ *
+ * Layout (all fields little endian):
+ *   header, 64 bytes:  char magic[8] "HUNKIMG\x1a", u32 version, u32 hunk_size,
+ *                      u64 size (uncompressed bytes), u32 hunk_count, u32 flags,
+ *                      u64 index_offset, 24 bytes reserved
+ *   hunk data
+ *   index at index_offset, 16 bytes per hunk: u64 offset, u32 length, u32 type
+ *
+ * Hunk types are HUNK_STORED (length bytes as is), HUNK_ZLIB (zlib stream inflating to
+ * hunk_size bytes) and HUNK_ZERO (no data). The last hunk is padded to hunk_size. */
+class HunkImage {
+public:
+	enum HunkType {
+		HUNK_STORED = 0,
+		HUNK_ZLIB = 1,
+		HUNK_ZERO = 2
+	};
+
+	static const char magic[8];
+	static const Bit32u version = 1;
+	static const Bit32u header_size = 64;
+	static const Bit32u index_entry_size = 16;
+	static const Bit32u min_hunk_size = 512;
+	static const Bit32u max_hunk_size = 1024*1024;
+	static const Bitu cache_hunks = 32;	/* decompressed hunks kept in memory */
+
+	/* whether the file starts with the container magic, leaves the file position undefined */
+	static bool IsHunkImage(FILE *f);
+	/* takes over f (closed on failure too), NULL if the file is not a valid container */
+	static HunkImage* Open(FILE *f);
+
+	~HunkImage();
+
+	bool Read(Bit64u offset, void *data, size_t len);
+	Bit64u GetSize(void) const { return size; }
+	Bit32u GetHunkSize(void) const { return hunk_size; }
+
+private:
+	struct IndexEntry {
+		Bit64u offset;
+		Bit32u length;
+		Bit32u type;
+	};
+	struct CacheSlot {
+		Bit32u hunk;
+		Bit32u lastUse;
+		std::vector<Bit8u> data;
+	};
+
+	HunkImage(FILE *f);
+	bool ReadIndex(Bit64u index_offset, Bit32u hunk_count);
+	const Bit8u* GetHunk(Bit32u hunk);
+	bool Decompress(const IndexEntry &ent, Bit8u *dst);
+
+	FILE *file;
+	Bit64u file_size;
+	Bit64u size;
+	Bit32u hunk_size;
+	std::vector<IndexEntry> index;
+
+	/* LRU of decompressed hunks */
+	std::vector<CacheSlot> cache;
+	std::map<Bit32u,Bitu> cacheIndex;	/* hunk -> slot */
+	Bit32u cacheClock;
+	std::vector<Bit8u> compBuffer;
+};
+
+/* Writes a container, hunk by hunk. Each hunk is stored compressed only if that saves
+ * space, all-zero hunks take no room at all. */
+class HunkImageWriter {
+public:
+	HunkImageWriter();
+	~HunkImageWriter();
+
+	bool Create(const char *filename, Bit64u size, Bit32u hunk_size);
+	/* one hunk of hunk_size bytes, the caller pads the last one */
+	bool AddHunk(const Bit8u *data);
+	/* writes the index and header and closes the file */
+	bool Finish(void);
+
+	Bit64u GetCompressedSize(void) const { return data_end; }
+
+private:
+	FILE *file;
+	Bit64u size;
+	Bit32u hunk_size;
+	Bit32u hunk_count;
+	Bit64u data_end;
+	std::vector<Bit8u> index;
+	std::vector<Bit8u> compBuffer;
+};
+
+#endif
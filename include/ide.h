@@ -16,5 +16,6 @@ void IDE_CDROM_Detach(unsigned char drive_index);
 void IDE_Hard_Disk_Attach(signed char index,bool slave,unsigned char bios_drive_index);
 void IDE_Hard_Disk_Detach(unsigned char bios_drive_index);
 void IDE_ResetDiskByBIOS(unsigned char disk);
+void IDE_BusMaster_SetIOBase(Bitu base,bool bus_master);
 
 #endif
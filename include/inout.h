@@ -35,6 +35,11 @@ class IO_CalloutObject;
 typedef Bitu IO_ReadHandler(Bitu port,Bitu iolen);
 typedef void IO_WriteHandler(Bitu port,Bitu val,Bitu iolen);
 
+/* block handlers for string I/O (REP INS/OUTS): move up to count elements of iolen bytes
+ * between the port and a host buffer, return how many were moved (0 = do them one by one) */
+typedef Bitu IO_ReadBlockHandler(Bitu port,void *dst,Bitu count,Bitu iolen);
+typedef Bitu IO_WriteBlockHandler(Bitu port,const void *src,Bitu count,Bitu iolen);
+
 typedef IO_ReadHandler* (IO_ReadCalloutHandler)(IO_CalloutObject &co,Bitu port,Bitu iolen);
 typedef IO_WriteHandler* (IO_WriteCalloutHandler)(IO_CalloutObject &co,Bitu port,Bitu iolen);
 
@@ -49,6 +54,13 @@ void IO_FreeWriteHandler(Bitu port,Bitu mask,Bitu range=1);
 
 void IO_InvalidateCachedHandler(Bitu port,Bitu range=1);
 
+/* block handlers are tied to the regular handler of the port, and only used while that is installed */
+void IO_RegisterReadBlockHandler(Bitu port,IO_ReadHandler * handler,IO_ReadBlockHandler * block,Bitu range=1);
+void IO_RegisterWriteBlockHandler(Bitu port,IO_WriteHandler * handler,IO_WriteBlockHandler * block,Bitu range=1);
+
+void IO_FreeReadBlockHandler(Bitu port,Bitu range=1);
+void IO_FreeWriteBlockHandler(Bitu port,Bitu range=1);
+
 void IO_WriteB(Bitu port,Bitu val);
 void IO_WriteW(Bitu port,Bitu val);
 void IO_WriteD(Bitu port,Bitu val);
@@ -57,6 +69,9 @@ Bitu IO_ReadB(Bitu port);
 Bitu IO_ReadW(Bitu port);
 Bitu IO_ReadD(Bitu port);
 
+Bitu IO_ReadBlock(Bitu port,void *dst,Bitu count,Bitu iolen);
+Bitu IO_WriteBlock(Bitu port,const void *src,Bitu count,Bitu iolen);
+
 static const Bitu IOMASK_ISA_10BIT = 0x3FFU; /* ISA 10-bit decode */
 static const Bitu IOMASK_ISA_12BIT = 0xFFFU; /* ISA 12-bit decode */
 static const Bitu IOMASK_FULL = 0xFFFFU; /* full 16-bit decode */
@@ -156,6 +156,19 @@ void mem_writeb(const PhysPt pt,const Bit8u val);
 void mem_writew(const PhysPt pt,const Bit16u val);
 void mem_writed(const PhysPt pt,const Bit32u val);
 
+/* block versions for REP STOS/MOVS, the range must not cross a page */
+Bitu mem_fillblock(const PhysPt pt,const Bit32u val,const Bitu size,const Bitu count);
+Bitu mem_copyblock(const PhysPt dest,const PhysPt src,const Bitu size,const Bitu count);
+
+/* host address of the run of plain memory starting at pt, covering as many following pages as
+ * are contiguous on the host. Returns the length of the span (at most size, at least up to the
+ * end of the first page) and sets *host to NULL when that first page has to go through its handler */
+Bitu MEM_HostSpan(const PhysPt pt,const Bitu size,const bool write,HostPt * const host);
+
+/* host pointer for a linear range that is plain memory, contiguous on the host and already
+ * in the TLB, NULL otherwise (device memory, code pages, ROM when writing, pages not yet touched) */
+HostPt MEM_GetBlockHostPt(const PhysPt pt,const Bitu size,const bool write);
+
 void phys_writes(PhysPt addr, const char* string, Bitu length);
 
 static INLINE void phys_writeb(const PhysPt addr,const Bit8u val) {
@@ -185,6 +198,8 @@ void MEM_BlockRead(PhysPt pt,void * data,Bitu size);
 void MEM_BlockWrite32(PhysPt pt,void * data,Bitu size);
 void MEM_BlockRead32(PhysPt pt,void * data,Bitu size);
 void MEM_BlockCopy(PhysPt dest,PhysPt src,Bitu size);
+void MEM_PhysBlockRead(PhysPt pt,void * data,Bitu size);
+void MEM_PhysBlockWrite(PhysPt pt,void const * const data,Bitu size);
 void MEM_StrCopy(PhysPt pt,char * data,Bitu size);
 
 void mem_memcpy(PhysPt dest,PhysPt src,Bitu size);
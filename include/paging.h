@@ -104,6 +104,10 @@ public:
 	virtual bool writeb_checked(PhysPt addr,Bitu val);
 	virtual bool writew_checked(PhysPt addr,Bitu val);
 	virtual bool writed_checked(PhysPt addr,Bitu val);
+	/* block writes of count elements of size (1, 2 or 4) bytes, never crossing a page.
+	 * return the number of elements written, 0 if the caller must write them one at a time. */
+	virtual Bitu writeblock_fill(PhysPt addr,Bitu val,Bitu size,Bitu count);
+	virtual Bitu writeblock_copy(PhysPt addr,ConstHostPt src,Bitu size,Bitu count);
    PageHandler (void) { }
 	Bitu flags; 
 	const Bitu getFlags() const {
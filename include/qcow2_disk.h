@@ -24,6 +24,9 @@
 #include <iostream>
 #include <fstream>
 #include <iomanip>
+#include <vector>
+#include <set>
+#include <map>
 #include <stdint.h>
 #include "config.h"
 #include "bios_disk.h"
@@ -59,9 +62,32 @@ public:
 	Bit8u read_sector(Bit32u sectnum, Bit8u* data);
 
 	Bit8u write_sector(Bit32u sectnum, Bit8u* data);
+
+	Bit8u read_sectors(Bit32u sectnum, Bit32u count, Bit8u* data);
+
+	Bit8u write_sectors(Bit32u sectnum, Bit32u count, Bit8u* data);
+
+	//Write out metadata held back in the caches: refcounts first, then L2 tables, then the L1 table.
+	Bit8u flush();
 	
 private:
 
+	//A cached cluster: an L2 table or refcount block at a file offset, or guest data by cluster number.
+	struct CacheEntry {
+		Bit64u key;
+		Bit32u last_use;
+		Bit64u dirty_start;	/* byte range changed since the last flush, empty if dirty_end is 0 */
+		Bit64u dirty_end;
+		std::vector<Bit8u> data;
+
+		CacheEntry() : key(0xFFFFFFFFFFFFFFFFULL), last_use(0), dirty_start(0), dirty_end(0) {}
+
+		void set_dirty(Bit64u start, Bit64u length){
+			if (dirty_end == 0 || start < dirty_start) dirty_start = start;
+			if (start + length > dirty_end) dirty_end = start + length;
+		}
+	};
+
 	FILE* file;
 	QCow2Header header;
 	static const Bit64u copy_flag;
@@ -78,6 +104,21 @@ private:
 	Bit64u refcount_bits;
 	QCow2Image* backing_image;
 
+	std::vector<Bit64u> l1_table;			/* raw big endian entries */
+	std::vector<Bit64u> refcount_table;		/* raw big endian entries */
+	std::set<Bit64u> l1_dirty;			/* indexes changed since the last flush */
+	std::set<Bit64u> refcount_table_dirty;
+	std::vector<CacheEntry> l2_cache;
+	std::vector<CacheEntry> refcount_cache;
+	std::vector<CacheEntry> data_cache;
+	std::map<Bit64u, size_t> data_cache_index;	/* guest cluster number to data_cache slot */
+	std::map<Bit32u, size_t> data_cache_lru;	/* last_use to data_cache slot, oldest first */
+	std::vector<size_t> data_cache_free;		/* slots not holding a cluster */
+	Bit32u cache_clock;
+	static const Bitu l2_cache_size;
+	static const Bitu refcount_cache_size;
+	static const Bit64u data_cache_bytes;
+
 	static Bit16u host_read16(Bit16u buffer);
 
 	static Bit32u host_read32(Bit32u buffer);
@@ -86,6 +127,18 @@ private:
 
 	static Bit64u mask64(Bit64u bits);
 	
+	Bit8u allocate_cluster(Bit64u& cluster_offset, const Bit8u* contents);
+
+	CacheEntry* find_cache_entry(std::vector<CacheEntry>& cache, Bit64u key);
+
+	CacheEntry* get_cached_cluster(Bit64u address);
+
+	void touch_cached_cluster(size_t slot);
+
+	CacheEntry* get_table(std::vector<CacheEntry>& cache, Bit64u table_offset, bool fresh);
+
+	Bit8u load_table(Bit64u offset, Bit64u entries, std::vector<Bit64u>& table);
+
 	Bit8u pad_file(Bit64u& new_file_length);
 
 	Bit8u read_allocated_data(Bit64u file_offset, Bit8u* data, Bit64u data_size);
@@ -98,13 +151,13 @@ private:
 
 	Bit8u read_refcount_table(Bit64u data_cluster_offset, Bit64u& refcount_cluster_offset);
 
-	Bit8u read_table(Bit64u entry_offset, Bit64u entry_mask, Bit64u& entry_value);
-
 	Bit8u read_unallocated_cluster(Bit64u data_cluster_number, Bit8u* data);
 
-	Bit8u read_unallocated_sector(Bit32u sectnum, Bit8u* data);
+	Bit8u update_reference_count(Bit64u cluster_offset);
 
-	Bit8u update_reference_count(Bit64u cluster_offset, Bit8u* cluster_buffer);
+	void update_cached_cluster(Bit64u address, const Bit8u* data, Bit64u data_size);
+
+	Bit8u write_cluster_data(Bit64u address, Bit8u* data, Bit64u data_size);
 
 	Bit8u write_data(Bit64u file_offset, Bit8u* data, Bit64u data_size);
 
@@ -117,6 +170,8 @@ private:
 	Bit8u write_refcount_table_entry(Bit64u cluster_offset, Bit64u refcount_cluster_offset);
 
 	Bit8u write_table_entry(Bit64u entry_offset, Bit64u entry_value);
+
+	Bit8u write_tables(std::vector<CacheEntry>& cache);
 };
 
 class QCow2Disk : public imageDisk{
@@ -131,6 +186,10 @@ public:
 
 	virtual Bit8u Write_AbsoluteSector(Bit32u sectnum, void* data);
 
+	virtual Bit8u Read_Sectors(Bit32u sectnum, Bit32u count, void* data);
+
+	virtual Bit8u Write_Sectors(Bit32u sectnum, Bit32u count, void* data);
+
 private:
 
 	QCow2Image qcowImage;
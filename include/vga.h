@@ -114,6 +114,7 @@ typedef struct {
 	Bit8u color_compare;
 	Bit8u data_rotate;
 	Bit8u raster_op;
+	Bit8u write_func;				/* specialized write path in use, see VGA_CheckWriteFunc() */
 
 	Bit32u full_bit_mask;
 	Bit32u full_map_mask;
@@ -387,10 +388,15 @@ typedef union {
 	Bit8u b[4];
 } VGA_Latch;
 
+#define VGA_WRITE_GEN_SHIFT	12
+
 typedef struct {
 	Bit8u* linear;
 	Bit8u* linear_orgptr;
 	uint32_t memmask;
+	Bit32u* write_gen;	/* per VGA_WRITE_GEN_SHIFT page of linear memory: write_serial of the last planar write */
+	Bit32u write_serial;	/* incremented once per rendered frame */
+	bool write_tracked;	/* all guest writes to display memory go through the planar write handlers */
 } VGA_Memory;
 
 typedef struct {
@@ -448,6 +454,7 @@ void Mono_CGA_Palette(void);
 void VGA_SetMode(VGAModes mode);
 void VGA_DetermineMode(void);
 void VGA_SetupHandlers(void);
+void VGA_CheckWriteFunc(void);
 void VGA_StartResize(Bitu delay=50);
 void VGA_SetupDrawing(Bitu val);
 void VGA_CheckScanLength(void);
@@ -487,6 +494,8 @@ void VGA_SetCGA2Table(Bit8u val0,Bit8u val1);
 void VGA_SetCGA4Table(Bit8u val0,Bit8u val1,Bit8u val2,Bit8u val3);
 void VGA_ActivateHardwareCursor(void);
 void VGA_KillDrawing(void);
+void VGA_RasterRegisterWrite(void);
+void VGA_InvalidateLineCache(void);
 
 void VGA_SetOverride(bool vga_override);
 
@@ -71,6 +71,9 @@
    prediction. */
 #define C_HAS_BUILTIN_EXPECT 1
 
+/* Define to 1 if you have the mmap function */
+/* #undef C_HAVE_MMAP */
+
 /* Define to 1 if you have the mprotect function */
 /* #undef C_HAVE_MPROTECT */
 
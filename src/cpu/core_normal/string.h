@@ -32,12 +32,48 @@ enum STRING_OP {
 
 extern int cpu_rep_max;
 
+/* How many elements of a forward string op starting at base+index can be done as one block
+ * without crossing a page or wrapping the index around add_mask. Also capped to the cycles
+ * left, since every element normally costs one cycle. */
+static INLINE Bitu DoString_BlockCount(const PhysPt base,const Bitu index,const Bitu add_mask,const Bitu size,Bitu count) {
+	const Bitu room = add_mask - index; /* bytes past the first one before the index wraps */
+	Bitu n = (0x1000u - ((base + index) & 0xFFFu)) / size;
+
+	if ((room / size) < n) n = (room + 1u) / size;
+	if (n > count) n = count;
+	if (CPU_Cycles <= 0) n = 1;
+	else if (n > (Bitu)CPU_Cycles) n = (Bitu)CPU_Cycles;
+	return n;
+}
+
+/* REP INS/OUTS: a device with a block I/O handler moves a run of elements straight between
+ * the port and guest memory. Only for plain RAM already in the TLB, so the run can not fault
+ * half way after the device has already consumed the data. Returns the elements done. */
+static INLINE Bitu DoString_BlockIn(const PhysPt base,const Bitu index,const Bitu add_mask,const Bitu size,const Bitu count) {
+	const Bitu n=DoString_BlockCount(base,index,add_mask,size,count);
+	if (n < 2) return 0;
+
+	const HostPt host=MEM_GetBlockHostPt(base+index,n*size,true);
+	if (host == NULL) return 0;
+	return IO_ReadBlock(reg_dx,host,n,size);
+}
+
+static INLINE Bitu DoString_BlockOut(const PhysPt base,const Bitu index,const Bitu add_mask,const Bitu size,const Bitu count) {
+	const Bitu n=DoString_BlockCount(base,index,add_mask,size,count);
+	if (n < 2) return 0;
+
+	const HostPt host=MEM_GetBlockHostPt(base+index,n*size,false);
+	if (host == NULL) return 0;
+	return IO_WriteBlock(reg_dx,host,n,size);
+}
+
 void DoString(STRING_OP type) {
 	static PhysPt  si_base,di_base;
 	static Bitu	si_index,di_index;
 	static Bitu	add_mask;
 	static Bitu	count,count_left;
 	static Bits	add_index;
+	bool block;
 
 	count_left=0;
 	si_base=BaseDS;
@@ -48,8 +84,13 @@ void DoString(STRING_OP type) {
 	count=reg_ecx & add_mask;
 	add_index=cpu.direction;
 
+	/* forward REP STOS/MOVS try whole page runs through mem_fillblock/mem_copyblock first,
+	 * forward REP INS/OUTS through the block I/O handler of the port */
+	block=(cpu.direction > 0);
+
 	if (!TEST_PREFIX_REP) {
 		count=1;
+		block=false;
 	}
 	else {
 		/* we allow the user to cap our count as a way of making REP string operations interruptable (and at what granularity) */
@@ -97,6 +138,17 @@ void DoString(STRING_OP type) {
 			switch (type) {
 				case R_OUTSB:
 					do {
+						if (block && count > 1) {
+							Bitu n=DoString_BlockOut(si_base,si_index,add_mask,1,count);
+							if (n != 0) {
+								si_index=(si_index+n) & add_mask;
+								count-=n;
+								CPU_Cycles-=(Bits)n;
+								if (CPU_Cycles <= 0) break;
+								continue;
+							}
+							block=false;
+						}
 						IO_WriteB(reg_dx,LoadMb(si_base+si_index));
 						si_index=(si_index+add_index) & add_mask;
 						count--;
@@ -106,6 +158,17 @@ void DoString(STRING_OP type) {
 				case R_OUTSW:
 					add_index<<=1;
 					do {
+						if (block && count > 1) {
+							Bitu n=DoString_BlockOut(si_base,si_index,add_mask,2,count);
+							if (n != 0) {
+								si_index=(si_index+(n*2)) & add_mask;
+								count-=n;
+								CPU_Cycles-=(Bits)n;
+								if (CPU_Cycles <= 0) break;
+								continue;
+							}
+							block=false;
+						}
 						IO_WriteW(reg_dx,LoadMw(si_base+si_index));
 						si_index=(si_index+add_index) & add_mask;
 						count--;
@@ -115,6 +178,17 @@ void DoString(STRING_OP type) {
 				case R_OUTSD:
 					add_index<<=2;
 					do {
+						if (block && count > 1) {
+							Bitu n=DoString_BlockOut(si_base,si_index,add_mask,4,count);
+							if (n != 0) {
+								si_index=(si_index+(n*4)) & add_mask;
+								count-=n;
+								CPU_Cycles-=(Bits)n;
+								if (CPU_Cycles <= 0) break;
+								continue;
+							}
+							block=false;
+						}
 						IO_WriteD(reg_dx,LoadMd(si_base+si_index));
 						si_index=(si_index+add_index) & add_mask;
 						count--;
@@ -124,6 +198,17 @@ void DoString(STRING_OP type) {
 
 				case R_INSB:
 					do {
+						if (block && count > 1) {
+							Bitu n=DoString_BlockIn(di_base,di_index,add_mask,1,count);
+							if (n != 0) {
+								di_index=(di_index+n) & add_mask;
+								count-=n;
+								CPU_Cycles-=(Bits)n;
+								if (CPU_Cycles <= 0) break;
+								continue;
+							}
+							block=false;
+						}
 						SaveMb(di_base+di_index,IO_ReadB(reg_dx));
 						di_index=(di_index+add_index) & add_mask;
 						count--;
@@ -133,6 +218,17 @@ void DoString(STRING_OP type) {
 				case R_INSW:
 					add_index<<=1;
 					do {
+						if (block && count > 1) {
+							Bitu n=DoString_BlockIn(di_base,di_index,add_mask,2,count);
+							if (n != 0) {
+								di_index=(di_index+(n*2)) & add_mask;
+								count-=n;
+								CPU_Cycles-=(Bits)n;
+								if (CPU_Cycles <= 0) break;
+								continue;
+							}
+							block=false;
+						}
 						SaveMw(di_base+di_index,IO_ReadW(reg_dx));
 						di_index=(di_index+add_index) & add_mask;
 						count--;
@@ -142,6 +238,17 @@ void DoString(STRING_OP type) {
 				case R_INSD:
 					add_index<<=2;
 					do {
+						if (block && count > 1) {
+							Bitu n=DoString_BlockIn(di_base,di_index,add_mask,4,count);
+							if (n != 0) {
+								di_index=(di_index+(n*4)) & add_mask;
+								count-=n;
+								CPU_Cycles-=(Bits)n;
+								if (CPU_Cycles <= 0) break;
+								continue;
+							}
+							block=false;
+						}
 						SaveMd(di_base+di_index,IO_ReadD(reg_dx));
 						di_index=(di_index+add_index) & add_mask;
 						count--;
@@ -151,6 +258,19 @@ void DoString(STRING_OP type) {
 
 				case R_STOSB:
 					do {
+						if (block && count > 1) {
+							Bitu n=DoString_BlockCount(di_base,di_index,add_mask,1,count);
+							if (n > 1) {
+								if ((n=mem_fillblock(di_base+di_index,reg_al,1,n)) != 0) {
+									di_index=(di_index+n) & add_mask;
+									count-=n;
+									CPU_Cycles-=(Bits)n;
+									if (CPU_Cycles <= 0) break;
+									continue;
+								}
+								block=false;
+							}
+						}
 						SaveMb(di_base+di_index,reg_al);
 						di_index=(di_index+add_index) & add_mask;
 						count--;
@@ -160,6 +280,19 @@ void DoString(STRING_OP type) {
 				case R_STOSW:
 					add_index<<=1;
 					do {
+						if (block && count > 1) {
+							Bitu n=DoString_BlockCount(di_base,di_index,add_mask,2,count);
+							if (n > 1) {
+								if ((n=mem_fillblock(di_base+di_index,reg_ax,2,n)) != 0) {
+									di_index=(di_index+(n*2)) & add_mask;
+									count-=n;
+									CPU_Cycles-=(Bits)n;
+									if (CPU_Cycles <= 0) break;
+									continue;
+								}
+								block=false;
+							}
+						}
 						SaveMw(di_base+di_index,reg_ax);
 						di_index=(di_index+add_index) & add_mask;
 						count--;
@@ -169,6 +302,19 @@ void DoString(STRING_OP type) {
 				case R_STOSD:
 					add_index<<=2;
 					do {
+						if (block && count > 1) {
+							Bitu n=DoString_BlockCount(di_base,di_index,add_mask,4,count);
+							if (n > 1) {
+								if ((n=mem_fillblock(di_base+di_index,reg_eax,4,n)) != 0) {
+									di_index=(di_index+(n*4)) & add_mask;
+									count-=n;
+									CPU_Cycles-=(Bits)n;
+									if (CPU_Cycles <= 0) break;
+									continue;
+								}
+								block=false;
+							}
+						}
 						SaveMd(di_base+di_index,reg_eax);
 						di_index=(di_index+add_index) & add_mask;
 						count--;
@@ -178,6 +324,21 @@ void DoString(STRING_OP type) {
 
 				case R_MOVSB:
 					do {
+						if (block && count > 1) {
+							Bitu n=DoString_BlockCount(di_base,di_index,add_mask,1,count);
+							n=DoString_BlockCount(si_base,si_index,add_mask,1,n);
+							if (n > 1) {
+								if ((n=mem_copyblock(di_base+di_index,si_base+si_index,1,n)) != 0) {
+									di_index=(di_index+n) & add_mask;
+									si_index=(si_index+n) & add_mask;
+									count-=n;
+									CPU_Cycles-=(Bits)n;
+									if (CPU_Cycles <= 0) break;
+									continue;
+								}
+								block=false;
+							}
+						}
 						SaveMb(di_base+di_index,LoadMb(si_base+si_index));
 						di_index=(di_index+add_index) & add_mask;
 						si_index=(si_index+add_index) & add_mask;
@@ -188,6 +349,21 @@ void DoString(STRING_OP type) {
 				case R_MOVSW:
 					add_index<<=1;
 					do {
+						if (block && count > 1) {
+							Bitu n=DoString_BlockCount(di_base,di_index,add_mask,2,count);
+							n=DoString_BlockCount(si_base,si_index,add_mask,2,n);
+							if (n > 1) {
+								if ((n=mem_copyblock(di_base+di_index,si_base+si_index,2,n)) != 0) {
+									di_index=(di_index+(n*2)) & add_mask;
+									si_index=(si_index+(n*2)) & add_mask;
+									count-=n;
+									CPU_Cycles-=(Bits)n;
+									if (CPU_Cycles <= 0) break;
+									continue;
+								}
+								block=false;
+							}
+						}
 						SaveMw(di_base+di_index,LoadMw(si_base+si_index));
 						di_index=(di_index+add_index) & add_mask;
 						si_index=(si_index+add_index) & add_mask;
@@ -198,6 +374,21 @@ void DoString(STRING_OP type) {
 				case R_MOVSD:
 					add_index<<=2;
 					do {
+						if (block && count > 1) {
+							Bitu n=DoString_BlockCount(di_base,di_index,add_mask,4,count);
+							n=DoString_BlockCount(si_base,si_index,add_mask,4,n);
+							if (n > 1) {
+								if ((n=mem_copyblock(di_base+di_index,si_base+si_index,4,n)) != 0) {
+									di_index=(di_index+(n*4)) & add_mask;
+									si_index=(si_index+(n*4)) & add_mask;
+									count-=n;
+									CPU_Cycles-=(Bits)n;
+									if (CPU_Cycles <= 0) break;
+									continue;
+								}
+								block=false;
+							}
+						}
 						SaveMd(di_base+di_index,LoadMd(si_base+si_index));
 						di_index=(di_index+add_index) & add_mask;
 						si_index=(si_index+add_index) & add_mask;
@@ -92,6 +92,13 @@ bool PageHandler::writed_checked(PhysPt addr,Bitu val) {
 	writed(addr,val);	return false;
 }
 
+Bitu PageHandler::writeblock_fill(PhysPt /*addr*/,Bitu /*val*/,Bitu /*size*/,Bitu /*count*/) {
+	return 0;
+}
+Bitu PageHandler::writeblock_copy(PhysPt /*addr*/,ConstHostPt /*src*/,Bitu /*size*/,Bitu /*count*/) {
+	return 0;
+}
+
 
 
 struct PF_Entry {
@@ -553,13 +553,6 @@ void DEBUG_ShowMsg(char const* format,...) {
 	va_list msg;
 	size_t len;
 
-    // in case of runaway error from the CPU core, user responsiveness can be helpful
-	CPU_CycleLeft += CPU_Cycles;
-	CPU_Cycles = 0;
-
-	void GFX_Events();
-	GFX_Events();
-		
 	va_start(msg,format);
 	len = vsnprintf(buf,sizeof(buf)-2,format,msg); /* <- NTS: Did you know sprintf/vsnprintf returns number of chars written? */
 	va_end(msg);
@@ -567,6 +560,18 @@ void DEBUG_ShowMsg(char const* format,...) {
     /* remove newlines if present */
     while (len > 0 && buf[len-1] == '\n') buf[--len] = 0;
 
+    /* the disk I/O thread must not touch the CPU core, the GUI or the log buffer, its
+     * messages are handed back to the emulation thread */
+	bool DISKIO_DeferLog(const char *msg);
+	if (DISKIO_DeferLog(buf)) return;
+
+    // in case of runaway error from the CPU core, user responsiveness can be helpful
+	CPU_CycleLeft += CPU_Cycles;
+	CPU_Cycles = 0;
+
+	void GFX_Events();
+	GFX_Events();
+
 	if (do_LOG_stderr || debuglog == NULL)
 		stderrlog = true;
 
@@ -154,6 +154,9 @@ public:
 	bool	LoadUnloadMedia		(bool /*unload*/) { return true; };
 };	
 
+class CDAudioDecoder;
+class HunkImage;
+
 class CDROM_Interface_Image : public CDROM_Interface
 {
 private:
@@ -161,6 +164,10 @@ private:
 	public:
 		virtual bool read(Bit8u *buffer, int seek, int count) = 0;
 		virtual int getLength() = 0;
+		/* whether read() of this range would return without waiting, for audio playback */
+		virtual bool ready(int /*seek*/, int /*count*/) { return true; }
+		/* playback moved elsewhere or stopped, release what ready() set up */
+		virtual void stop() { }
 		virtual ~TrackFile() { };
 	};
 	
@@ -175,6 +182,52 @@ private:
 		std::ifstream *file;
 	};
 
+	/* BINARY or ISO file stored in a compressed hunk container (see hunk_image.h).
+	 * Data reads and CD audio playback share the container, so reads are serialized. */
+	class HunkFile : public TrackFile {
+	public:
+		static HunkFile* Open(const char *filename);
+		~HunkFile();
+		bool read(Bit8u *buffer, int seek, int count);
+		int getLength();
+	private:
+		HunkFile(HunkImage *image);
+		HunkImage *image;
+		SDL_mutex *mutex;
+	};
+
+	/* Audio track in a WAVE or compressed file, read as raw CD audio (44.1kHz 16-bit
+	 * stereo, little endian), seek offsets are into that stream. While the track plays a
+	 * thread decodes it ahead, other reads decode on the spot. */
+	class AudioFile : public TrackFile {
+	public:
+		static AudioFile* Open(const char *filename);
+		~AudioFile();
+		bool read(Bit8u *buffer, int seek, int count);
+		int getLength();
+		bool ready(int seek, int count);
+		void stop();
+	private:
+		AudioFile(CDAudioDecoder *decoder);
+		void Start(void);
+		void Reposition(int seek);
+		static int DecodeThread(void *data);
+
+		CDAudioDecoder *decoder;
+		SDL_Thread *thread;
+		SDL_mutex *mutex;
+		SDL_cond *cond;
+		std::vector<Bit8u> ring;
+		int ringHead;		// index of the first buffered byte in ring
+		int ringFill;		// buffered bytes
+		int ringStart;		// stream offset of the first buffered byte
+		int seekPos;		// stream offset the thread has to go to, -1 if none
+		int syncPos;		// stream offset of the decoder without a thread, -1 if unknown
+		int length;
+		bool atEnd;		// decoded to the end of the stream
+		bool quit;
+	};
+
 	struct Track {
 		int number;
 		int attr;
@@ -215,6 +268,8 @@ private:
 	// player
 static	void	CDAudioCallBack(Bitu len);
 	int	GetTrack(int sector);
+	unsigned long	ReadRun(Bit8u *buffer, bool raw, unsigned long sector, unsigned long num);
+	bool	AudioReady(unsigned long sector);
 
 static  struct imagePlayer {
 		CDROM_Interface_Image *cd;
@@ -246,6 +301,9 @@ static	int	refCount;
 typedef	std::vector<Track>::iterator	track_it;
 	std::string	mcn;
 	Bit8u	subUnit;
+	std::vector<Bit8u>	readBuffer;	// ReadSectors into guest memory that is not plain RAM
+	std::vector<Bit8u>	rawBuffer;	// whole raw sectors, cooked data is picked out of these
+	TrackFile*	playFile;	// file of the track being played, its decoder is running
 };
 
 #if defined (WIN32)	/* Win 32 */
@@ -30,6 +30,8 @@
 #include "support.h"
 #include "control.h"
 #include "setup.h"
+#include "dos_inc.h"
+#include "hunk_image.h"
 
 #if !defined(WIN32)
 #include <libgen.h>
@@ -37,6 +39,13 @@
 #include <string.h>
 #endif
 
+#if defined(C_VORBISFILE)
+#include <vorbis/vorbisfile.h>
+#endif
+#if defined(C_FLAC)
+#include <FLAC/stream_decoder.h>
+#endif
+
 using namespace std;
 
 #define MAX_LINE_LENGTH 512
@@ -69,6 +78,456 @@ int CDROM_Interface_Image::BinaryFile::getLength()
 	return length;
 }
 
+CDROM_Interface_Image::HunkFile* CDROM_Interface_Image::HunkFile::Open(const char *filename)
+{
+	FILE *f = fopen64(filename, "rb");
+	if (!f) return NULL;
+	if (!HunkImage::IsHunkImage(f)) {
+		fclose(f);
+		return NULL;
+	}
+	HunkImage *image = HunkImage::Open(f);	// closes f on failure
+	if (!image) return NULL;
+	if (image->GetSize() > (Bit64u)std::numeric_limits<int>::max()) {
+		LOG_MSG("CDROM: hunk image %s is too large", filename);
+		delete image;
+		return NULL;
+	}
+	return new HunkFile(image);
+}
+
+CDROM_Interface_Image::HunkFile::HunkFile(HunkImage *image) : image(image)
+{
+	mutex = SDL_CreateMutex();
+}
+
+CDROM_Interface_Image::HunkFile::~HunkFile()
+{
+	SDL_DestroyMutex(mutex);
+	delete image;
+	image = NULL;
+}
+
+bool CDROM_Interface_Image::HunkFile::read(Bit8u *buffer, int seek, int count)
+{
+	if (seek < 0 || count < 0) return false;
+	SDL_LockMutex(mutex);
+	bool ok = image->Read((Bit64u)seek, buffer, (size_t)count);
+	SDL_UnlockMutex(mutex);
+	return ok;
+}
+
+int CDROM_Interface_Image::HunkFile::getLength()
+{
+	return (int)image->GetSize();
+}
+
+/* Audio decoders. They produce CD audio samples: 44.1kHz, 16-bit, stereo, little endian.
+ * Mono sources are played on both channels, other sample rates are not supported. */
+class CDAudioDecoder {
+public:
+	virtual ~CDAudioDecoder() { }
+	/* decodes up to frames sample frames into buffer, returns how many, 0 at the end */
+	virtual int Read(Bit8u *buffer, int frames) = 0;
+	virtual bool Seek(int frame) = 0;
+	virtual int Length() = 0;
+protected:
+	/* widens frames of mono samples at the start of buffer to stereo, in place */
+	static void ExpandMono(Bit8u *buffer, int frames) {
+		for (int i = frames - 1; i >= 0; i--) {
+			Bit8u lo = buffer[i * 2], hi = buffer[i * 2 + 1];
+			buffer[i * 4 + 0] = lo; buffer[i * 4 + 1] = hi;
+			buffer[i * 4 + 2] = lo; buffer[i * 4 + 3] = hi;
+		}
+	}
+	static bool Supported(const char *filename, long rate, int channels) {
+		if (rate == 44100 && (channels == 1 || channels == 2)) return true;
+		LOG_MSG("CDROM: %s has %ld Hz, %d channels; CD audio tracks must be 44100 Hz mono or stereo", filename, rate, channels);
+		return false;
+	}
+};
+
+/* RIFF WAVE, 16-bit PCM */
+class WaveDecoder : public CDAudioDecoder {
+public:
+	static WaveDecoder* Open(const char *filename) {
+		FILE *f = fopen(filename, "rb");
+		if (!f) return NULL;
+		Bit8u header[12];
+		if (fread(header, 1, 12, f) != 12 || memcmp(header, "RIFF", 4) || memcmp(header + 8, "WAVE", 4)) {
+			fclose(f);
+			return NULL;
+		}
+		bool pcm = false;
+		int channels = 0;
+		for (;;) {
+			Bit8u chunk[8];
+			if (fread(chunk, 1, 8, f) != 8) break;
+			Bit32u size = host_readd(&chunk[4]);
+			if (!memcmp(chunk, "fmt ", 4) && size >= 16) {
+				Bit8u fmt[16];
+				if (fread(fmt, 1, 16, f) != 16) break;
+				channels = host_readw(&fmt[2]);
+				pcm = host_readw(&fmt[0]) == 1 && host_readw(&fmt[14]) == 16 && Supported(filename, (long)host_readd(&fmt[4]), channels);
+				if (!pcm) break;
+				fseek(f, (long)(size - 16 + (size & 1)), SEEK_CUR);
+			} else if (!memcmp(chunk, "data", 4)) {
+				if (!pcm) break;
+				return new WaveDecoder(f, ftell(f), (int)(size / (2 * channels)), channels);
+			} else {
+				fseek(f, (long)(size + (size & 1)), SEEK_CUR);
+			}
+		}
+		fclose(f);
+		return NULL;
+	}
+	~WaveDecoder() { fclose(file); }
+	int Read(Bit8u *buffer, int frames) {
+		if (frames > length - pos) frames = length - pos;
+		if (frames <= 0) return 0;
+		frames = (int)fread(buffer, 2 * channels, frames, file);
+		if (channels == 1) ExpandMono(buffer, frames);
+		pos += frames;
+		return frames;
+	}
+	bool Seek(int frame) {
+		if (frame > length) frame = length;
+		pos = frame;
+		return fseek(file, dataStart + (long)frame * 2 * channels, SEEK_SET) == 0;
+	}
+	int Length() { return length; }
+private:
+	WaveDecoder(FILE *file, long dataStart, int length, int channels)
+		: file(file), dataStart(dataStart), length(length), pos(0), channels(channels) { }
+	FILE *file;
+	long dataStart;
+	int length, pos, channels;
+};
+
+#if defined(C_VORBISFILE)
+/* Ogg Vorbis through libvorbisfile */
+class VorbisDecoder : public CDAudioDecoder {
+public:
+	static VorbisDecoder* Open(const char *filename) {
+		VorbisDecoder *d = new VorbisDecoder();
+		if (ov_fopen((char*)filename, &d->vf) != 0) {
+			delete d;
+			return NULL;
+		}
+		d->opened = true;
+		vorbis_info *vi = ov_info(&d->vf, -1);
+		if (!vi || !Supported(filename, vi->rate, vi->channels)) {
+			delete d;
+			return NULL;
+		}
+		d->channels = vi->channels;
+		return d;
+	}
+	~VorbisDecoder() { if (opened) ov_clear(&vf); }
+	int Read(Bit8u *buffer, int frames) {
+		int want = frames * 2 * channels;
+		int got = 0;
+		while (got < want) {
+			int bitstream;
+			long n = ov_read(&vf, (char*)buffer + got, want - got, 0 /* little endian */, 2, 1, &bitstream);
+			if (n == OV_HOLE) continue;
+			if (n <= 0) break;
+			got += (int)n;
+		}
+		frames = got / (2 * channels);
+		if (channels == 1) ExpandMono(buffer, frames);
+		return frames;
+	}
+	bool Seek(int frame) { return ov_pcm_seek(&vf, frame) == 0; }
+	int Length() {
+		ogg_int64_t total = ov_pcm_total(&vf, -1);
+		return total < 0 ? 0 : (int)total;
+	}
+private:
+	VorbisDecoder() : opened(false), channels(2) { }
+	OggVorbis_File vf;
+	bool opened;
+	int channels;
+};
+#endif
+
+#if defined(C_FLAC)
+/* FLAC through libFLAC, any bit depth is scaled to 16 bits */
+class FlacDecoder : public CDAudioDecoder {
+public:
+	static FlacDecoder* Open(const char *filename) {
+		FlacDecoder *d = new FlacDecoder();
+		if (!d->decoder
+			|| FLAC__stream_decoder_init_file(d->decoder, filename, Write, Metadata, Error, d) != FLAC__STREAM_DECODER_INIT_STATUS_OK
+			|| !FLAC__stream_decoder_process_until_end_of_metadata(d->decoder)
+			|| d->rate == 0 || !Supported(filename, (long)d->rate, (int)d->channels)) {
+			delete d;
+			return NULL;
+		}
+		return d;
+	}
+	~FlacDecoder() {
+		if (decoder) {
+			FLAC__stream_decoder_finish(decoder);
+			FLAC__stream_decoder_delete(decoder);
+		}
+	}
+	int Read(Bit8u *buffer, int frames) {
+		int done = 0;
+		while (done < frames) {
+			if (pendingPos >= pending.size()) {
+				pending.clear();
+				pendingPos = 0;
+				if (FLAC__stream_decoder_get_state(decoder) == FLAC__STREAM_DECODER_END_OF_STREAM) break;
+				if (!FLAC__stream_decoder_process_single(decoder)) break;
+				continue;
+			}
+			int n = (int)((pending.size() - pendingPos) / 4);
+			if (n > frames - done) n = frames - done;
+			memcpy(buffer + done * 4, &pending[pendingPos], n * 4);
+			pendingPos += n * 4;
+			done += n;
+		}
+		return done;
+	}
+	bool Seek(int frame) {
+		// the decoder hands out the frame holding the target from the target sample on
+		pending.clear();
+		pendingPos = 0;
+		if (FLAC__stream_decoder_seek_absolute(decoder, (FLAC__uint64)frame)) return true;
+		if (FLAC__stream_decoder_get_state(decoder) == FLAC__STREAM_DECODER_SEEK_ERROR)
+			FLAC__stream_decoder_flush(decoder);
+		return false;
+	}
+	int Length() { return (int)total; }
+private:
+	FlacDecoder() : total(0), rate(0), channels(0), pendingPos(0) {
+		decoder = FLAC__stream_decoder_new();
+	}
+	static FLAC__StreamDecoderWriteStatus Write(const FLAC__StreamDecoder* /*decoder*/, const FLAC__Frame *frame, const FLAC__int32 * const buffer[], void *client) {
+		FlacDecoder *d = (FlacDecoder*)client;
+		unsigned bits = frame->header.bits_per_sample;
+		unsigned right = frame->header.channels > 1 ? 1 : 0;
+		size_t base = d->pending.size();
+		d->pending.resize(base + frame->header.blocksize * 4);
+		Bit8u *out = &d->pending[base];
+		for (unsigned i = 0; i < frame->header.blocksize; i++) {
+			FLAC__int32 l = buffer[0][i], r = buffer[right][i];
+			if (bits > 16) { l >>= bits - 16; r >>= bits - 16; }
+			else if (bits < 16) { l <<= 16 - bits; r <<= 16 - bits; }
+			host_writew(out, (Bit16u)l);
+			host_writew(out + 2, (Bit16u)r);
+			out += 4;
+		}
+		return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
+	}
+	static void Metadata(const FLAC__StreamDecoder* /*decoder*/, const FLAC__StreamMetadata *metadata, void *client) {
+		FlacDecoder *d = (FlacDecoder*)client;
+		if (metadata->type != FLAC__METADATA_TYPE_STREAMINFO) return;
+		d->total = metadata->data.stream_info.total_samples;
+		d->rate = metadata->data.stream_info.sample_rate;
+		d->channels = metadata->data.stream_info.channels;
+	}
+	static void Error(const FLAC__StreamDecoder* /*decoder*/, FLAC__StreamDecoderErrorStatus /*status*/, void* /*client*/) {
+	}
+	FLAC__StreamDecoder *decoder;
+	FLAC__uint64 total;
+	unsigned rate, channels;
+	std::vector<Bit8u> pending;
+	size_t pendingPos;
+};
+#endif
+
+#if defined(C_FLAC) && defined(C_VORBISFILE)
+#define AUDIO_FILE_FORMATS	"44.1kHz WAVE, FLAC or Ogg Vorbis"
+#elif defined(C_FLAC)
+#define AUDIO_FILE_FORMATS	"44.1kHz WAVE or FLAC"
+#elif defined(C_VORBISFILE)
+#define AUDIO_FILE_FORMATS	"44.1kHz WAVE or Ogg Vorbis"
+#else
+#define AUDIO_FILE_FORMATS	"44.1kHz 16-bit WAVE"
+#endif
+#define AUDIO_DECODE_AHEAD	(RAW_SECTOR_SIZE * 75 * 4)	// 4 seconds
+#define AUDIO_DECODE_CHUNK	(RAW_SECTOR_SIZE * 4)
+
+CDROM_Interface_Image::AudioFile* CDROM_Interface_Image::AudioFile::Open(const char *filename)
+{
+	CDAudioDecoder *decoder = WaveDecoder::Open(filename);
+#if defined(C_FLAC)
+	if (!decoder) decoder = FlacDecoder::Open(filename);
+#endif
+#if defined(C_VORBISFILE)
+	if (!decoder) decoder = VorbisDecoder::Open(filename);
+#endif
+	if (!decoder) return NULL;
+	return new AudioFile(decoder);
+}
+
+CDROM_Interface_Image::AudioFile::AudioFile(CDAudioDecoder *decoder)
+	: decoder(decoder), thread(NULL), ringHead(0), ringFill(0), ringStart(0), seekPos(-1), syncPos(0), atEnd(false), quit(false)
+{
+	length = decoder->Length() * 4;
+	mutex = SDL_CreateMutex();
+	cond = SDL_CreateCond();
+}
+
+CDROM_Interface_Image::AudioFile::~AudioFile()
+{
+	stop();
+	SDL_DestroyCond(cond);
+	SDL_DestroyMutex(mutex);
+	delete decoder;
+}
+
+int CDROM_Interface_Image::AudioFile::getLength()
+{
+	return length;
+}
+
+// the decoder thread only runs while the track plays. Called with the mutex held.
+void CDROM_Interface_Image::AudioFile::Start(void)
+{
+	if (thread) return;
+	ring.resize(AUDIO_DECODE_AHEAD);
+	ringHead = 0;
+	ringFill = 0;
+	ringStart = 0;
+	seekPos = 0;	// wherever the decoder was left, Reposition() takes it from here
+	atEnd = false;
+	quit = false;
+#if defined(C_SDL2)
+	thread = SDL_CreateThread(DecodeThread, "CD audio decoder", this);
+#else
+	thread = SDL_CreateThread(DecodeThread, this);
+#endif
+}
+
+void CDROM_Interface_Image::AudioFile::stop()
+{
+	if (!thread) return;
+	SDL_LockMutex(mutex);
+	quit = true;
+	SDL_CondBroadcast(cond);
+	SDL_UnlockMutex(mutex);
+	SDL_WaitThread(thread, NULL);
+	thread = NULL;
+	std::vector<Bit8u>().swap(ring);
+	ringFill = 0;
+	syncPos = -1;
+}
+
+// makes seek the start of the buffered data, keeping what was decoded from there on.
+// Called with the mutex held.
+void CDROM_Interface_Image::AudioFile::Reposition(int seek)
+{
+	if (seek >= ringStart && seek <= ringStart + ringFill && seekPos < 0) {
+		int drop = seek - ringStart;
+		ringHead = (ringHead + drop) % (int)ring.size();
+		ringFill -= drop;
+		ringStart = seek;
+	} else if (seek != ringStart || seekPos < 0) {
+		seekPos = seek;
+		ringStart = seek;
+		ringHead = 0;
+		ringFill = 0;
+		atEnd = false;
+	}
+	SDL_CondBroadcast(cond);
+}
+
+bool CDROM_Interface_Image::AudioFile::ready(int seek, int count)
+{
+	SDL_LockMutex(mutex);
+	Start();
+	Reposition(seek);
+	bool result = ringFill >= count || (atEnd && seekPos < 0);
+	SDL_UnlockMutex(mutex);
+	return result;
+}
+
+bool CDROM_Interface_Image::AudioFile::read(Bit8u *buffer, int seek, int count)
+{
+	int done = 0;
+	if (!thread) {
+		// not playing, decode just what is asked for
+		if (seek != syncPos && !decoder->Seek(seek / 4)) seek = -1;
+		while (seek >= 0 && done < count) {
+			int n = decoder->Read(buffer + done, (count - done) / 4) * 4;
+			if (n == 0) break;
+			done += n;
+		}
+		syncPos = seek >= 0 ? seek + done : -1;
+		memset(buffer + done, 0, count - done);
+		return true;
+	}
+
+	SDL_LockMutex(mutex);
+	Reposition(seek);
+	while (done < count) {
+		while (ringFill == 0 && !(atEnd && seekPos < 0)) SDL_CondWait(cond, mutex);
+		if (ringFill == 0) break;
+		int n = count - done;
+		if (n > ringFill) n = ringFill;
+		if (n > (int)ring.size() - ringHead) n = (int)ring.size() - ringHead;
+		memcpy(buffer + done, &ring[ringHead], n);
+		ringHead = (ringHead + n) % (int)ring.size();
+		ringFill -= n;
+		ringStart += n;
+		done += n;
+		SDL_CondBroadcast(cond);
+	}
+	SDL_UnlockMutex(mutex);
+	// past the end of the stream
+	memset(buffer + done, 0, count - done);
+	return true;
+}
+
+int CDROM_Interface_Image::AudioFile::DecodeThread(void *data)
+{
+	AudioFile *af = (AudioFile*)data;
+	Bit8u chunk[AUDIO_DECODE_CHUNK];
+
+	SDL_LockMutex(af->mutex);
+	while (!af->quit) {
+		if (af->seekPos >= 0) {
+			int pos = af->seekPos;
+			af->seekPos = -1;
+			SDL_UnlockMutex(af->mutex);
+			bool success = af->decoder->Seek(pos / 4);
+			SDL_LockMutex(af->mutex);
+			if (!success && af->seekPos < 0) {
+				af->atEnd = true;
+				SDL_CondBroadcast(af->cond);
+			}
+			continue;
+		}
+		if (af->atEnd || (int)af->ring.size() - af->ringFill < AUDIO_DECODE_CHUNK) {
+			SDL_CondWait(af->cond, af->mutex);
+			continue;
+		}
+
+		SDL_UnlockMutex(af->mutex);
+		int bytes = af->decoder->Read(chunk, AUDIO_DECODE_CHUNK / 4) * 4;
+		SDL_LockMutex(af->mutex);
+		// moved elsewhere meanwhile, this is of no use
+		if (af->seekPos >= 0) continue;
+
+		if (bytes == 0) af->atEnd = true;
+		int size = (int)af->ring.size();
+		for (int done = 0; done < bytes; ) {
+			int tail = (af->ringHead + af->ringFill) % size;
+			int n = bytes - done;
+			if (n > size - tail) n = size - tail;
+			memcpy(&af->ring[tail], &chunk[done], n);
+			af->ringFill += n;
+			done += n;
+		}
+		SDL_CondBroadcast(af->cond);
+	}
+	SDL_UnlockMutex(af->mutex);
+	return 0;
+}
+
 // initialize static members
 int CDROM_Interface_Image::refCount = 0;
 CDROM_Interface_Image* CDROM_Interface_Image::images[26] = {NULL};
@@ -78,6 +537,7 @@ CDROM_Interface_Image::imagePlayer CDROM_Interface_Image::player = {
 	
 CDROM_Interface_Image::CDROM_Interface_Image(Bit8u subUnit)
 {
+	playFile = NULL;
 	images[subUnit] = this;
 	if (refCount == 0) {
 		player.mutex = SDL_CreateMutex();
@@ -189,6 +649,8 @@ bool CDROM_Interface_Image::PlayAudioSector(unsigned long start,unsigned long le
 		//Real drives either fail or succeed as well
 	} else player.isPlaying = true;
 	player.isPaused = false;
+	// get compressed tracks decoding from the new position right away
+	AudioReady(start);
 	SDL_mutexV(player.mutex);
 	return true;
 }
@@ -201,8 +663,12 @@ bool CDROM_Interface_Image::PauseAudio(bool resume)
 
 bool CDROM_Interface_Image::StopAudio(void)
 {
+	SDL_mutexP(player.mutex);
 	player.isPlaying = false;
 	player.isPaused = false;
+	if (playFile) playFile->stop();
+	playFile = NULL;
+	SDL_mutexV(player.mutex);
 	return true;
 }
 
@@ -214,18 +680,17 @@ void CDROM_Interface_Image::ChannelControl(TCtrl ctrl)
 
 bool CDROM_Interface_Image::ReadSectors(PhysPt buffer, bool raw, unsigned long sector, unsigned long num)
 {
+	if (num == 0) return true; //Gobliiins reads 0 sectors
 	int sectorSize = raw ? RAW_SECTOR_SIZE : COOKED_SECTOR_SIZE;
 	Bitu buflen = num * sectorSize;
-	Bit8u* buf = new Bit8u[buflen];
-	
-	bool success = true; //Gobliiins reads 0 sectors
-	for(unsigned long i = 0; i < num; i++) {
-		success = ReadSector(&buf[i * sectorSize], raw, sector + i);
-		if (!success) break;
-	}
 
-	MEM_BlockWrite(buffer, buf, buflen);
-	delete[] buf;
+	// read straight into guest memory if it is plain RAM
+	HostPt host = MEM_GetBlockHostPt(buffer, buflen, true);
+	if (host) return ReadSectorsHost(host, raw, sector, num);
+
+	if (readBuffer.size() < buflen) readBuffer.resize(buflen);
+	bool success = ReadSectorsHost(&readBuffer[0], raw, sector, num);
+	MEM_BlockWrite(buffer, &readBuffer[0], buflen);
 
 	return success;
 }
@@ -233,13 +698,15 @@ bool CDROM_Interface_Image::ReadSectors(PhysPt buffer, bool raw, unsigned long s
 bool CDROM_Interface_Image::ReadSectorsHost(void *buffer, bool raw, unsigned long sector, unsigned long num)
 {
 	int sectorSize = raw ? RAW_SECTOR_SIZE : COOKED_SECTOR_SIZE;
-	bool success = true; //Gobliiins reads 0 sectors
-	for(unsigned long i = 0; i < num; i++) {
-		success = ReadSector((Bit8u*)buffer + (i * sectorSize), raw, sector + i);
-		if (!success) break;
+	Bit8u *buf = (Bit8u*)buffer;
+	while (num > 0) {
+		unsigned long done = ReadRun(buf, raw, sector, num);
+		if (done == 0) return false;
+		buf += done * sectorSize;
+		sector += done;
+		num -= done;
 	}
-
-	return success;
+	return true;
 }
 
 bool CDROM_Interface_Image::LoadUnloadMedia(bool unload)
@@ -249,48 +716,92 @@ bool CDROM_Interface_Image::LoadUnloadMedia(bool unload)
 
 int CDROM_Interface_Image::GetTrack(int sector)
 {
-	vector<Track>::iterator i = tracks.begin();
-	vector<Track>::iterator end = tracks.end() - 1;
-	
-	while(i != end) {
-		Track &curr = *i;
-		Track &next = *(i + 1);
-		if (curr.start <= sector && sector < next.start) return curr.number;
-		i++;
+	// tracks are sorted by start, the last one is the lead-out
+	int low = 0;
+	int high = (int)tracks.size() - 2;
+	while (low <= high) {
+		int mid = (low + high) / 2;
+		if (sector < tracks[mid].start) high = mid - 1;
+		else if (sector >= tracks[mid + 1].start) low = mid + 1;
+		else return tracks[mid].number;
 	}
 	return -1;
 }
 
+/* whether reading the audio of sector would return right away */
+bool CDROM_Interface_Image::AudioReady(unsigned long sector)
+{
+	int trackIndex = GetTrack(sector) - 1;
+	if (trackIndex < 0) return true;
+	Track &track = tracks[trackIndex];
+	// playback went to another file, its decoder is no longer needed
+	if (track.file != playFile) {
+		if (playFile) playFile->stop();
+		playFile = track.file;
+	}
+	if (sector >= (unsigned long)(track.start + track.length)) return true;
+	return track.file->ready(track.skip + (sector - track.start) * track.sectorSize, RAW_SECTOR_SIZE);
+}
+
 bool CDROM_Interface_Image::ReadSector(Bit8u *buffer, bool raw, unsigned long sector)
 {
-	int track = GetTrack(sector) - 1;
-	if (track < 0) return false;
+	return ReadRun(buffer, raw, sector, 1) == 1;
+}
+
+/* Reads up to num sectors starting at sector, as far as they lie in the same track, with
+ * a single file read. Returns the number of sectors read, 0 on failure. */
+unsigned long CDROM_Interface_Image::ReadRun(Bit8u *buffer, bool raw, unsigned long sector, unsigned long num)
+{
+	int trackIndex = GetTrack(sector) - 1;
+	if (trackIndex < 0) return 0;
+	Track &track = tracks[trackIndex];
 
-	if (tracks[track].sectorSize != RAW_SECTOR_SIZE && raw) return false;
+	if (track.sectorSize != RAW_SECTOR_SIZE && raw) return 0;
 
 	/* we must reject non-raw reads against CD audio sectors.
 	 * not just for correctness, but also to avoid a weird bug in MSCDEX.EXE
 	 * that reads the non-data sectors one-by-one looking for a volume label
 	 * that doesn't exist on pure CD audio emulated images */
-	if (tracks[track].sectorSize == RAW_SECTOR_SIZE && !raw) {
-		if ((tracks[track].attr&0x40) == 0x00) {
+	if (track.sectorSize == RAW_SECTOR_SIZE && !raw) {
+		if ((track.attr&0x40) == 0x00) {
 			LOG_MSG("Rejecting cooked read from raw audio CD sector\n");
-			return false;
+			return 0;
 		}
 	}
 
 	int length = (raw ? RAW_SECTOR_SIZE : COOKED_SECTOR_SIZE);
+	unsigned long trackEnd = (unsigned long)(track.start + track.length);
 
-	if (sector >= (unsigned long)(tracks[track].start + tracks[track].length)) {
-		memset(buffer, 0, length);
-		return true;
+	// the gap up to the next track reads as zeroes
+	if (sector >= trackEnd) {
+		unsigned long count = (unsigned long)tracks[trackIndex + 1].start - sector;
+		if (count > num) count = num;
+		memset(buffer, 0, count * length);
+		return count;
 	}
 
-	int seek = tracks[track].skip + (sector - tracks[track].start) * tracks[track].sectorSize;
-	if (tracks[track].sectorSize == RAW_SECTOR_SIZE && !tracks[track].mode2 && !raw) seek += 16;
-	if (tracks[track].mode2 && !raw) seek += 24;
+	unsigned long count = trackEnd - sector;
+	if (count > num) count = num;
+
+	int seek = track.skip + (sector - track.start) * track.sectorSize;
+	int offset = 0;
+	if (track.sectorSize == RAW_SECTOR_SIZE && !track.mode2 && !raw) offset = 16;
+	if (track.mode2 && !raw) offset += 24;
 
-	return tracks[track].file->read(buffer, seek, length);
+	if (offset == 0 && track.sectorSize == length) {
+		// the sectors are stored back to back as requested
+		if (!track.file->read(buffer, seek, (int)(count * length))) return 0;
+		return count;
+	}
+
+	// cooked data out of larger sectors, read them whole and pick it out
+	if (count > 64) count = 64;
+	int span = (int)((count - 1) * track.sectorSize) + offset + length;
+	if (rawBuffer.size() < (size_t)span) rawBuffer.resize(span);
+	if (!track.file->read(&rawBuffer[0], seek, span)) return 0;
+	for (unsigned long i = 0; i < count; i++)
+		memcpy(buffer + i * length, &rawBuffer[i * track.sectorSize + offset], length);
+	return count;
 }
 
 void CDROM_Interface_Image::CDAudioCallBack(Bitu len)
@@ -305,9 +816,15 @@ void CDROM_Interface_Image::CDAudioCallBack(Bitu len)
 	SDL_mutexP(player.mutex);
 	while (player.bufLen < (Bits)len) {
 		bool success;
-		if (player.targetFrame > player.currFrame)
+		if (player.targetFrame > player.currFrame) {
+			if (!player.cd->AudioReady(player.currFrame)) {
+				// still decoding, play silence rather than wait for it
+				memset(&player.buffer[player.bufLen], 0, len - player.bufLen);
+				player.bufLen = len;
+				break;
+			}
 			success = player.cd->ReadSector(&player.buffer[player.bufLen], true, player.currFrame);
-		else success = false;
+		} else success = false;
 		
 		if (success) {
 			player.currFrame++;
@@ -350,8 +867,9 @@ bool CDROM_Interface_Image::LoadIsoFile(char* filename)
 	
 	// data track
 	Track track = {0, 0, 0, 0, 0, 0, false, NULL};
-	bool error;
-	track.file = new BinaryFile(filename, error);
+	bool error = false;
+	track.file = HunkFile::Open(filename);
+	if (!track.file) track.file = new BinaryFile(filename, error);
 	if (error) {
 		delete track.file;
 		track.file = NULL;
@@ -505,7 +1023,19 @@ bool CDROM_Interface_Image::LoadCueSheet(char *cuefile)
 			track.file = NULL;
 			bool error = true;
 			if (type == "BINARY") {
-				track.file = new BinaryFile(filename.c_str(), error);
+				track.file = HunkFile::Open(filename.c_str());
+				if (track.file) error = false;
+				else track.file = new BinaryFile(filename.c_str(), error);
+			} else if (type == "MP3" || type == "AIFF") {
+				LOG_MSG("CDROM: %s audio tracks are not supported, convert %s to %s",
+					type.c_str(), filename.c_str(), AUDIO_FILE_FORMATS);
+			} else if (type == "WAVE" || type == "FLAC" || type == "OGG") {
+				// cue sheets call compressed audio whatever they like, the decoders go by content
+				track.file = AudioFile::Open(filename.c_str());
+				error = (track.file == NULL);
+				if (error) LOG_MSG("CDROM: %s is not %s audio", filename.c_str(), AUDIO_FILE_FORMATS);
+			} else {
+				LOG_MSG("CDROM: unknown cue sheet file type %s", type.c_str());
 			}
 			if (error) {
 				delete track.file;
@@ -695,6 +1225,7 @@ void CDROM_Interface_Image::ClearTracks()
 	vector<Track>::iterator end = tracks.end();
 
 	TrackFile* last = NULL;	
+	playFile = NULL;
 	while(i != end) {
 		Track &curr = *i;
 		if (curr.file != last) {
@@ -271,6 +271,15 @@ void diskio_delay(Bits value/*bytes*/) {
     }
 }
 
+/* handle refers to an open file on a drive, as opposed to a character device.
+ * Only those may transfer directly to/from guest memory, devices like CON
+ * or AUX rely on the copy buffer and may block or re-enter the emulation. */
+static bool DOS_IsDiskFileHandle(Bit16u entry) {
+	Bit8u handle=RealHandle(entry);
+	if (handle==0xFF || handle>=DOS_FILES || !Files[handle] || !Files[handle]->IsOpen()) return false;
+	return (Files[handle]->GetInformation() & 0x8000) == 0;
+}
+
 static inline void overhead() {
 	reg_ip += 2;
 }
@@ -1214,8 +1223,10 @@ static Bitu DOS_21Handler(void) {
             }
 
 			dos.echo=true;
-			if (DOS_ReadFile(reg_bx,dos_copybuf,&toread)) {
-				MEM_BlockWrite(SegPhys(ds)+reg_dx,dos_copybuf,toread);
+			/* read straight into guest memory when it is plain RAM, else through the copy buffer */
+			HostPt direct = DOS_IsDiskFileHandle(reg_bx) ? MEM_GetBlockHostPt(SegPhys(ds)+reg_dx,toread,true) : NULL;
+			if (DOS_ReadFile(reg_bx,direct != NULL ? direct : dos_copybuf,&toread)) {
+				if (direct == NULL) MEM_BlockWrite(SegPhys(ds)+reg_dx,dos_copybuf,toread);
 				reg_ax=toread;
 				CALLBACK_SCF(false);
 			} else {
@@ -1246,8 +1257,9 @@ static Bitu DOS_21Handler(void) {
                 towrite = nuwrite;
             }
 
-			MEM_BlockRead(SegPhys(ds)+reg_dx,dos_copybuf,towrite);
-			if (DOS_WriteFile(reg_bx,dos_copybuf,&towrite)) {
+			HostPt direct = DOS_IsDiskFileHandle(reg_bx) ? MEM_GetBlockHostPt(SegPhys(ds)+reg_dx,towrite,false) : NULL;
+			if (direct == NULL) MEM_BlockRead(SegPhys(ds)+reg_dx,dos_copybuf,towrite);
+			if (DOS_WriteFile(reg_bx,direct != NULL ? direct : dos_copybuf,&towrite)) {
 				reg_ax=towrite;
 	   			CALLBACK_SCF(false);
 			} else {
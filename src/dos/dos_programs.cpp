@@ -40,6 +40,7 @@
 #include "dma.h"
 #include "bios_disk.h"
 #include "qcow2_disk.h"
+#include "hunk_image.h"
 #include "setup.h"
 #include "control.h"
 #include "video.h"
@@ -1034,7 +1035,7 @@ public:
 						newDiskSwap[i] = new imageDiskNFD(usefile, (Bit8u *)temp_line.c_str(), floppysize, false, 1);
 					}					
                     else {
-                        newDiskSwap[i] = new imageDisk(usefile, (Bit8u *)temp_line.c_str(), floppysize, false);
+                        newDiskSwap[i] = new imageDiskMapped(usefile, (Bit8u *)temp_line.c_str(), floppysize, false);
                     }
 					newDiskSwap[i]->Addref();
 					if (newDiskSwap[i]->active && !newDiskSwap[i]->hardDrive) incrementFDD(); //moved from imageDisk constructor
@@ -1132,6 +1133,8 @@ public:
         /* clear the disk change flag.
          * Most OSes don't expect the disk change error signal when they first boot up */
         imageDiskChange[drive-65] = false;
+
+		DISKIO_Sync();
 		 
 		bool has_read = false;
 		bool pc98_sect128 = false;
@@ -2269,6 +2272,85 @@ static void IMGMAKE_ProgramStart(Program * * make) {
 	*make=new IMGMAKE;
 }
 
+// IMGCOMP
+
+class IMGCOMP : public Program {
+public:
+	void Run(void) {
+		std::string src,dst,tmp;
+		Bit32u hunk_size = 65536;
+
+		if (cmd->FindExist("-?", false) || cmd->FindExist("/?", false)) {
+			WriteOut(MSG_Get("PROGRAM_IMGCOMP_SYNTAX"));
+			return;
+		}
+		if (cmd->FindString("-hunk",tmp,true)) {
+			hunk_size = (Bit32u)atoi(tmp.c_str());
+			if (hunk_size < HunkImage::min_hunk_size || hunk_size > HunkImage::max_hunk_size) {
+				WriteOut(MSG_Get("PROGRAM_IMGCOMP_SYNTAX"));
+				return;
+			}
+		}
+		if (!cmd->FindCommand(1,src) || !cmd->FindCommand(2,dst)) {
+			WriteOut(MSG_Get("PROGRAM_IMGCOMP_SYNTAX"));
+			return;
+		}
+
+		FILE *in = fopen64(src.c_str(),"rb");
+		if (!in) {
+			WriteOut(MSG_Get("PROGRAM_IMGCOMP_CANNOT_READ"),src.c_str());
+			return;
+		}
+		if (HunkImage::IsHunkImage(in)) {
+			fclose(in);
+			WriteOut(MSG_Get("PROGRAM_IMGCOMP_ALREADY"),src.c_str());
+			return;
+		}
+
+		// don't trash user's files
+		FILE* f = fopen(dst.c_str(),"r");
+		if (f) {
+			fclose(f);
+			fclose(in);
+			WriteOut(MSG_Get("PROGRAM_IMGMAKE_FILE_EXISTS"),dst.c_str());
+			return;
+		}
+
+		fseeko64(in,0L,SEEK_END);
+		Bit64u size = (Bit64u)ftello64(in);
+		fseeko64(in,0L,SEEK_SET);
+
+		HunkImageWriter writer;
+		if (!writer.Create(dst.c_str(),size,hunk_size)) {
+			fclose(in);
+			WriteOut(MSG_Get("PROGRAM_IMGMAKE_CANNOT_WRITE"),dst.c_str());
+			return;
+		}
+
+		std::vector<Bit8u> buf(hunk_size);
+		bool ok = true;
+		for (Bit64u pos=0;ok && pos < size;pos += hunk_size) {
+			size_t len = (size - pos) < hunk_size ? (size_t)(size - pos) : (size_t)hunk_size;
+			if (len < hunk_size) memset(&buf[len],0,hunk_size - len);
+			ok = fread(&buf[0],len,1,in) == 1 && writer.AddHunk(&buf[0]);
+		}
+		fclose(in);
+		if (!writer.Finish()) ok = false;
+
+		if (!ok) {
+			remove(dst.c_str());
+			WriteOut(MSG_Get("PROGRAM_IMGCOMP_FAILED"),dst.c_str());
+			return;
+		}
+		WriteOut(MSG_Get("PROGRAM_IMGCOMP_DONE"),dst.c_str(),
+			(unsigned int)(size / 1024),(unsigned int)(writer.GetCompressedSize() / 1024));
+	}
+};
+
+static void IMGCOMP_ProgramStart(Program * * make) {
+	*make=new IMGCOMP;
+}
+
 // LOADFIX
 
 class LOADFIX : public Program {
@@ -3986,6 +4068,16 @@ private:
 			setbuf(newDisk, NULL);
 			newImage = new QCow2Disk(qcow2_header, newDisk, (Bit8u *)fileName, imagesize, sizes[0], (imagesize > 2880));
 		}
+		else if (HunkImage::IsHunkImage(newDisk)) {
+			HunkImage *hunkImage = HunkImage::Open(newDisk); /* closes newDisk on failure */
+			if (hunkImage == NULL) {
+				WriteOut("Invalid or corrupt hunk image '%s'\n", fileName);
+				return NULL;
+			}
+			sectors = hunkImage->GetSize() / (Bit64u)sizes[0];
+			imagesize = (Bit32u)(hunkImage->GetSize() / 1024L);
+			newImage = new imageDiskHunk(hunkImage, fileName, (imagesize > 2880));
+		}
 		else {
 			char tmp[256];
 
@@ -4025,7 +4117,7 @@ private:
 				sectors = (Bit64u)ftello64(newDisk) / (Bit64u)sizes[0];
 				imagesize = (Bit32u)(sectors / 2); /* orig. code wants it in KBs */
 				setbuf(newDisk, NULL);
-				newImage = new imageDisk(newDisk, (Bit8u *)fileName, imagesize, (imagesize > 2880));
+				newImage = new imageDiskMapped(newDisk, (Bit8u *)fileName, imagesize, (imagesize > 2880));
 			}
 		}
 
@@ -4826,6 +4918,21 @@ void DOS_SetupPrograms(void) {
 	MSG_Add("PROGRAM_IMGMAKE_PRINT_CHS","Creating an image file with %u cylinders, %u heads and %u sectors\n");
 	MSG_Add("PROGRAM_IMGMAKE_CANT_READ_FLOPPY","\n\nUnable to read floppy.");
 
+	MSG_Add("PROGRAM_IMGCOMP_SYNTAX",
+		"Compresses a disk or CD image into a read-only hunk image.\n"
+		"Syntax: IMGCOMP source dest [-hunk size]\n"
+		"  source: raw floppy, harddisk, .iso or .bin image - !path on the host!\n"
+		"  dest: the hunk image to create - !path on the host!\n"
+		"  -hunk: bytes per compressed hunk (512-1048576, default 65536).\n"
+		"         Smaller hunks make random reads cheaper, larger ones compress better.\n"
+		" The hunk image is mounted with IMGMOUNT like the original. Cue sheets\n"
+		" can refer to it in place of the original BINARY file."
+		);
+	MSG_Add("PROGRAM_IMGCOMP_CANNOT_READ","The file \"%s\" cannot be opened for reading.\n");
+	MSG_Add("PROGRAM_IMGCOMP_ALREADY","The file \"%s\" is already a hunk image.\n");
+	MSG_Add("PROGRAM_IMGCOMP_FAILED","Unable to write the hunk image \"%s\".\n");
+	MSG_Add("PROGRAM_IMGCOMP_DONE","Created \"%s\": %uKB compressed to %uKB.\n");
+
 	MSG_Add("PROGRAM_KEYB_INFO","Codepage %i has been loaded\n");
 	MSG_Add("PROGRAM_KEYB_INFO_LAYOUT","Codepage %i has been loaded for layout %s\n");
 	MSG_Add("PROGRAM_KEYB_SHOWHELP",
@@ -4859,6 +4966,7 @@ void DOS_SetupPrograms(void) {
         PROGRAMS_MakeFile("LOADROM.COM", LOADROM_ProgramStart);
 
 	PROGRAMS_MakeFile("IMGMAKE.COM", IMGMAKE_ProgramStart);
+	PROGRAMS_MakeFile("IMGCOMP.COM", IMGCOMP_ProgramStart);
 	PROGRAMS_MakeFile("IMGMOUNT.COM", IMGMOUNT_ProgramStart);
 
     if (!IS_PC98_ARCH)
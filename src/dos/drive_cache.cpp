@@ -26,6 +26,7 @@
 #include <vector>
 #include <iterator>
 #include <algorithm>
+#include <new>
 
 #if defined (WIN32)   /* Win 32 */
 #define WIN32_LEAN_AND_MEAN        // Exclude rarely-used stuff from 
@@ -38,6 +39,13 @@
 #include <os2.h>
 #endif
 
+#if defined (C_HAVE_INOTIFY)
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <time.h>
+#include <errno.h>
+#endif
+
 int fileInfoCounter = 0;
 
 bool SortByName(DOS_Drive_Cache::CFileInfo* const &a, DOS_Drive_Cache::CFileInfo* const &b) {
@@ -60,6 +68,114 @@ bool SortByDirNameRev(DOS_Drive_Cache::CFileInfo* const &a, DOS_Drive_Cache::CFi
 	return strcmp(a->shortname,b->shortname)>0;
 }
 
+/* Per directory lookup tables for name generation. The prefix table keeps the highest ~N
+ * handed out for each short name stem, keyed by the stem and the width of the number, so
+ * picking the next number does not walk every similar name. The Wine table maps hashed
+ * short names back to their entries; it is only built once a directory gets asked for
+ * one, as most never are. */
+class DOS_Drive_Cache::CNameIndex {
+public:
+	CNameIndex() : prefixCount(0), wineCount(0), wineBuilt(false) {
+		prefixTable.resize(INITIAL_BUCKETS);
+		wineTable.resize(INITIAL_BUCKETS);
+	}
+	Bitu GetNumber(const char* key) const {
+		const Bucket& bucket = prefixTable[Hash(key) & (prefixTable.size()-1)];
+		for (Bitu i=0; i<bucket.size(); i++) {
+			if (strcmp(bucket[i].key,key) == 0) return bucket[i].nr;
+		}
+		return 0;
+	}
+	void SetNumber(const char* key, Bitu nr) {
+		Bucket& bucket = prefixTable[Hash(key) & (prefixTable.size()-1)];
+		for (Bitu i=0; i<bucket.size(); i++) {
+			if (strcmp(bucket[i].key,key) == 0) {
+				if (nr > bucket[i].nr) bucket[i].nr = nr;
+				return;
+			}
+		}
+		Insert(prefixTable,prefixCount,key,nr,0);
+	}
+	/* Replace the highest N of key, 0 forgets the stem */
+	void ResetNumber(const char* key, Bitu nr) {
+		Bucket& bucket = prefixTable[Hash(key) & (prefixTable.size()-1)];
+		for (Bitu i=0; i<bucket.size(); i++) {
+			if (strcmp(bucket[i].key,key) == 0) {
+				if (nr != 0) {
+					bucket[i].nr = nr;
+				}
+				else {
+					bucket.erase(bucket.begin() + (Bucket::difference_type)i);
+					prefixCount--;
+				}
+				return;
+			}
+		}
+		if (nr != 0) Insert(prefixTable,prefixCount,key,nr,0);
+	}
+	/* Of several entries hashing to the same name, return the first in fileList order */
+	CFileInfo* FindWine(const char* name) const {
+		const Bucket& bucket = wineTable[Hash(name) & (wineTable.size()-1)];
+		CFileInfo* found = 0;
+		for (Bitu i=0; i<bucket.size(); i++) {
+			if (strcmp(bucket[i].key,name) == 0 && (!found || strcmp(bucket[i].info->shortname,found->shortname) < 0))
+				found = bucket[i].info;
+		}
+		return found;
+	}
+	void AddWine(const char* name, CFileInfo* info) {
+		Insert(wineTable,wineCount,name,0,info);
+	}
+	void RemoveWine(const char* name, CFileInfo* info) {
+		Bucket& bucket = wineTable[Hash(name) & (wineTable.size()-1)];
+		for (Bitu i=0; i<bucket.size(); i++) {
+			if (bucket[i].info == info) {
+				bucket.erase(bucket.begin() + (Bucket::difference_type)i);
+				wineCount--;
+				return;
+			}
+		}
+	}
+	bool IsWineBuilt(void) const { return wineBuilt; }
+	void SetWineBuilt(void) { wineBuilt = true; }
+private:
+	enum { INITIAL_BUCKETS = 64 };
+	struct Node {
+		char		key[DOS_NAMELENGTH_ASCII];
+		Bitu		nr;
+		CFileInfo*	info;
+	};
+	typedef std::vector<Node> Bucket;
+
+	static Bit32u Hash(const char* key) {
+		Bit32u hash = 2166136261u;
+		while (*key) hash = (hash ^ (Bit8u)*key++) * 16777619u;
+		return hash;
+	}
+	static void Insert(std::vector<Bucket>& table, Bitu& count, const char* key, Bitu nr, CFileInfo* info) {
+		if (++count > table.size()) {
+			// keep chains short, rehash into twice the buckets
+			std::vector<Bucket> grown(table.size()*2);
+			for (Bitu b=0; b<table.size(); b++) {
+				for (Bitu i=0; i<table[b].size(); i++)
+					grown[Hash(table[b][i].key) & (grown.size()-1)].push_back(table[b][i]);
+			}
+			table.swap(grown);
+		}
+		Node node;
+		safe_strncpy(node.key,key,DOS_NAMELENGTH_ASCII);
+		node.nr = nr;
+		node.info = info;
+		table[Hash(node.key) & (table.size()-1)].push_back(node);
+	}
+
+	std::vector<Bucket>	prefixTable;
+	std::vector<Bucket>	wineTable;
+	Bitu			prefixCount;
+	Bitu			wineCount;
+	bool			wineBuilt;
+};
+
 DOS_Drive_Cache::DOS_Drive_Cache(void) {
 	dirBase			= new CFileInfo;
 	save_dir		= 0;
@@ -69,6 +185,8 @@ DOS_Drive_Cache::DOS_Drive_Cache(void) {
 	for (Bit32u i=0; i<MAX_OPENDIRS; i++) { dirSearch[i] = 0; dirFindFirst[i] = 0; };
 	SetDirSort(DIRALPHABETICAL);
 	updatelabel = true;
+	watchFd			= -1;
+	watchFailed		= false;
 }
 
 DOS_Drive_Cache::DOS_Drive_Cache(const char* path, DOS_Drive *drive) {
@@ -79,6 +197,8 @@ DOS_Drive_Cache::DOS_Drive_Cache(const char* path, DOS_Drive *drive) {
 	nextFreeFindFirst	= 0;
 	for (Bit32u i=0; i<MAX_OPENDIRS; i++) { dirSearch[i] = 0; dirFindFirst[i] = 0; };
 	SetDirSort(DIRALPHABETICAL);
+	watchFd			= -1;
+	watchFailed		= false;
 	SetBaseDir(path,drive);
 	updatelabel = true;
 }
@@ -86,9 +206,13 @@ DOS_Drive_Cache::DOS_Drive_Cache(const char* path, DOS_Drive *drive) {
 DOS_Drive_Cache::~DOS_Drive_Cache(void) {
 	Clear();
 	for (Bit32u i=0; i<MAX_OPENDIRS; i++) { DeleteFileInfo(dirFindFirst[i]); dirFindFirst[i]=0; };
+#if defined (C_HAVE_INOTIFY)
+	if (watchFd >= 0) close(watchFd);
+#endif
 }
 
 void DOS_Drive_Cache::Clear(void) {
+	UnwatchDirs("");
 	DeleteFileInfo(dirBase); dirBase = 0;
 	nextFreeFindFirst	= 0;
 	for (Bit32u i=0; i<MAX_OPENDIRS; i++) dirSearch[i] = 0;
@@ -170,6 +294,8 @@ char* DOS_Drive_Cache::GetExpandName(const char* path) {
 	static char work [CROSS_LEN] = { 0 };
 	char dir [CROSS_LEN]; 
 
+	UpdateFromHost();
+
 	work[0] = 0;
 	strcpy (dir,path);
 
@@ -264,7 +390,11 @@ void DOS_Drive_Cache::CacheOut(const char* path, bool ignoreLastDir) {
 	} else {
 		dir = FindDirInfo(path,expand);	
 	}
+	CacheOutDir(dir,expand);
+}
 
+/* drop the cached entries of dir, whose host path is expand */
+void DOS_Drive_Cache::CacheOutDir(CFileInfo* dir, const char* expand) {
 //	LOG_DEBUG("DIR: Caching out %s : dir %s",expand,dir->orgname);
 //	clear cache first?
 	for (Bit32u i=0; i<MAX_OPENDIRS; i++) {
@@ -273,12 +403,13 @@ void DOS_Drive_Cache::CacheOut(const char* path, bool ignoreLastDir) {
 	// delete file objects...
 	for(Bit32u i=0; i<dir->fileList.size(); i++) {
 		if (dirSearch[srchNr]==dir->fileList[i]) dirSearch[srchNr] = 0;
-		DeleteFileInfo(dir->fileList[i]); dir->fileList[i] = 0;
+		ClearFileInfo(dir->fileList[i]);
 	}
-	// clear lists
-	dir->fileList.clear();
-	dir->longNameList.clear();
+	// release the entries and their names, this clears the lists
+	dir->FreeEntries();
 	save_dir = 0;
+	// the directory is read and watched again the next time it is needed
+	UnwatchDirs(expand);
 }
 
 bool DOS_Drive_Cache::IsCachedIn(CFileInfo* curDir) {
@@ -343,32 +474,50 @@ int DOS_Drive_Cache::CompareShortname(const char* compareName, const char* short
 }
 
 Bitu DOS_Drive_Cache::CreateShortNameID(CFileInfo* curDir, const char* name) {
-	std::vector<CFileInfo*>::size_type filelist_size = curDir->longNameList.size();
-	if (GCC_UNLIKELY(filelist_size<=0)) return 1;	// shortener IDs start with 1
-
-	Bitu foundNr	= 0;	
-	Bits low		= 0;
-	Bits high		= (Bits)(filelist_size-1);
-	Bits mid, res;
-
-	while (low<=high) {
-		mid = (low+high)/2;
-		res = CompareShortname(name,curDir->longNameList[mid]->shortname);
-		
-		if (res>0)	low  = mid+1; else
-		if (res<0)	high = mid-1; 
-		else {
-			// any more same x chars in next entries ?	
-			do {
-				foundNr = curDir->longNameList[mid]->shortNr;
-				mid++;
-			} while((Bitu)mid<curDir->longNameList.size() && (CompareShortname(name,curDir->longNameList[mid]->shortname)==0));
-			break;
-		};
+	if (GCC_UNLIKELY(!curDir->names)) return 1;	// shortener IDs start with 1
+
+	// An existing STEM~N matches when its stem equals the same number of leading
+	// characters of name, see CompareShortname. Look up every stem length a name of
+	// this length could have been cut to for each width of N.
+	size_t baseLen		= strcspn(name,".");
+	size_t compareLen	= baseLen>8 ? 8 : baseLen;
+	Bitu foundNr	= 0;
+	char key[DOS_NAMELENGTH_ASCII];
+	for (size_t digits=1; digits<=7; digits++) {
+		size_t low	= compareLen>digits+1 ? compareLen-digits-1 : 0;
+		size_t high	= 8-digits-1;
+		if (high>baseLen) high = baseLen;
+		for (size_t len=low; len<=high; len++) {
+			memcpy(key,name,len);
+			key[len] = '~';
+			key[len+1] = (char)('0'+digits);
+			key[len+2] = 0;
+			Bitu nr = curDir->names->GetNumber(key);
+			if (nr>foundNr) foundNr = nr;
+		}
 	}
 	return foundNr+1;
 }
 
+/* The prefix table key of a generated short name: the stem up to and including '~'
+ * followed by the number of digits, as recorded by CreateShortName */
+bool DOS_Drive_Cache::GetShortNameKey(const char* shortname, char* key) {
+	// the number ends the name part, the stem itself may contain '~'
+	const char* end = strchr(shortname,'.');
+	if (!end) end = shortname + strlen(shortname);
+	const char* tilde = end;
+	while (tilde > shortname && *(tilde-1) != '~') tilde--;
+	if (tilde == shortname) return false;
+	tilde--;
+	size_t digits = (size_t)(end - tilde) - 1;
+	if (digits == 0 || digits > 7 || strspn(tilde+1,"0123456789") != digits) return false;
+	size_t len = (size_t)(tilde - shortname) + 1;
+	memcpy(key,shortname,len);
+	key[len] = (char)('0'+digits);
+	key[len+1] = 0;
+	return true;
+}
+
 bool DOS_Drive_Cache::RemoveTrailingDot(char* shortname) {
 // remove trailing '.' if no extension is available (Linux compatibility)
 	size_t len = strlen(shortname);
@@ -384,18 +533,18 @@ bool DOS_Drive_Cache::RemoveTrailingDot(char* shortname) {
 #define WINE_DRIVE_SUPPORT 1
 #if WINE_DRIVE_SUPPORT
 //Changes to interact with WINE by supporting their namemangling.
-//The code is rather slow, because orglist is unordered, so it needs to be avoided if possible.
-//Hence the tests in GetLongFileName
+//Hashing a whole directory is rather slow, so it needs to be avoided if possible.
+//Hence the tests in GetLongFileName; once hashed, the names are kept in the directory's CNameIndex
 
 
 // From the Wine project
-static Bits wine_hash_short_file_name( char* name, char* buffer )
+static Bits wine_hash_short_file_name( const char* name, char* buffer )
 {
 	static const char hash_chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ012345";
 	static const char invalid_chars[] = { '*','?','<','>','|','"','+','=',',',';','[',']',' ','\345','~','.',0 };
-	char* p;
-	char* ext;
-	char* end = name + strlen(name);
+	const char* p;
+	const char* ext;
+	const char* end = name + strlen(name);
 	char* dst;
 	unsigned short hash;
 	int i;
@@ -458,15 +607,24 @@ Bits DOS_Drive_Cache::GetLongName(CFileInfo* curDir, char* shortName) {
 #ifdef WINE_DRIVE_SUPPORT
 	if (strlen(shortName) < 8 || shortName[4] != '~' || shortName[5] == '.' || shortName[6] == '.' || shortName[7] == '.') return -1; // not available
 	// else it's most likely a Wine style short name ABCD~###, # = not dot  (length at least 8) 
-	// The above test is rather strict as the following loop can be really slow if filelist_size is large.
-	char buff[CROSS_LEN];
-	for (Bitu i = 0; i < filelist_size; i++) {
-		res = wine_hash_short_file_name(curDir->fileList[i]->orgname,buff);
-		buff[res] = 0;
-		if (!strcmp(shortName,buff)) {	
-			// Found
-			strcpy(shortName,curDir->fileList[i]->orgname);
-			return (Bits)i;
+	// Hash every name in the directory once, later lookups and new entries use the index.
+	if (!curDir->names) curDir->names = new CNameIndex;
+	if (!curDir->names->IsWineBuilt()) {
+		char buff[CROSS_LEN];
+		for (Bitu i = 0; i < filelist_size; i++) {
+			res = wine_hash_short_file_name(curDir->fileList[i]->orgname,buff);
+			buff[res] = 0;
+			curDir->names->AddWine(buff,curDir->fileList[i]);
+		}
+		curDir->names->SetWineBuilt();
+	}
+	if (CFileInfo* info = curDir->names->FindWine(shortName)) {
+		// Found, fileList is sorted by short name
+		std::vector<CFileInfo*>::iterator it = std::lower_bound(curDir->fileList.begin(),curDir->fileList.end(),info,SortByName);
+		while (it != curDir->fileList.end() && *it != info) ++it;
+		if (it != curDir->fileList.end()) {
+			strcpy(shortName,info->orgname);
+			return (Bits)(it - curDir->fileList.begin());
 		}
 	}
 #endif
@@ -529,6 +687,7 @@ void DOS_Drive_Cache::CreateShortName(CFileInfo* curDir, CFileInfo* info) {
 	if (createShort) {
 		// Create number
 		char buffer[8];
+		if (!curDir->names) curDir->names = new CNameIndex;
 		info->shortNr = CreateShortNameID(curDir,tmpName);
 		sprintf(buffer,"%d",(int)info->shortNr);
 		// Copy first letters
@@ -539,6 +698,9 @@ void DOS_Drive_Cache::CreateShortName(CFileInfo* curDir, CFileInfo* info) {
 		safe_strncpy(info->shortname,tmpName,tocopy+1);
 		// Copy number
 		strcat(info->shortname,"~");
+		char key[DOS_NAMELENGTH_ASCII];
+		sprintf(key,"%s%c",info->shortname,(char)('0'+buflen));
+		curDir->names->SetNumber(key,info->shortNr);
 		strcat(info->shortname,buffer);
 		// Add (and cut) Extension, if available
 		if (pos) {
@@ -549,29 +711,8 @@ void DOS_Drive_Cache::CreateShortName(CFileInfo* curDir, CFileInfo* info) {
 			info->shortname[DOS_NAMELENGTH] = 0;
 		}
 
-		// keep list sorted for CreateShortNameID to work correctly
-		if (curDir->longNameList.size()>0) {
-			if (!(strcmp(info->shortname,curDir->longNameList.back()->shortname)<0)) {
-				// append at end of list
-				curDir->longNameList.push_back(info);
-			} else {
-				// look for position where to insert this element
-				bool found=false;
-				std::vector<CFileInfo*>::iterator it;
-				for (it=curDir->longNameList.begin(); it!=curDir->longNameList.end(); ++it) {
-					if (strcmp(info->shortname,(*it)->shortname)<0) {
-						found = true;
-						break;
-					}
-				}
-				// Put it in longname list...
-				if (found) curDir->longNameList.insert(it,info);
-				else curDir->longNameList.push_back(info);
-			}
-		} else {
-			// empty file list, append
-			curDir->longNameList.push_back(info);
-		}
+		// keep list sorted
+		curDir->longNameList.insert(std::upper_bound(curDir->longNameList.begin(),curDir->longNameList.end(),info,SortByName),info);
 	} else {
 		strcpy(info->shortname,tmpName);
 	}
@@ -589,7 +730,8 @@ DOS_Drive_Cache::CFileInfo* DOS_Drive_Cache::FindDirInfo(const char* path, char*
 	CFileInfo*	curDir = dirBase;
 	Bit16u		id;
 
-	if (save_dir && (strcmp(path,save_path)==0)) {
+	/* with unwatched directories about, walk the path so that their stamps get checked */
+	if (save_dir && stampDirs.empty() && (strcmp(path,save_path)==0)) {
 		strcpy(expandedPath,save_expanded);
 		return save_dir;
 	};
@@ -601,6 +743,7 @@ DOS_Drive_Cache::CFileInfo* DOS_Drive_Cache::FindDirInfo(const char* path, char*
 	strcpy(expandedPath,basePath);
 
 	// hehe, baseDir should be cached in... 
+	CheckDirStamp(curDir,basePath);
 	if (!IsCachedIn(curDir)) {
 		strcpy(work,basePath);
 		if (OpenDir(curDir,work,id)) {
@@ -636,7 +779,7 @@ DOS_Drive_Cache::CFileInfo* DOS_Drive_Cache::FindDirInfo(const char* path, char*
 		// Follow Directory
 		if ((nextDir>=0) && curDir->fileList[nextDir]->isDir) {
 			curDir = curDir->fileList[nextDir];
-			strcpy (curDir->orgname,dir);
+			CheckDirStamp(curDir,expandedPath);
 			if (!IsCachedIn(curDir)) {
 				if (OpenDir(curDir,expandedPath,id)) {
 					char buffer[CROSS_LEN];
@@ -702,44 +845,28 @@ bool DOS_Drive_Cache::OpenDir(CFileInfo* dir, const char* expand, Bit16u& id) {
 }
 
 void DOS_Drive_Cache::CreateEntry(CFileInfo* dir, const char* name, bool is_directory) {
-	CFileInfo* info = new CFileInfo;
-	strcpy(info->orgname, name);				
+	CFileInfo* info = dir->AllocEntry(name);
 	info->shortNr = 0;
 	info->isDir = is_directory;
 
 	// Check for long filenames...
 	CreateShortName(dir, info);		
 
-	bool found = false;
-
 	// keep list sorted (so GetLongName works correctly, used by CreateShortName in this routine)
-	if (dir->fileList.size()>0) {
-		if (!(strcmp(info->shortname,dir->fileList.back()->shortname)<0)) {
-			// append at end of list
-			dir->fileList.push_back(info);
-		} else {
-			// look for position where to insert this element
-			std::vector<CFileInfo*>::iterator it;
-			for (it=dir->fileList.begin(); it!=dir->fileList.end(); ++it) {
-				if (strcmp(info->shortname,(*it)->shortname)<0) {
-					found = true;
-					break;
-				}
-			}
-			// Put file in lists
-			if (found) dir->fileList.insert(it,info);
-			else dir->fileList.push_back(info);
-		}
-	} else {
-		// empty file list, append
-		dir->fileList.push_back(info);
+	dir->fileList.insert(std::upper_bound(dir->fileList.begin(),dir->fileList.end(),info,SortByName),info);
+
+#ifdef WINE_DRIVE_SUPPORT
+	if (dir->names && dir->names->IsWineBuilt()) {
+		char buff[CROSS_LEN];
+		buff[wine_hash_short_file_name(info->orgname,buff)] = 0;
+		dir->names->AddWine(buff,info);
 	}
+#endif
 }
 
 void DOS_Drive_Cache::CopyEntry(CFileInfo* dir, CFileInfo* from) {
-	CFileInfo* info = new CFileInfo;
+	CFileInfo* info = dir->AllocEntry(from->orgname);
 	// just copy things into new fileinfo
-	strcpy(info->orgname, from->orgname);				
 	strcpy(info->shortname, from->shortname);				
 	info->shortNr = from->shortNr;
 	info->isDir = from->isDir;
@@ -774,6 +901,9 @@ bool DOS_Drive_Cache::ReadDir(Bit16u id, char* &result) {
 		// close dir
 		drive->closedir(dirp);
 
+		// keep it current from now on instead of rescanning it
+		if (!drive->nocachedir) WatchDir(dirPath);
+
 		// Info
 /*		if (!dirp) {
 			LOG_DEBUG("DIR: Error Caching in %s",dirPath);			
@@ -809,6 +939,7 @@ bool DOS_Drive_Cache::SetResult(CFileInfo* dir, char* &result, Bitu entryNr)
 // FindFirst / FindNext
 bool DOS_Drive_Cache::FindFirst(char* path, Bit16u& id) {
 	Bit16u	dirID;
+	UpdateFromHost();
 	// Cache directory in 
 	if (!OpenDir(path,dirID)) return false;
 
@@ -860,6 +991,13 @@ bool DOS_Drive_Cache::FindFirst(char* path, Bit16u& id) {
 }
 
 bool DOS_Drive_Cache::FindNext(Bit16u id, char* &result) {
+	const char* orgname;
+	bool is_directory;
+	return FindNext(id,result,orgname,is_directory);
+}
+
+// Also hands out the host name and type of the entry, so the caller needs no lookup for them
+bool DOS_Drive_Cache::FindNext(Bit16u id, char* &result, const char* &orgname, bool &is_directory) {
 	// out of range ?
 	if ((id>=MAX_OPENDIRS) || !dirFindFirst[id]) {
 		LOG(LOG_MISC,LOG_ERROR)("DIRCACHE: FindFirst/Next failure : ID out of range: %04X",id);
@@ -870,6 +1008,9 @@ bool DOS_Drive_Cache::FindNext(Bit16u id, char* &result) {
 		DeleteFileInfo(dirFindFirst[id]); dirFindFirst[id] = 0;
 		return false;
 	}
+	CFileInfo* info = dirFindFirst[id]->fileList[dirFindFirst[id]->nextEntry-1];
+	orgname = info->orgname;
+	is_directory = info->isDir;
 	return true;
 }
 
@@ -889,3 +1030,303 @@ void DOS_Drive_Cache::DeleteFileInfo(CFileInfo *dir) {
 		ClearFileInfo(dir);
 	delete dir;
 }
+
+/* Bump allocator behind a directory's entries. Records and names are packed into large
+ * blocks that are only given back when the whole directory is cached out; records of
+ * single removed entries are recycled through a free list, their names are not. */
+class DOS_Drive_Cache::CFileArena {
+public:
+	CFileArena() : blockPos(0), blockLeft(0), freeInfo(0) {}
+	~CFileArena() {
+		for (Bitu i=0; i<blocks.size(); i++) free(blocks[i]);
+	}
+	void* Alloc(size_t size) {
+		size = (size + sizeof(void*) - 1) & ~(sizeof(void*) - 1);
+		if (size > blockLeft) {
+			size_t len = size > (size_t)BLOCK_SIZE ? size : (size_t)BLOCK_SIZE;
+			char* block = (char*)malloc(len);
+			if (!block) E_Exit("DIRCACHE: out of memory");
+			blocks.push_back(block);
+			blockPos = block;
+			blockLeft = len;
+		}
+		void* p = blockPos;
+		blockPos += size;
+		blockLeft -= size;
+		return p;
+	}
+	const char* Intern(const char* name) {
+		size_t len = strlen(name) + 1;
+		char* p = (char*)Alloc(len);
+		memcpy(p,name,len);
+		return p;
+	}
+	CFileInfo* NewInfo(void) {
+		void* p;
+		if (freeInfo) {
+			p = freeInfo;
+			freeInfo = *(void**)freeInfo;
+		} else {
+			p = Alloc(sizeof(CFileInfo));
+		}
+		return new(p) CFileInfo;
+	}
+	void DeleteInfo(CFileInfo* info) {
+		info->~CFileInfo();
+		*(void**)info = freeInfo;
+		freeInfo = info;
+	}
+private:
+	enum { BLOCK_SIZE = 16384 };
+	std::vector<char*>	blocks;
+	char*			blockPos;
+	size_t			blockLeft;
+	void*			freeInfo;
+};
+
+DOS_Drive_Cache::CFileInfo* DOS_Drive_Cache::CFileInfo::AllocEntry(const char* name) {
+	if (!arena) arena = new CFileArena;
+	CFileInfo* info = arena->NewInfo();
+	info->orgname = arena->Intern(name);
+	return info;
+}
+
+void DOS_Drive_Cache::CFileInfo::FreeEntry(CFileInfo* info) {
+	arena->DeleteInfo(info);
+}
+
+void DOS_Drive_Cache::CFileInfo::FreeEntries(void) {
+	for (Bitu i=0; i<fileList.size(); i++) fileList[i]->~CFileInfo();
+	fileList.clear();
+	longNameList.clear();
+	delete names;
+	names = 0;
+	delete arena;
+	arena = 0;
+}
+
+#if defined (C_HAVE_INOTIFY)
+/* modification time of an unwatched directory in ns, 0 if it was modified so recently that
+ * a further change could still get the same time, such a directory is read again on its
+ * next lookup */
+static Bit64u DirStamp(const struct stat& st) {
+	const Bit64u RACY_NS = 10000000; /* kernel timestamps are only as fine as a clock tick */
+	Bit64u stamp = (Bit64u)st.st_mtim.tv_sec * 1000000000u + (Bit64u)st.st_mtim.tv_nsec;
+	struct timespec now;
+	if (clock_gettime(CLOCK_REALTIME,&now) != 0) return 0;
+	if (stamp + RACY_NS >= (Bit64u)now.tv_sec * 1000000000u + (Bit64u)now.tv_nsec) return 0;
+	return stamp;
+}
+#endif
+
+/* Host directory watching. Every directory read from the host is watched with inotify, and
+ * changes made outside the emulator are applied to the cached directories as they come in,
+ * so listings stay current without rescanning. Changes to directories that are not cached
+ * in are ignored, they will be read fresh when they are needed. The emulator's own changes
+ * show up here too, but by then the cache already agrees with the host. */
+void DOS_Drive_Cache::WatchDir(const char* path) {
+#if defined (C_HAVE_INOTIFY)
+	if (watchFd == -1) {
+		watchFd = inotify_init1(IN_NONBLOCK|IN_CLOEXEC);
+		if (watchFd < 0) {
+			LOG(LOG_DOSMISC,LOG_WARN)("DIRCACHE: inotify not available, host changes to %s are found by directory modification time",basePath);
+			watchFd = -2; /* don't try again */
+		}
+	}
+	if (watchFd >= 0) {
+		int wd = inotify_add_watch(watchFd,path,IN_CREATE|IN_DELETE|IN_MOVED_FROM|IN_MOVED_TO|IN_DELETE_SELF|IN_MOVE_SELF|IN_ONLYDIR);
+		if (wd >= 0) {
+			watchDirs[wd] = path;
+			return;
+		}
+		if (!watchFailed) {
+			/* usually the watch limit, it will not get better for the next directory */
+			LOG(LOG_DOSMISC,LOG_WARN)("DIRCACHE: cannot watch %s for host changes (%s), falling back to directory modification times",path,strerror(errno));
+			watchFailed = true;
+		}
+	}
+
+	/* not watched, CheckDirStamp() rereads it when a lookup passes through it and its
+	 * modification time has changed */
+	struct stat st;
+	if (stat(path,&st) == 0) stampDirs[path] = DirStamp(st);
+#else
+	(void)path;
+#endif
+}
+
+/* forget the watches and modification times of path and every directory below it,
+ * "" for all of them */
+void DOS_Drive_Cache::UnwatchDirs(const char* path) {
+#if defined (C_HAVE_INOTIFY)
+	std::string prefix = path;
+	if (!prefix.empty() && prefix[prefix.size()-1] != CROSS_FILESPLIT) prefix += CROSS_FILESPLIT;
+
+	for (std::map<int,std::string>::iterator it = watchDirs.begin(); it != watchDirs.end();) {
+		if (it->second.compare(0,prefix.size(),prefix) == 0) {
+			inotify_rm_watch(watchFd,it->first);
+			watchDirs.erase(it++);
+		}
+		else {
+			++it;
+		}
+	}
+
+	std::map<std::string,Bit64u>::iterator st = stampDirs.lower_bound(prefix);
+	while (st != stampDirs.end() && st->first.compare(0,prefix.size(),prefix) == 0)
+		stampDirs.erase(st++);
+#else
+	(void)path;
+#endif
+}
+
+/* reread dir, at host path path, if it is not watched and has changed since it was read */
+void DOS_Drive_Cache::CheckDirStamp(CFileInfo* dir, const char* path) {
+#if defined (C_HAVE_INOTIFY)
+	if (stampDirs.empty() || !IsCachedIn(dir)) return;
+	std::string key = path;
+	if (key.empty() || key[key.size()-1] != CROSS_FILESPLIT) key += CROSS_FILESPLIT;
+	std::map<std::string,Bit64u>::iterator it = stampDirs.find(key);
+	if (it == stampDirs.end()) return;
+
+	struct stat st;
+	if (it->second != 0 && stat(key.c_str(),&st) == 0 && DirStamp(st) == it->second) return;
+	CacheOutDir(dir,key.c_str());
+#else
+	(void)dir; (void)path;
+#endif
+}
+
+void DOS_Drive_Cache::UpdateFromHost(void) {
+#if defined (C_HAVE_INOTIFY)
+	if (watchFd >= 0) {
+		Bit32u buffer[1024]; /* aligned for struct inotify_event */
+		for (;;) {
+			ssize_t len = read(watchFd,buffer,sizeof(buffer));
+			if (len <= 0) break;
+
+			const char* p = (const char*)buffer;
+			const char* end = p + len;
+			while (p < end) {
+				const struct inotify_event* ev = (const struct inotify_event*)p;
+				HostChange(ev->wd,ev->mask,ev->len ? ev->name : "");
+				p += sizeof(struct inotify_event) + ev->len;
+			}
+		}
+	}
+#endif
+}
+
+void DOS_Drive_Cache::HostChange(int wd, Bit32u mask, const char* name) {
+#if defined (C_HAVE_INOTIFY)
+	if (mask & IN_Q_OVERFLOW) {
+		LOG(LOG_DOSMISC,LOG_NORMAL)("DIRCACHE: too many host changes at once, rereading %s",basePath);
+		EmptyCache();
+		return;
+	}
+
+	std::map<int,std::string>::iterator it = watchDirs.find(wd);
+	if (it == watchDirs.end()) return;
+
+	if (mask & IN_IGNORED) {
+		watchDirs.erase(it);
+		return;
+	}
+	if (mask & (IN_DELETE_SELF|IN_MOVE_SELF)) {
+		/* the parent directory reports this as well, only the base directory needs handling */
+		const bool base = (it->second == basePath);
+		inotify_rm_watch(watchFd,wd);
+		watchDirs.erase(it);
+		if (base) EmptyCache();
+		return;
+	}
+
+	CFileInfo* dir = FindCachedDir(it->second.c_str());
+	if (dir == NULL || *name == 0) return;
+
+	Bits index = FindHostName(dir,name);
+	if (mask & (IN_CREATE|IN_MOVED_TO)) {
+		if (index >= 0) return;
+		CreateEntry(dir,name,(mask & IN_ISDIR) != 0);
+		index = FindHostName(dir,name);
+		if (index >= 0 && (Bitu)index < dir->nextEntry) dir->nextEntry++;
+		save_dir = 0;
+	}
+	else if (mask & (IN_DELETE|IN_MOVED_FROM)) {
+		if (index < 0) return;
+		/* a directory moved elsewhere keeps its watches otherwise */
+		if (mask & IN_ISDIR) UnwatchDirs((it->second + name).c_str());
+		RemoveEntry(dir,(Bitu)index);
+	}
+#else
+	(void)wd; (void)mask; (void)name;
+#endif
+}
+
+/* cached directory for a host directory path, NULL unless it and every directory above it are cached in */
+DOS_Drive_Cache::CFileInfo* DOS_Drive_Cache::FindCachedDir(const char* path) {
+	const size_t baselen = strlen(basePath);
+	if (strncmp(path,basePath,baselen) != 0) return NULL;
+
+	CFileInfo* curDir = dirBase;
+	const char* start = path + baselen;
+	char name[CROSS_LEN];
+
+	while (curDir != NULL && IsCachedIn(curDir)) {
+		while (*start == CROSS_FILESPLIT) start++;
+		if (*start == 0) return curDir;
+
+		const char* pos = strchr(start,CROSS_FILESPLIT);
+		size_t len = pos ? (size_t)(pos - start) : strlen(start);
+		if (len >= CROSS_LEN) return NULL;
+		memcpy(name,start,len);
+		name[len] = 0;
+		start += len;
+
+		Bits index = FindHostName(curDir,name);
+		if (index < 0 || !curDir->fileList[(Bitu)index]->isDir) return NULL;
+		curDir = curDir->fileList[(Bitu)index];
+	}
+	return NULL;
+}
+
+Bits DOS_Drive_Cache::FindHostName(CFileInfo* dir, const char* name) {
+	for (Bitu i=0; i<dir->fileList.size(); i++) {
+		if (strcmp(dir->fileList[i]->orgname,name) == 0) return (Bits)i;
+	}
+	return -1;
+}
+
+void DOS_Drive_Cache::RemoveEntry(CFileInfo* dir, Bitu index) {
+	CFileInfo* info = dir->fileList[index];
+
+	dir->fileList.erase(dir->fileList.begin() + (std::vector<CFileInfo*>::difference_type)index);
+	std::vector<CFileInfo*>::iterator it = std::find(dir->longNameList.begin(),dir->longNameList.end(),info);
+	if (it != dir->longNameList.end()) dir->longNameList.erase(it);
+	if (index < dir->nextEntry) dir->nextEntry--;
+#ifdef WINE_DRIVE_SUPPORT
+	if (dir->names && dir->names->IsWineBuilt()) {
+		char buff[CROSS_LEN];
+		buff[wine_hash_short_file_name(info->orgname,buff)] = 0;
+		dir->names->RemoveWine(buff,info);
+	}
+#endif
+	if (info->shortNr > 0 && dir->names) {
+		// if this was the highest STEM~N, the next name may reuse its number
+		char key[DOS_NAMELENGTH_ASCII];
+		if (GetShortNameKey(info->shortname,key) && dir->names->GetNumber(key) == info->shortNr) {
+			Bitu nr = 0;
+			char other[DOS_NAMELENGTH_ASCII];
+			for (Bitu i=0; i<dir->longNameList.size(); i++) {
+				CFileInfo* entry = dir->longNameList[i];
+				if (entry->shortNr > nr && GetShortNameKey(entry->shortname,other) && strcmp(other,key) == 0)
+					nr = entry->shortNr;
+			}
+			dir->names->ResetNumber(key,nr);
+		}
+	}
+
+	ClearFileInfo(info);
+	dir->FreeEntry(info);
+	save_dir = 0;
+}
@@ -29,6 +29,7 @@
 #include "bios.h"
 #include "bios_disk.h"
 #include "qcow2_disk.h"
+#include "hunk_image.h"
 
 #include <algorithm>
 
@@ -51,6 +52,9 @@ public:
 	void Flush(void);
 	bool UpdateDateTimeFromHost(void);   
 	Bit32u GetSeekPos(void);
+private:
+	Bit32u getSectorRun(Bit32u pos, Bit32u startSector, Bit32u count);
+	Bit32u getWriteSector(void);
 public:
 	Bit32u firstCluster;
 	Bit32u seekpos;
@@ -65,6 +69,7 @@ public:
     bool modified;
 	bool loadedSector;
 	fatDrive *myDrive;
+	fatChainMap chainMap;
 private:
 #if 0/*unused*/
     enum { NONE,READ,WRITE } last_action;
@@ -152,56 +157,95 @@ void fatFile::Flush(void) {
 	}
 }
 	
+/* Number of sectors, up to count, that follow startSector on the disk in the same order as in
+ * the file starting at byte position pos. The chain map makes each lookup cheap. */
+Bit32u fatFile::getSectorRun(Bit32u pos, Bit32u startSector, Bit32u count) {
+	const Bit32u secsize = myDrive->getSectorSize();
+	Bit32u run = 1;
+	while (run < count && myDrive->getAbsoluteSectFromBytePos(firstCluster, pos + (run * secsize), &chainMap) == (startSector + run))
+		run++;
+	return run;
+}
+
+/* Sector holding seekpos for writing, allocating the first cluster or appending one when
+ * the chain is too short. 0 if the disk is full. */
+Bit32u fatFile::getWriteSector(void) {
+	if (filelength == 0) {
+		firstCluster = myDrive->getFirstFreeClust();
+		if (firstCluster == 0) return 0; // out of space
+		myDrive->allocateCluster(firstCluster, 0);
+	}
+	Bit32u sector = myDrive->getAbsoluteSectFromBytePos(firstCluster, seekpos, &chainMap);
+	if (sector == 0) {
+		/* EOC reached before EOF - try to increase file allocation */
+		myDrive->appendCluster(firstCluster);
+		/* Try getting sector again */
+		sector = myDrive->getAbsoluteSectFromBytePos(firstCluster, seekpos, &chainMap);
+	}
+	return sector;
+}
+
 bool fatFile::Read(Bit8u * data, Bit16u *size) {
 	if ((this->flags & 0xf) == OPEN_WRITE) {	// check if file opened in write-only mode
 		DOS_SetError(DOSERR_ACCESS_DENIED);
 		return false;
 	}
-	Bit16u sizedec, sizecount;
 	if(seekpos >= filelength) {
 		*size = 0;
 		return true;
 	}
 
-	if (!loadedSector) {
-		currentSector = myDrive->getAbsoluteSectFromBytePos(firstCluster, seekpos);
-		if(currentSector == 0) {
-			/* EOC reached before EOF */
-			*size = 0;
+	const Bit32u secsize = myDrive->getSectorSize();
+	Bit32u want = *size;
+	if (want > (filelength - seekpos)) want = filelength - seekpos;
+
+	Bit32u done = 0;
+	while (done < want) {
+		curSectOff = seekpos % secsize;
+
+		if (curSectOff == 0 && (want - done) >= secsize) {
+			/* whole sectors go straight into the caller's buffer, one read per contiguous run */
+			Bit32u sector = myDrive->getAbsoluteSectFromBytePos(firstCluster, seekpos, &chainMap);
+			if (sector == 0) break; /* EOC reached before EOF */
+
+			Bit32u run = getSectorRun(seekpos, sector, (want - done) / secsize);
 			loadedSector = false;
-			return true;
+			if (myDrive->readSectors(sector, run, data + done) != 0) {
+				DOS_SetError(DOSERR_READ_FAULT);
+				return false;
+			}
+			done += run * secsize;
+			seekpos += run * secsize;
+			continue;
 		}
-		curSectOff = seekpos % myDrive->getSectorSize();
-		myDrive->readSector(currentSector, sectorBuffer);
-		loadedSector = true;
-	}
 
-	sizedec = *size;
-	sizecount = 0;
-	while(sizedec != 0) {
-		if(seekpos >= filelength) {
-			*size = sizecount;
-			return true; 
-		}
-		data[sizecount++] = sectorBuffer[curSectOff++];
-		seekpos++;
-		if(curSectOff >= myDrive->getSectorSize()) {
-			currentSector = myDrive->getAbsoluteSectFromBytePos(firstCluster, seekpos);
-			if(currentSector == 0) {
-				/* EOC reached before EOF */
-				//LOG_MSG("EOC reached before EOF, seekpos %d, filelen %d", seekpos, filelength);
-				*size = sizecount;
-				loadedSector = false;
-				return true;
+		/* partial sector at the start or end, through the sector buffer */
+		if (!loadedSector) {
+			currentSector = myDrive->getAbsoluteSectFromBytePos(firstCluster, seekpos, &chainMap);
+			if (currentSector == 0) break; /* EOC reached before EOF */
+			if (myDrive->readSector(currentSector, sectorBuffer) != 0) {
+				DOS_SetError(DOSERR_READ_FAULT);
+				return false;
 			}
-			curSectOff = 0;
-			myDrive->readSector(currentSector, sectorBuffer);
 			loadedSector = true;
-			//LOG_MSG("Reading absolute sector at %d for seekpos %d", currentSector, seekpos);
 		}
-		--sizedec;
+
+		Bit32u n = std::min(secsize - curSectOff, want - done);
+		memcpy(data + done, &sectorBuffer[curSectOff], n);
+		done += n;
+		seekpos += n;
+		curSectOff += n;
+		if (curSectOff >= secsize) {
+			curSectOff = 0;
+			loadedSector = false;
+		}
 	}
-	*size =sizecount;
+
+	if (done < want) {
+		//LOG_MSG("EOC reached before EOF, seekpos %d, filelen %d", seekpos, filelength);
+		loadedSector = false;
+	}
+	*size = (Bit16u)done;
 	return true;
 }
 
@@ -212,9 +256,10 @@ bool fatFile::Write(Bit8u * data, Bit16u *size) {
 	}
 
 	direntry tmpentry;
-	Bit16u sizedec, sizecount;
-	sizedec = *size;
-	sizecount = 0;
+	const Bit32u secsize = myDrive->getSectorSize();
+	Bit32u want = *size;
+	Bit32u done = 0;
+	bool ioerror = false;
 	
 	if(seekpos < filelength && *size == 0) {
 		/* Truncate file to current position */
@@ -241,62 +286,63 @@ bool fatFile::Write(Bit8u * data, Bit16u *size) {
 		if(*size == 0) goto finalizeWrite;
 	}
 
-	while(sizedec != 0) {
-		/* Increase filesize if necessary */
-		if(seekpos >= filelength) {
-			if(filelength == 0) {
-				firstCluster = myDrive->getFirstFreeClust();
-				if(firstCluster == 0) goto finalizeWrite; // out of space
-				myDrive->allocateCluster(firstCluster, 0);
-				currentSector = myDrive->getAbsoluteSectFromBytePos(firstCluster, seekpos);
-				myDrive->readSector(currentSector, sectorBuffer);
-				loadedSector = true;
-			}
-			if (!loadedSector) {
-				currentSector = myDrive->getAbsoluteSectFromBytePos(firstCluster, seekpos);
-				if(currentSector == 0) {
-					/* EOC reached before EOF - try to increase file allocation */
-					myDrive->appendCluster(firstCluster);
-					/* Try getting sector again */
-					currentSector = myDrive->getAbsoluteSectFromBytePos(firstCluster, seekpos);
-					if(currentSector == 0) {
-						/* No can do. lets give up and go home.  We must be out of room */
-						goto finalizeWrite;
-					}
-				}
-				curSectOff = seekpos % myDrive->getSectorSize();
-				myDrive->readSector(currentSector, sectorBuffer);
-				loadedSector = true;
+	/* an empty file gets a fresh first cluster, whatever sector was loaded is stale */
+	if(filelength == 0) loadedSector = false;
+
+	while(done < want) {
+		curSectOff = seekpos % secsize;
+
+		if (curSectOff == 0 && (want - done) >= secsize) {
+			/* whole sectors are written from the caller's buffer, one write per contiguous run */
+			Bit32u sector = getWriteSector();
+			/* No can do. lets give up and go home.  We must be out of room */
+			if (sector == 0) break;
+
+			Bit32u run = getSectorRun(seekpos, sector, (want - done) / secsize);
+			loadedSector = false;
+			if (myDrive->writeSectors(sector, run, data + done) != 0) {
+				ioerror = true;
+				break;
 			}
-			filelength = seekpos+1;
+			done += run * secsize;
+			seekpos += run * secsize;
+			if (seekpos > filelength) filelength = seekpos;
+			modified = true;
+			continue;
 		}
-		sectorBuffer[curSectOff++] = data[sizecount++];
-		seekpos++;
-		if(curSectOff >= myDrive->getSectorSize()) {
-			if(loadedSector) myDrive->writeSector(currentSector, sectorBuffer);
-			loadedSector = false;
 
-			if (sizedec <= 1) goto finalizeWrite; // --sizedec == 0
-
-			currentSector = myDrive->getAbsoluteSectFromBytePos(firstCluster, seekpos);
-			if(currentSector == 0) {
-				/* EOC reached before EOF - try to increase file allocation */
-				myDrive->appendCluster(firstCluster);
-				/* Try getting sector again */
-				currentSector = myDrive->getAbsoluteSectFromBytePos(firstCluster, seekpos);
-				if(currentSector == 0) {
-					/* No can do. lets give up and go home.  We must be out of room */
-					goto finalizeWrite;
-				}
+		/* partial sector at the start or end, read-modify-write through the sector buffer */
+		if (!loadedSector) {
+			currentSector = getWriteSector();
+			/* No can do. lets give up and go home.  We must be out of room */
+			if (currentSector == 0) break;
+			if (myDrive->readSector(currentSector, sectorBuffer) != 0) {
+				ioerror = true;
+				break;
 			}
-			curSectOff = 0;
-			myDrive->readSector(currentSector, sectorBuffer);
 			loadedSector = true;
 		}
-        modified = true;
-		--sizedec;
+
+		Bit32u n = std::min(secsize - curSectOff, want - done);
+		memcpy(&sectorBuffer[curSectOff], data + done, n);
+		done += n;
+		seekpos += n;
+		curSectOff += n;
+		if (seekpos > filelength) filelength = seekpos;
+		modified = true;
+		if (curSectOff >= secsize) {
+			curSectOff = 0;
+			loadedSector = false;
+			if (myDrive->writeSector(currentSector, sectorBuffer) != 0) {
+				ioerror = true;
+				break;
+			}
+		}
+	}
+	if(curSectOff>0 && loadedSector && myDrive->writeSector(currentSector, sectorBuffer) != 0) {
+		loadedSector = false;
+		ioerror = true;
 	}
-	if(curSectOff>0 && loadedSector) myDrive->writeSector(currentSector, sectorBuffer);
 
 finalizeWrite:
 	myDrive->directoryBrowse(dirCluster, &tmpentry, (Bit32s)dirIndex);
@@ -304,7 +350,12 @@ finalizeWrite:
 	tmpentry.loFirstClust = (Bit16u)firstCluster;
 	myDrive->directoryChange(dirCluster, &tmpentry, (Bit32s)dirIndex);
 
-	*size =sizecount;
+	if (ioerror) {
+		/* the directory entry still covers the sectors that did reach the disk */
+		DOS_SetError(DOSERR_WRITE_FAULT);
+		return false;
+	}
+	*size = (Bit16u)done;
 	return true;
 }
 
@@ -327,7 +378,7 @@ bool fatFile::Seek(Bit32u *pos, Bit32u type) {
 
 	if(seekto<0) seekto = 0;
 	seekpos = (Bit32u)seekto;
-	currentSector = myDrive->getAbsoluteSectFromBytePos(firstCluster, seekpos);
+	currentSector = myDrive->getAbsoluteSectFromBytePos(firstCluster, seekpos, &chainMap);
 	if (currentSector == 0) {
 		/* not within file size, thus no sector is available */
 		loadedSector = false;
@@ -384,10 +435,66 @@ Bit32u fatDrive::getClustFirstSect(Bit32u clustNum) {
 	return ((clustNum - 2) * bootbuffer.sectorspercluster) + firstDataSector;
 }
 
+bool fatDrive::loadFAT(void) {
+	checkDiskWrites();
+	if (fatCacheValid) return true;
+
+	const Bit32u fatbytes = (Bit32u)bootbuffer.sectorsperfat * std::max((Bit32u)bootbuffer.bytespersector,getSectSize());
+	/* one spare byte, a FAT12 entry read at the very end of the table touches the byte after it */
+	fatCache.assign(fatbytes + 1u, 0);
+	fatCacheDirty.assign(bootbuffer.sectorsperfat, false);
+	if (readSectors(bootbuffer.reservedsectors + partSectOff, bootbuffer.sectorsperfat, &fatCache[0]) != 0) {
+		LOG_MSG("FAT: Unable to read the file allocation table");
+		fatCache.clear();
+		fatCacheDirty.clear();
+		return false;
+	}
+	fatCacheValid = true;
+	return true;
+}
+
+void fatDrive::invalidateFAT(void) {
+	flushFAT();
+	fatCacheValid = false;
+	fatCache.clear();
+	fatCacheDirty.clear();
+	chainGeneration++;
+}
+
+/* something other than this driver wrote to the disk (INT 13h, IDE, the floppy controller), so the
+ * cached FAT and chain maps may no longer match it. They are dropped, not flushed: the cache is clean
+ * between operations and the disk is newer. */
+void fatDrive::checkDiskWrites(void) {
+	if (loadedDisk == NULL || loadedDisk->write_generation == diskWriteGeneration) return;
+	diskWriteGeneration = loadedDisk->write_generation;
+	fatCacheValid = false;
+	fatCache.clear();
+	fatCacheDirty.clear();
+	chainGeneration++;
+}
+
+void fatDrive::flushFAT(void) {
+	if (!fatCacheValid) return;
+
+	const Bit32u bps = bootbuffer.bytespersector;
+	Bit32u i = 0;
+	while (i < (Bit32u)fatCacheDirty.size()) {
+		if (!fatCacheDirty[i]) {
+			i++;
+			continue;
+		}
+		/* write each run of changed sectors to every copy of the FAT */
+		Bit32u n = 1;
+		while ((i + n) < (Bit32u)fatCacheDirty.size() && fatCacheDirty[i + n]) n++;
+		for (unsigned int fc=0;fc<bootbuffer.fatcopies;fc++)
+			writeSectors(bootbuffer.reservedsectors + partSectOff + (fc * bootbuffer.sectorsperfat) + i, n, &fatCache[i * bps]);
+		for (Bit32u j=0;j < n;j++) fatCacheDirty[i + j] = false;
+		i += n;
+	}
+}
+
 Bit32u fatDrive::getClusterValue(Bit32u clustNum) {
 	Bit32u fatoffset=0;
-	Bit32u fatsectnum;
-	Bit32u fatentoff;
 	Bit32u clustValue=0;
 
 	switch(fattype) {
@@ -401,22 +508,12 @@ Bit32u fatDrive::getClusterValue(Bit32u clustNum) {
 			fatoffset = clustNum * 4;
 			break;
 	}
-	fatsectnum = bootbuffer.reservedsectors + (fatoffset / bootbuffer.bytespersector) + partSectOff;
-	fatentoff = fatoffset % bootbuffer.bytespersector;
 
-    assert((bootbuffer.bytespersector * 2) <= sizeof(fatSectBuffer));
-
-	if(curFatSect != fatsectnum) {
-		/* Load two sectors at once for FAT12 */
-		readSector(fatsectnum, &fatSectBuffer[0]);
-		if (fattype==FAT12)
-			readSector(fatsectnum+1, &fatSectBuffer[bootbuffer.bytespersector]);
-		curFatSect = fatsectnum;
-	}
+	if (!loadFAT() || (fatoffset + 2u) > (Bit32u)fatCache.size()) return 0;
 
 	switch(fattype) {
 		case FAT12:
-			clustValue = *((Bit16u *)&fatSectBuffer[fatentoff]);
+			clustValue = host_readw(&fatCache[fatoffset]);
 			if(clustNum & 0x1) {
 				clustValue >>= 4;
 			} else {
@@ -424,10 +521,11 @@ Bit32u fatDrive::getClusterValue(Bit32u clustNum) {
 			}
 			break;
 		case FAT16:
-			clustValue = *((Bit16u *)&fatSectBuffer[fatentoff]);
+			clustValue = host_readw(&fatCache[fatoffset]);
 			break;
 		case FAT32:
-			clustValue = *((Bit32u *)&fatSectBuffer[fatentoff]);
+			if ((fatoffset + 4u) > (Bit32u)fatCache.size()) return 0;
+			clustValue = host_readd(&fatCache[fatoffset]);
 			break;
 	}
 
@@ -436,36 +534,33 @@ Bit32u fatDrive::getClusterValue(Bit32u clustNum) {
 
 void fatDrive::setClusterValue(Bit32u clustNum, Bit32u clustValue) {
 	Bit32u fatoffset=0;
-	Bit32u fatsectnum;
-	Bit32u fatentoff;
+	Bit32u fatlast=0;
 
 	switch(fattype) {
 		case FAT12:
 			fatoffset = clustNum + (clustNum / 2);
+			fatlast = fatoffset + 1;
 			break;
 		case FAT16:
 			fatoffset = clustNum * 2;
+			fatlast = fatoffset + 1;
 			break;
 		case FAT32:
 			fatoffset = clustNum * 4;
+			fatlast = fatoffset + 3;
 			break;
 	}
-	fatsectnum = bootbuffer.reservedsectors + (fatoffset / bootbuffer.bytespersector) + partSectOff;
-	fatentoff = fatoffset % bootbuffer.bytespersector;
 
-    assert((bootbuffer.bytespersector * 2) <= sizeof(fatSectBuffer));
+	if (!loadFAT() || fatlast >= (Bit32u)fatCache.size()) return;
 
-	if(curFatSect != fatsectnum) {
-		/* Load two sectors at once for FAT12 */
-		readSector(fatsectnum, &fatSectBuffer[0]);
-		if (fattype==FAT12)
-			readSector(fatsectnum+1, &fatSectBuffer[bootbuffer.bytespersector]);
-		curFatSect = fatsectnum;
-	}
+	/* changing a link that points somewhere breaks the chain maps built through it */
+	const Bit32u oldValue = getClusterValue(clustNum);
+	if (oldValue != clustValue && oldValue >= 2 && oldValue <= (CountOfClusters + 1))
+		chainGeneration++;
 
 	switch(fattype) {
 		case FAT12: {
-			Bit16u tmpValue = *((Bit16u *)&fatSectBuffer[fatentoff]);
+			Bit16u tmpValue = host_readw(&fatCache[fatoffset]);
 			if(clustNum & 0x1) {
 				clustValue &= 0xfff;
 				clustValue <<= 4;
@@ -477,23 +572,21 @@ void fatDrive::setClusterValue(Bit32u clustNum, Bit32u clustValue) {
 				tmpValue &= 0xf000;
 				tmpValue |= (Bit16u)clustValue;
 			}
-			*((Bit16u *)&fatSectBuffer[fatentoff]) = tmpValue;
+			host_writew(&fatCache[fatoffset],tmpValue);
 			break;
 			}
 		case FAT16:
-			*((Bit16u *)&fatSectBuffer[fatentoff]) = (Bit16u)clustValue;
+			host_writew(&fatCache[fatoffset],(Bit16u)clustValue);
 			break;
 		case FAT32:
-			*((Bit32u *)&fatSectBuffer[fatentoff]) = clustValue;
+			host_writed(&fatCache[fatoffset],clustValue);
 			break;
 	}
-	for(unsigned int fc=0;fc<bootbuffer.fatcopies;fc++) {
-		writeSector(fatsectnum + (fc * bootbuffer.sectorsperfat), &fatSectBuffer[0]);
-		if (fattype==FAT12) {
-			if (fatentoff >= (bootbuffer.bytespersector-1U))
-				writeSector(fatsectnum+1u+(fc * bootbuffer.sectorsperfat), &fatSectBuffer[bootbuffer.bytespersector]);
-		}
-	}
+
+	const Bit32u bps = bootbuffer.bytespersector;
+	fatCacheDirty[fatoffset / bps] = true;
+	if ((fatlast / bps) < (Bit32u)fatCacheDirty.size())
+		fatCacheDirty[fatlast / bps] = true;
 }
 
 bool fatDrive::getEntryName(const char *fullname, char *entname) {
@@ -683,6 +776,7 @@ bool fatDrive::getDirClustNum(const char *dir, Bit32u *clustNum, bool parDir) {
 }
 
 Bit8u fatDrive::readSector(Bit32u sectnum, void * data) {
+	DISKIO_Sync();
 	if (absolute) return Read_AbsoluteSector(sectnum, data);
     assert(!IS_PC98_ARCH);
 	Bit32u cylindersize = bootbuffer.headcount * bootbuffer.sectorspertrack;
@@ -694,6 +788,7 @@ Bit8u fatDrive::readSector(Bit32u sectnum, void * data) {
 }	
 
 Bit8u fatDrive::writeSector(Bit32u sectnum, void * data) {
+	DISKIO_Sync();
 	if (absolute) return Write_AbsoluteSector(sectnum, data);
     assert(!IS_PC98_ARCH);
 	Bit32u cylindersize = bootbuffer.headcount * bootbuffer.sectorspertrack;
@@ -704,6 +799,40 @@ Bit8u fatDrive::writeSector(Bit32u sectnum, void * data) {
 	return loadedDisk->Write_Sector(head, cylinder, sector, data);
 }
 
+Bit8u fatDrive::readSectors(Bit32u sectnum, Bit32u count, void * data) {
+	DISKIO_Sync();
+	if (absolute && loadedDisk != NULL) {
+		const unsigned int lsz = loadedDisk->getSectSize();
+		unsigned int c = sector_size / lsz;
+
+		if (c != 0 && (sector_size % lsz) == 0)
+			return (loadedDisk->Read_Sectors(sectnum * c,count * c,data) != 0) ? 0x05 : 0;
+	}
+
+	for (Bit32u i=0;i < count;i++) {
+		Bit8u ret = readSector(sectnum+i, (Bit8u*)data + (i * getSectSize()));
+		if (ret != 0) return ret;
+	}
+	return 0;
+}
+
+Bit8u fatDrive::writeSectors(Bit32u sectnum, Bit32u count, void * data) {
+	DISKIO_Sync();
+	if (absolute && loadedDisk != NULL) {
+		const unsigned int lsz = loadedDisk->getSectSize();
+		unsigned int c = sector_size / lsz;
+
+		if (c != 0 && (sector_size % lsz) == 0)
+			return (loadedDisk->Write_Sectors(sectnum * c,count * c,data) != 0) ? 0x05 : 0;
+	}
+
+	for (Bit32u i=0;i < count;i++) {
+		Bit8u ret = writeSector(sectnum+i, (Bit8u*)data + (i * getSectSize()));
+		if (ret != 0) return ret;
+	}
+	return 0;
+}
+
 Bit32u fatDrive::GetSectorCount(void) {
     return (loadedDisk->heads * loadedDisk->sectors * loadedDisk->cylinders) - partSectOff;
 }
@@ -725,23 +854,79 @@ Bit8u fatDrive::Read_AbsoluteSector_INT25(Bit32u sectnum, void * data) {
 }
 
 Bit8u fatDrive::Write_AbsoluteSector_INT25(Bit32u sectnum, void * data) {
-    return writeSector(sectnum+partSectOff,data);
+    Bit8u ret = writeSector(sectnum+partSectOff,data);
+
+    /* the caller may have rewritten part of the FAT behind our back */
+    if (sectnum >= bootbuffer.reservedsectors &&
+        sectnum < (bootbuffer.reservedsectors + ((Bit32u)bootbuffer.fatcopies * bootbuffer.sectorsperfat)))
+        invalidateFAT();
+
+    return ret;
 }
 
-Bit32u fatDrive::getAbsoluteSectFromBytePos(Bit32u startClustNum, Bit32u bytePos) {
-	return  getAbsoluteSectFromChain(startClustNum, bytePos / bootbuffer.bytespersector);
+Bit32u fatDrive::getAbsoluteSectFromBytePos(Bit32u startClustNum, Bit32u bytePos, fatChainMap *map) {
+	return  getAbsoluteSectFromChain(startClustNum, bytePos / bootbuffer.bytespersector, map);
 }
 
-Bit32u fatDrive::getAbsoluteSectFromChain(Bit32u startClustNum, Bit32u logicalSector) {
-	Bit32s skipClust = (Bit32s)(logicalSector / bootbuffer.sectorspercluster);
-	Bit32u sectClust = (Bit32u)(logicalSector % bootbuffer.sectorspercluster);
+Bit32u fatDrive::getAbsoluteSectFromChain(Bit32u startClustNum, Bit32u logicalSector, fatChainMap *map) {
+	Bit32u skipClust = logicalSector / bootbuffer.sectorspercluster;
+	Bit32u sectClust = logicalSector % bootbuffer.sectorspercluster;
 
 	Bit32u currentClust = startClustNum;
-	Bit32u testvalue;
+	if (skipClust != 0) {
+		currentClust = getChainCluster(startClustNum, skipClust, map != NULL ? map : &chainMap);
+		if (currentClust == 0) return 0;
+	}
 
-	while(skipClust!=0) {
+	return (getClustFirstSect(currentClust) + sectClust);
+}
+
+/* Cluster number clustIndex clusters into the chain starting at startClustNum, 0 if the
+ * chain ends before that. Known runs are looked up in the map, the chain is only walked
+ * (and the map extended) past the end of what was walked before. */
+Bit32u fatDrive::getChainCluster(Bit32u startClustNum, Bit32u clustIndex, fatChainMap *map) {
+	checkDiskWrites();
+	if (map->first != startClustNum || map->generation != chainGeneration || map->extents.empty()) {
+		fatChainMap::Extent e;
+		e.index = 0;
+		e.cluster = startClustNum;
+		e.count = 1;
+		map->extents.clear();
+		map->extents.push_back(e);
+		map->first = startClustNum;
+		map->generation = chainGeneration;
+		map->last = 0;
+	}
+
+	std::vector<fatChainMap::Extent> &ext = map->extents;
+
+	/* sequential access hits the previous extent or the one after it */
+	size_t i = map->last < ext.size() ? map->last : 0;
+	if (clustIndex < ext[i].index || clustIndex >= (ext[i].index + ext[i].count)) {
+		if ((i + 1) < ext.size() && clustIndex >= ext[i+1].index && clustIndex < (ext[i+1].index + ext[i+1].count)) {
+			i++;
+		}
+		else {
+			size_t lo = 0,hi = ext.size();
+			while ((hi - lo) > 1) {
+				size_t mid = (lo + hi) / 2;
+				if (ext[mid].index <= clustIndex) lo = mid;
+				else hi = mid;
+			}
+			i = lo;
+		}
+	}
+	if (clustIndex < (ext[i].index + ext[i].count)) {
+		map->last = i;
+		return ext[i].cluster + (clustIndex - ext[i].index);
+	}
+
+	/* past what is known, continue walking the chain from its last known cluster */
+	Bit32u currentClust = ext.back().cluster + ext.back().count - 1;
+	Bit32u idx = ext.back().index + ext.back().count - 1;
+	while (idx < clustIndex) {
+		Bit32u testvalue = getClusterValue(currentClust);
 		bool isEOF = false;
-		testvalue = getClusterValue(currentClust);
 		switch(fattype) {
 			case FAT12:
 				if(testvalue >= 0xff8) isEOF = true;
@@ -753,19 +938,30 @@ Bit32u fatDrive::getAbsoluteSectFromChain(Bit32u startClustNum, Bit32u logicalSe
 				if(testvalue >= 0xfffffff8) isEOF = true;
 				break;
 		}
-		if((isEOF) && (skipClust>=1)) {
+		if (isEOF || testvalue < 2) {
 			//LOG_MSG("End of cluster chain reached before end of logical sector seek!");
-			if (skipClust == 1 && fattype == FAT12) {
-				//break;
+			if ((clustIndex - idx) == 1 && fattype == FAT12) {
 				LOG(LOG_DOSMISC,LOG_ERROR)("End of cluster chain reached, but maybe good afterall ?");
 			}
+			map->last = ext.size() - 1;
 			return 0;
 		}
+		idx++;
+		if (testvalue == (currentClust + 1)) {
+			ext.back().count++;
+		}
+		else {
+			fatChainMap::Extent e;
+			e.index = idx;
+			e.cluster = testvalue;
+			e.count = 1;
+			ext.push_back(e);
+		}
 		currentClust = testvalue;
-		--skipClust;
 	}
 
-	return (getClustFirstSect(currentClust) + sectClust);
+	map->last = ext.size() - 1;
+	return currentClust;
 }
 
 void fatDrive::deleteClustChain(Bit32u startCluster, Bit32u bytePos) {
@@ -814,6 +1010,7 @@ void fatDrive::deleteClustChain(Bit32u startCluster, Bit32u bytePos) {
 		currentClust = testvalue;
 		countClust++;
 	}
+	flushFAT();
 }
 
 Bit32u fatDrive::appendCluster(Bit32u startCluster) {
@@ -874,11 +1071,13 @@ bool fatDrive::allocateCluster(Bit32u useCluster, Bit32u prevCluster) {
 			setClusterValue(useCluster, 0xffffffff);
 			break;
 	}
+	flushFAT();
 	return true;
 }
 
 fatDrive::~fatDrive() {
 	if (loadedDisk) {
+		flushFAT();
 		loadedDisk->Release();
 		loadedDisk = NULL;
 	}
@@ -906,7 +1105,7 @@ struct _PC98RawPartition {
 };
 #pragma pack(pop)
 
-fatDrive::fatDrive(const char *sysFilename, Bit32u bytesector, Bit32u cylsector, Bit32u headscyl, Bit32u cylinders, std::vector<std::string> &options) : loadedDisk(NULL) {
+fatDrive::fatDrive(const char *sysFilename, Bit32u bytesector, Bit32u cylsector, Bit32u headscyl, Bit32u cylinders, std::vector<std::string> &options) : loadedDisk(NULL), fatCacheValid(false), diskWriteGeneration(0), chainGeneration(0) {
 	created_successfully = true;
 	FILE *diskfile;
 	Bit32u filesize;
@@ -937,6 +1136,15 @@ fatDrive::fatDrive(const char *sysFilename, Bit32u bytesector, Bit32u cylsector,
 		filesize = (Bit32u)(qcow2_header.size / 1024L);
 		loadedDisk = new QCow2Disk(qcow2_header, diskfile, (Bit8u *)sysFilename, filesize, bytesector, (filesize > 2880));
 	}
+	else if (HunkImage::IsHunkImage(diskfile)) {
+		HunkImage *hunkImage = HunkImage::Open(diskfile); /* closes diskfile on failure */
+		if (hunkImage == NULL) {
+			created_successfully = false;
+			return;
+		}
+		filesize = (Bit32u)(hunkImage->GetSize() / 1024L);
+		loadedDisk = new imageDiskHunk(hunkImage, sysFilename, (filesize > 2880));
+	}
 	else{
 		fseeko64(diskfile, 0L, SEEK_SET);
         assert(sizeof(bootbuffer.bootcode) >= 256);
@@ -967,14 +1175,14 @@ fatDrive::fatDrive(const char *sysFilename, Bit32u bytesector, Bit32u cylsector,
         else {
             fseeko64(diskfile, 0L, SEEK_END);
             filesize = (Bit32u)(ftello64(diskfile) / 1024L);
-            loadedDisk = new imageDisk(diskfile, (Bit8u *)sysFilename, filesize, (filesize > 2880));
+            loadedDisk = new imageDiskMapped(diskfile, (Bit8u *)sysFilename, filesize, (filesize > 2880));
         }
 	}
 
     fatDriveInit(sysFilename, bytesector, cylsector, headscyl, cylinders, filesize, options);
 }
 
-fatDrive::fatDrive(imageDisk *sourceLoadedDisk, std::vector<std::string> &options) : loadedDisk(NULL) {
+fatDrive::fatDrive(imageDisk *sourceLoadedDisk, std::vector<std::string> &options) : loadedDisk(NULL), fatCacheValid(false), diskWriteGeneration(0), chainGeneration(0) {
 	if (sourceLoadedDisk == 0) {
 		created_successfully = false;
 		return;
@@ -993,46 +1201,28 @@ fatDrive::fatDrive(imageDisk *sourceLoadedDisk, std::vector<std::string> &option
 }
 
 Bit8u fatDrive::Read_AbsoluteSector(Bit32u sectnum, void * data) {
+    DISKIO_Sync();
     if (loadedDisk != NULL) {
         /* this will only work if the logical sector size is larger than the disk sector size */
         const unsigned int lsz = loadedDisk->getSectSize();
         unsigned int c = sector_size / lsz;
 
-        if (c != 0 && (sector_size % lsz) == 0) {
-            Bit32u ssect = sectnum * c;
-
-            while (c-- != 0) {
-                if (loadedDisk->Read_AbsoluteSector(ssect++,data) != 0)
-                    return 0x05;
-
-                data = (void*)((char*)data + lsz);
-            }
-
-            return 0;
-        }
+        if (c != 0 && (sector_size % lsz) == 0)
+            return (loadedDisk->Read_Sectors(sectnum * c,c,data) != 0) ? 0x05 : 0;
     }
 
     return 0x05;
 }
 
 Bit8u fatDrive::Write_AbsoluteSector(Bit32u sectnum, void * data) {
+    DISKIO_Sync();
     if (loadedDisk != NULL) {
         /* this will only work if the logical sector size is larger than the disk sector size */
         const unsigned int lsz = loadedDisk->getSectSize();
         unsigned int c = sector_size / lsz;
 
-        if (c != 0 && (sector_size % lsz) == 0) {
-            Bit32u ssect = sectnum * c;
-
-            while (c-- != 0) {
-                if (loadedDisk->Write_AbsoluteSector(ssect++,data) != 0)
-                    return 0x05;
-
-                data = (void*)((char*)data + lsz);
-            }
-
-            return 0;
-        }
+        if (c != 0 && (sector_size % lsz) == 0)
+            return (loadedDisk->Write_Sectors(sectnum * c,c,data) != 0) ? 0x05 : 0;
     }
 
     return 0x05;
@@ -1087,6 +1277,8 @@ void fatDrive::fatDriveInit(const char *sysFilename, Bit32u bytesector, Bit32u c
 		return;
 	}
 
+	DISKIO_Sync();
+
     //for (const auto &opt : options) {
 	for (std::vector<std::string>::iterator i=options.begin();i!=options.end();i++) {
 		std::string opt = *i;
@@ -1492,8 +1684,10 @@ void fatDrive::fatDriveInit(const char *sysFilename, Bit32u bytesector, Bit32u c
 	/* There is no cluster 0, this means we are in the root directory */
 	cwdDirCluster = 0;
 
-	memset(fatSectBuffer,0,1024);
-	curFatSect = 0xffffffff;
+	fatCacheValid = false;
+	fatCache.clear();
+	fatCacheDirty.clear();
+	chainGeneration++;
 
 	strcpy(info, "fatDrive ");
 	strcat(info, sysFilename);
@@ -161,6 +161,8 @@ isoDrive::isoDrive(char driveLetter, const char *fileName, Bit8u mediaid, int &e
 	nextFreeDirIterator = 0;
 	memset(dirIterators, 0, sizeof(dirIterators));
 	memset(sectorHashEntries, 0, sizeof(sectorHashEntries));
+	memset(sectorCache, 0, sizeof(sectorCache));
+	sectorCacheClock = 0;
 	memset(&rootEntry, 0, sizeof(isoDirEntry));
 	
 	safe_strncpy(this->fileName, fileName, CROSS_LEN);
@@ -188,7 +190,9 @@ isoDrive::isoDrive(char driveLetter, const char *fileName, Bit8u mediaid, int &e
 	}
 }
 
-isoDrive::~isoDrive() { }
+isoDrive::~isoDrive() {
+	ClearCaches();
+}
 
 int isoDrive::UpdateMscdex(char driveLetter, const char* path, Bit8u& subUnit) {
 	if (MSCDEX_HasDrive(driveLetter)) {
@@ -211,6 +215,7 @@ int isoDrive::UpdateMscdex(char driveLetter, const char* path, Bit8u& subUnit) {
 
 void isoDrive::Activate(void) {
 	UpdateMscdex(driveLetter, fileName, subUnit);
+	ClearCaches();
 }
 
 bool isoDrive::FileOpen(DOS_File **file, const char *name, Bit32u flags) {
@@ -476,8 +481,31 @@ bool isoDrive::ReadCachedSector(Bit8u** buffer, const Bit32u sector) {
 	return true;
 }
 
-inline bool isoDrive :: readSector(Bit8u *buffer, Bit32u sector) {
-	return CDROM_Interface_Image::images[subUnit]->ReadSector(buffer, false, sector);
+bool isoDrive :: readSector(Bit8u *buffer, Bit32u sector) {
+	std::map<Bit32u, Bitu>::iterator it = sectorCacheIndex.find(sector);
+	if (it != sectorCacheIndex.end()) {
+		SectorCacheEntry& ce = sectorCache[it->second];
+		ce.lastUse = ++sectorCacheClock;
+		memcpy(buffer, ce.data, ISO_FRAMESIZE);
+		return true;
+	}
+
+	// replace the least recently used sector
+	Bitu victim = 0;
+	for (Bitu i = 1; i < ISO_SECTOR_CACHE_SIZE; i++) {
+		if (sectorCache[i].lastUse < sectorCache[victim].lastUse) victim = i;
+	}
+	SectorCacheEntry& ce = sectorCache[victim];
+	if (ce.lastUse) {
+		sectorCacheIndex.erase(ce.sector);
+		ce.lastUse = 0;
+	}
+	if (!CDROM_Interface_Image::images[subUnit]->ReadSector(ce.data, false, sector)) return false;
+	ce.sector = sector;
+	ce.lastUse = ++sectorCacheClock;
+	sectorCacheIndex[sector] = victim;
+	memcpy(buffer, ce.data, ISO_FRAMESIZE);
+	return true;
 }
 
 int isoDrive :: readDirEntry(isoDirEntry *de, Bit8u *data) {	
@@ -543,34 +571,74 @@ bool isoDrive :: lookup(isoDirEntry *de, const char *path) {
 	char isoPath[ISO_MAXPATHNAME];
 	safe_strncpy(isoPath, path, ISO_MAXPATHNAME);
 	strreplace(isoPath, '\\', '/');
+	upcase(isoPath);
+
+	std::map<std::string, const isoDirEntry*>::iterator cached = pathCache.find(isoPath);
+	if (cached != pathCache.end()) {
+		*de = *cached->second;
+		return true;
+	}
+	std::string key = isoPath;
 	
 	// iterate over all path elements (name), and search each of them in the current de
+	const isoDirEntry* found = &this->rootEntry;
 	for(char* name = strtok(isoPath, "/"); NULL != name; name = strtok(NULL, "/")) {
-
-		bool found = false;	
 		// current entry must be a directory, abort otherwise
-		if (IS_DIR(FLAGS2)) {
-			
-			// remove the trailing dot if present
-			size_t nameLength = strlen(name);
-			if (nameLength > 0) {
-				if (name[nameLength - 1] == '.') name[nameLength - 1] = 0;
-			}
-			
-			// look for the current path element
-			int dirIterator = GetDirIterator(de);
-			while (!found && GetNextDirEntry(dirIterator, de)) {
-				if (!IS_ASSOC(FLAGS2) && (0 == strncasecmp((char*) de->ident, name, ISO_MAX_FILENAME_LENGTH))) {
-					found = true;
-				}
-			}
-			FreeDirIterator(dirIterator);
+		if (!IS_DIR(iso ? found->fileFlags : found->timeZone)) return false;
+
+		// remove the trailing dot if present
+		size_t nameLength = strlen(name);
+		if (nameLength > 0) {
+			if (name[nameLength - 1] == '.') name[nameLength - 1] = 0;
 		}
+
+		// look for the current path element
+		found = LookupCached(found, name);
 		if (!found) return false;
 	}
+	pathCache[key] = found;
+	*de = *found;
 	return true;
 }
 
+/* Reads a directory in full the first time it is searched, later lookups in it are served
+ * from its name index. Names are kept upcased, matching is case insensitive. */
+const isoDirEntry* isoDrive :: LookupCached(const isoDirEntry* dir, const char* name) {
+	DirCache*& cache = dirCache[EXTENT_LOCATION(*dir)];
+	if (!cache) {
+		cache = new DirCache;
+		isoDirEntry de;
+		int dirIterator = GetDirIterator(dir);
+		while (GetNextDirEntry(dirIterator, &de)) {
+			if (IS_ASSOC(FLAGS1)) continue;
+			cache->entries.push_back(de);
+		}
+		FreeDirIterator(dirIterator);
+		for (size_t i = 0; i < cache->entries.size(); i++) {
+			char ident[ISO_MAX_FILENAME_LENGTH + 1];
+			safe_strncpy(ident, (char*)cache->entries[i].ident, sizeof(ident));
+			upcase(ident);
+			// the first entry of a name wins, as with a linear search
+			cache->names.insert(std::make_pair(std::string(ident), i));
+		}
+	}
+	char ident[ISO_MAX_FILENAME_LENGTH + 1];
+	safe_strncpy(ident, name, sizeof(ident));
+	std::map<std::string, size_t>::iterator it = cache->names.find(ident);
+	if (it == cache->names.end()) return NULL;
+	return &cache->entries[it->second];
+}
+
+void isoDrive :: ClearCaches(void) {
+	pathCache.clear();
+	for (std::map<Bit32u, DirCache*>::iterator it = dirCache.begin(); it != dirCache.end(); ++it)
+		delete it->second;
+	dirCache.clear();
+	sectorCacheIndex.clear();
+	for (Bitu i = 0; i < ISO_SECTOR_CACHE_SIZE; i++) sectorCache[i].lastUse = 0;
+	for (Bitu i = 0; i < ISO_MAX_HASH_TABLE_SIZE; i++) sectorHashEntries[i].valid = false;
+}
+
 void IDE_ATAPI_MediaChangeNotify(unsigned char drive_index);
 
 void isoDrive :: MediaChange() {
@@ -646,6 +646,10 @@ bool localDrive::FindFirst(const char * _dir,DOS_DTA & dta,bool fcb_findfirst) {
 		return false;
 	}
 	strcpy(srchInfo[id].srch_dir,tempDir);
+	// expand the directory once, the entries found in it come with their long names
+	strcpy(srchInfo[id].expanded_dir,dirCache.GetExpandName(tempDir));
+	size_t expanded_len = strlen(srchInfo[id].expanded_dir);
+	if (expanded_len && srchInfo[id].expanded_dir[expanded_len-1]!=CROSS_FILESPLIT) strcat(srchInfo[id].expanded_dir,end);
 	dta.SetDirID(id);
 	
 	Bit8u sAttr;
@@ -685,6 +689,8 @@ char * shiftjis_upcase(char * str);
 bool localDrive::FindNext(DOS_DTA & dta) {
 
 	char * dir_ent;
+	const char * long_ent;
+	bool is_directory;
 	ht_stat_t stat_block;
 	char full_name[CROSS_LEN];
 	char dir_entcopy[CROSS_LEN];
@@ -696,26 +702,23 @@ bool localDrive::FindNext(DOS_DTA & dta) {
 	Bit16u id = dta.GetDirID();
 
 again:
-	if (!dirCache.FindNext(id,dir_ent)) {
+	if (!dirCache.FindNext(id,dir_ent,long_ent,is_directory)) {
 		DOS_SetError(DOSERR_NO_MORE_FILES);
 		return false;
 	}
 	if(!WildFileCmp(dir_ent,srch_pattern)) goto again;
+	// the cache knows directories, skip them without going to the host for details
+	if (is_directory && !(srch_attr & DOS_ATTR_DIRECTORY)) goto again;
 
-	strcpy(full_name,srchInfo[id].srch_dir);
-	strcat(full_name,dir_ent);
-	
-	//GetExpandName might indirectly destroy dir_ent (by caching in a new directory 
-	//and due to its design dir_ent might be lost.)
-	//Copying dir_ent first
 	strcpy(dir_entcopy,dir_ent);
 
-    char *temp_name = dirCache.GetExpandName(full_name);
+	strcpy(full_name,srchInfo[id].expanded_dir);
+	strcat(full_name,long_ent);
 
     // guest to host code page translation
-    host_cnv_char_t *host_name = CodePageGuestToHost(temp_name);
+    host_cnv_char_t *host_name = CodePageGuestToHost(full_name);
     if (host_name == NULL) {
-        LOG_MSG("%s: Filename '%s' from guest is non-representable on the host filesystem through code page conversion",__FUNCTION__,temp_name);
+        LOG_MSG("%s: Filename '%s' from guest is non-representable on the host filesystem through code page conversion",__FUNCTION__,full_name);
 		goto again;//No symlinks and such
     }
 
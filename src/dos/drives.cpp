@@ -24,6 +24,7 @@
 #include "mapper.h"
 #include "support.h"
 #include "control.h"
+#include "bios_disk.h"
 
 bool WildFileCmp(const char * file, const char * wild) 
 {
@@ -254,6 +255,10 @@ int DriveManager::UnmountDrive(int drive) {
 	return result;
 }
 
+static void DriveManager_DiskIOShutDown(Section* /*sec*/) {
+	DISKIO_Configure(false);
+}
+
 bool drivemanager_init = false;
 bool int13_extensions_enable = true;
 
@@ -263,6 +268,10 @@ void DriveManager::Init(Section* s) {
 	drivemanager_init = true;
 
 	int13_extensions_enable = section->Get_bool("int 13 extensions");
+	imageDiskCache_Configure((Bitu)section->Get_int("disk image cache size"),section->Get_bool("disk image read-ahead"));
+	imageDiskMapped_Configure(section->Get_bool("disk image mmap"));
+	DISKIO_Configure(section->Get_bool("disk image async io"));
+	AddExitFunction(AddExitFunctionFuncPair(DriveManager_DiskIOShutDown));
 	
 	// setup driveInfos structure
 	currentDrive = 0;
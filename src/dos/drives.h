@@ -21,6 +21,8 @@
 #define _DRIVES_H__
 
 #include <vector>
+#include <map>
+#include <string>
 #include <sys/types.h>
 #include "dos_system.h"
 #include "shell.h" /* for DOS_Shell */
@@ -89,6 +91,7 @@ protected:
 	friend void DOS_Shell::CMD_SUBST(char* args); 	
 	struct {
 		char srch_dir[CROSS_LEN];
+		char expanded_dir[CROSS_LEN];	/* srch_dir with the host's long names */
 	} srchInfo[MAX_OPENDIRS];
 
 	struct {
@@ -202,6 +205,24 @@ struct partTable {
 #endif
 //Forward
 class imageDisk;
+
+/* Cluster chain of one file or directory as runs of consecutive clusters, filled in lazily
+ * as far as the chain has been walked. Appending to the chain keeps it valid, anything that
+ * unlinks clusters bumps fatDrive::chainGeneration which throws the map away. */
+struct fatChainMap {
+	struct Extent {
+		Bit32u index;		/* cluster index within the chain */
+		Bit32u cluster;		/* first cluster of the run */
+		Bit32u count;
+	};
+	std::vector<Extent> extents;
+	Bit32u first;			/* start cluster the map was built for */
+	Bit32u generation;
+	size_t last;			/* extent hit by the previous lookup */
+
+	fatChainMap() : first(0), generation(0), last(0) { }
+};
+
 class fatDrive : public DOS_Drive {
 public:
 	fatDrive(const char * sysFilename, Bit32u bytesector, Bit32u cylsector, Bit32u headscyl, Bit32u cylinders, std::vector<std::string> &options);
@@ -227,10 +248,14 @@ public:
 public:
 	Bit8u readSector(Bit32u sectnum, void * data);
 	Bit8u writeSector(Bit32u sectnum, void * data);
-	Bit32u getAbsoluteSectFromBytePos(Bit32u startClustNum, Bit32u bytePos);
+	Bit8u readSectors(Bit32u sectnum, Bit32u count, void * data);
+	Bit8u writeSectors(Bit32u sectnum, Bit32u count, void * data);
+	Bit32u getAbsoluteSectFromBytePos(Bit32u startClustNum, Bit32u bytePos, fatChainMap *map=NULL);
 	Bit32u getSectorSize(void);
 	Bit32u getClusterSize(void);
-	Bit32u getAbsoluteSectFromChain(Bit32u startClustNum, Bit32u logicalSector);
+	Bit32u getAbsoluteSectFromChain(Bit32u startClustNum, Bit32u logicalSector, fatChainMap *map=NULL);
+	Bit32u getChainCluster(Bit32u startClustNum, Bit32u clustIndex, fatChainMap *map);
+	void flushFAT(void);
 	bool allocateCluster(Bit32u useCluster, Bit32u prevCluster);
 	Bit32u appendCluster(Bit32u startCluster);
 	void deleteClustChain(Bit32u startCluster, Bit32u bytePos);
@@ -242,6 +267,9 @@ public:
 private:
 	Bit32u getClusterValue(Bit32u clustNum);
 	void setClusterValue(Bit32u clustNum, Bit32u clustValue);
+	bool loadFAT(void);
+	void invalidateFAT(void);
+	void checkDiskWrites(void);
 	Bit32u getClustFirstSect(Bit32u clustNum);
 	bool FindNextInternal(Bit32u dirClustNumber, DOS_DTA & dta, direntry *foundEntry);
 	bool getDirClustNum(const char * dir, Bit32u * clustNum, bool parDir);
@@ -273,8 +301,15 @@ private:
 	Bit32u cwdDirCluster;
 	Bit32u dirPosition; /* Position in directory search */
 
-	Bit8u fatSectBuffer[SECTOR_SIZE_MAX * 2];
-	Bit32u curFatSect;
+	/* copy of the first FAT, loaded on first use. Changed sectors are written to every
+	 * FAT copy by flushFAT() at the end of each operation that modifies the chain. */
+	std::vector<Bit8u> fatCache;
+	std::vector<bool> fatCacheDirty;
+	bool fatCacheValid;
+	Bit32u diskWriteGeneration;	/* loadedDisk->write_generation the caches are current with */
+
+	Bit32u chainGeneration;
+	fatChainMap chainMap;	/* used for directories and when the caller has no map of its own */
 
 	DOS_Drive_Cache labelCache;
 public:
@@ -419,6 +454,7 @@ struct isoDirEntry {
 #define IS_DIR(fileFlags)	(fileFlags & ISO_DIRECTORY)
 #define IS_HIDDEN(fileFlags)	(fileFlags & ISO_HIDDEN)
 #define ISO_MAX_HASH_TABLE_SIZE 	100
+#define ISO_SECTOR_CACHE_SIZE		64
 
 class isoDrive : public DOS_Drive {
 public:
@@ -456,6 +492,8 @@ private:
 	bool GetNextDirEntry(const int dirIterator, isoDirEntry* de);
 	void FreeDirIterator(const int dirIterator);
 	bool ReadCachedSector(Bit8u** buffer, const Bit32u sector);
+	const isoDirEntry* LookupCached(const isoDirEntry* dir, const char* name);
+	void ClearCaches(void);
 	
 	struct DirIterator {
 		bool valid;
@@ -473,6 +511,24 @@ private:
 		Bit8u data[ISO_FRAMESIZE];
 	} sectorHashEntries[ISO_MAX_HASH_TABLE_SIZE];
 
+	/* Parsed directories, keyed by extent location, with their entries indexed by name */
+	struct DirCache {
+		std::vector<isoDirEntry> entries;
+		std::map<std::string, size_t> names;
+	};
+	std::map<Bit32u, DirCache*> dirCache;
+	/* Full paths resolved before, pointing into dirCache */
+	std::map<std::string, const isoDirEntry*> pathCache;
+
+	/* Least recently used file data sectors */
+	struct SectorCacheEntry {
+		Bit32u sector;
+		Bit32u lastUse;	/* 0 = unused */
+		Bit8u data[ISO_FRAMESIZE];
+	} sectorCache[ISO_SECTOR_CACHE_SIZE];
+	std::map<Bit32u, Bitu> sectorCacheIndex;
+	Bit32u sectorCacheClock;
+
 	bool iso;
 	bool dataCD;
 	isoDirEntry rootEntry;
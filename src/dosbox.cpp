@@ -85,11 +85,18 @@
 /*===================================TODO: Move to it's own file==============================*/
 #if defined(__SSE__) && !defined(_M_AMD64)
 bool sse2_available = false;
+# if defined(C_TARGET_SSSE3_AVX2)
+bool ssse3_available = false;
+bool avx2_available = false;
+# endif
 
 # ifdef __GNUC__
 #  define cpuid(func,ax,bx,cx,dx)\
 	__asm__ __volatile__ ("cpuid":\
 	"=a" (ax), "=b" (bx), "=c" (cx), "=d" (dx) : "a" (func));
+#  define cpuid_count(func,sub,ax,bx,cx,dx)\
+	__asm__ __volatile__ ("cpuid":\
+	"=a" (ax), "=b" (bx), "=c" (cx), "=d" (dx) : "a" (func), "c" (sub));
 # endif /* __GNUC__ */
 
 # if defined(_MSC_VER)
@@ -108,6 +115,19 @@ void CheckSSESupport()
 	Bitu a, b, c, d;
 	cpuid(1, a, b, c, d);
 	sse2_available = ((d >> 26) & 1)?true:false;
+# if defined(C_TARGET_SSSE3_AVX2)
+	ssse3_available = ((c >> 9) & 1)?true:false;
+	/* AVX2 also needs the OS to save the YMM registers (OSXSAVE, then XCR0 bits 1 and 2) */
+	if ((c >> 27) & 1) {
+		Bit32u xcr0_lo, xcr0_hi;
+		__asm__ __volatile__ (".byte 0x0f,0x01,0xd0" /* xgetbv */ : "=a" (xcr0_lo), "=d" (xcr0_hi) : "c" (0));
+		cpuid(0, a, b, c, d);
+		if ((xcr0_lo & 6) == 6 && a >= 7) {
+			cpuid_count(7, 0, a, b, c, d);
+			avx2_available = ((b >> 5) & 1)?true:false;
+		}
+	}
+# endif
 #endif
 }
 #endif
@@ -117,7 +137,6 @@ extern void			GFX_SetTitle(Bit32s cycles,Bits frameskip,Bits timing,bool paused)
 
 extern Bitu			frames;
 extern Bitu			cycle_count;
-extern bool			sse2_available;
 extern bool			dynamic_dos_kernel_alloc;
 extern Bitu			DOS_PRIVATE_SEGMENT_Size;
 extern bool			VGA_BIOS_dont_duplicate_CGA_first_half;
@@ -1552,6 +1571,16 @@ void DOSBOX_SetupConfigSections(void) {
 	Pbool->Set_help("This setting affects the VGA Line Compare register. Set to false (default value) to emulate most VGA behavior\n"
 			"Set to true for the value to latch once at the start of the frame.");
 
+	Pbool = secprop->Add_bool("batched scanline rendering",Property::Changeable::Always,false);
+	Pbool->Set_help("If set, EGA/VGA frames are drawn in one pass at the end of active display instead of one scanline at a time,\n"
+			"which reduces emulation overhead. Rendering automatically falls back to per-scanline timing for a while when the\n"
+			"DOS program writes CRTC, sequencer, miscellaneous output, attribute controller or DAC registers during active display\n"
+			"(raster effects).");
+
+	Pbool = secprop->Add_bool("skip unchanged scanlines",Property::Changeable::Always,true);
+	Pbool->Set_help("If set, EGA/VGA graphics scanlines are not redrawn when the video memory they show has not been written\n"
+			"and no palette or CRTC register has changed since the previous frame. Set to false if a game shows stale graphics.");
+
 	Pbool = secprop->Add_bool("ignore vblank wraparound",Property::Changeable::Always,false);
 	Pbool->Set_help("DOSBox-X can handle active display properly if games or demos reprogram vertical blanking to end in the active picture area.\n"
 			"If the wraparound handling prevents the game from displaying properly, set this to false. Out of bounds vblank values will be ignored.\n");
@@ -2667,6 +2696,19 @@ void DOSBOX_SetupConfigSections(void) {
 	Pbool = secprop->Add_bool("int 13 extensions",Property::Changeable::WhenIdle,true);
 	Pbool->Set_help("Enable INT 13h extensions (functions 0x40-0x48). You will need this enabled if the virtual hard drive image is 8.4GB or larger.");
 
+	Pint = secprop->Add_int("disk image cache size",Property::Changeable::WhenIdle,4096);
+	Pint->SetMinMax(0,262144);
+	Pint->Set_help("Size in KB of the block cache shared by raw disk images (INT 13h, FAT and IDE access). Set to 0 to disable.");
+
+	Pbool = secprop->Add_bool("disk image read-ahead",Property::Changeable::WhenIdle,true);
+	Pbool->Set_help("If set, sequential reads from raw disk images read the following block ahead into the disk image cache.");
+
+	Pbool = secprop->Add_bool("disk image mmap",Property::Changeable::WhenIdle,true);
+	Pbool->Set_help("If set, raw disk and floppy images are memory mapped instead of read through the disk image cache, where the host supports it.");
+
+	Pbool = secprop->Add_bool("disk image async io",Property::Changeable::OnlyAtStart,true);
+	Pbool->Set_help("If set, IDE and INT 13h disk image transfers run on a separate thread, so that slow host storage does not stall emulation.");
+
 	Pbool = secprop->Add_bool("biosps2",Property::Changeable::OnlyAtStart,true);
 	Pbool->Set_help("Emulate BIOS INT 15h PS/2 mouse services\n"
 		"Note that some OS's like Microsoft Windows neither use INT 33h nor\n"
@@ -2894,6 +2936,12 @@ void DOSBOX_SetupConfigSections(void) {
 				"In this way, you can have DOSBox emulate one of the strange quirks of 1995-1997 era\n"
 				"laptop hardware");
 
+		Pbool = secprop->Add_bool("busmaster dma",Property::Changeable::OnlyAtStart,false);
+		if (i == 0) Pbool->Set_help(
+				"If set, and the PCI bus is enabled, the primary and secondary IDE interfaces are\n"
+				"served by an emulated PCI bus master IDE controller (Intel PIIX) and hard disks\n"
+				"support READ/WRITE DMA. Has no effect on other IDE interfaces.");
+
 		Pint = secprop->Add_int("cd-rom spinup time",Property::Changeable::WhenIdle,0/*use IDE or CD-ROM default*/);
 		if (i == 0) Pint->Set_help("Emulated CD-ROM time in ms to spin up if CD is stationary.\n"
 				"Set to 0 to use controller or CD-ROM drive-specific default.");
@@ -118,16 +118,6 @@ void RENDER_SetPal(Bit8u entry,Bit8u red,Bit8u green,Bit8u blue) {
 static void RENDER_EmptyLineHandler(const void * src) {
 }
 
-/*HACK*/
-#if defined(__SSE__) && defined(_M_AMD64)
-# define sse2_available (1) /* SSE2 is always available on x86_64 */
-#else
-# ifdef __SSE__
-extern bool				sse2_available;
-# endif
-#endif
-/*END HACK*/
-
 static void RENDER_StartLineHandler(const void * s) {
 	if (s) {
 		const Bitu *src = (Bitu*)s;
@@ -165,6 +155,8 @@ static void RENDER_StartLineHandler(const void * s) {
 	return;
 cacheMiss:
 	if (!GFX_StartUpdate( render.scale.outWrite, render.scale.outPitch )) {
+		/* the cache no longer matches what is on screen, VGA may rely on it for unchanged lines */
+		render.scale.clearCache = true;
 		RENDER_DrawLine = RENDER_EmptyLineHandler;
 		return;
 	}
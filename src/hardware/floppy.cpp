@@ -768,6 +768,8 @@ void FloppyController::on_fdc_in_command() {
 					}
 
 					/* write sector */
+					DISKIO_Sync();
+					image->write_generation++;
 					Bit8u err = image->Write_Sector(in_cmd[3]/*head*/,in_cmd[2]/*cylinder*/,in_cmd[4]/*sector*/,sector,sector_size_bytes);
 					if (err != 0x00) {
 						fail = true;
@@ -873,6 +875,7 @@ void FloppyController::on_fdc_in_command() {
 				
 				while (!fail && !dma->tcount/*terminal count*/) {
 					/* read sector */
+					DISKIO_Sync();
 					Bit8u err = image->Read_Sector(in_cmd[3]/*head*/,in_cmd[2]/*cylinder*/,in_cmd[4]/*sector*/,sector,sector_size_bytes);
 					if (err != 0x00) {
 						fail = true;
@@ -21,6 +21,7 @@
 #include "control.h"
 #include "callback.h"
 #include "bios_disk.h"
+#include "pci_bus.h"
 #include "../src/dos/cdrom.h"
 
 #ifdef _MSC_VER
@@ -31,6 +32,12 @@
 
 static unsigned char init_ide = 0;
 
+/* how often a busy drive looks whether the disk I/O thread has finished its transfer.
+ * The first look comes soon, host reads are often served from the OS cache, then the
+ * interval doubles up to the maximum for as long as the transfer takes */
+#define IDE_DISKIO_POLL_MIN 0.05 /*ms*/
+#define IDE_DISKIO_POLL_MAX 1.0 /*ms*/
+
 static const unsigned char IDE_default_IRQs[4] = {
 	14,	/* primary */
 	15,	/* secondary */
@@ -60,7 +67,10 @@ static void ide_altio_w(Bitu port,Bitu val,Bitu iolen);
 static Bitu ide_altio_r(Bitu port,Bitu iolen);
 static void ide_baseio_w(Bitu port,Bitu val,Bitu iolen);
 static Bitu ide_baseio_r(Bitu port,Bitu iolen);
+static Bitu ide_baseio_readblock(Bitu port,void *dst,Bitu count,Bitu iolen);
+static Bitu ide_baseio_writeblock(Bitu port,const void *src,Bitu count,Bitu iolen);
 bool GetMSCDEXDrive(unsigned char drive_letter,CDROM_Interface **_cdrom);
+bool has_pcibus_enable(void);
 
 enum IDEDeviceType {
 	IDE_TYPE_NONE,
@@ -87,6 +97,16 @@ enum {
 	IDE_STATUS_ERROR=0x01
 };
 
+enum {
+	IDE_BM_CMD_START=0x01,
+	IDE_BM_CMD_TO_MEMORY=0x08,	/* bus master writes to memory (device READ DMA) */
+
+	IDE_BM_STATUS_ACTIVE=0x01,
+	IDE_BM_STATUS_ERROR=0x02,
+	IDE_BM_STATUS_INTERRUPT=0x04,
+	IDE_BM_STATUS_DRIVE_DMA=0x60	/* drive 0/1 DMA capable, set by BIOS or driver */
+};
+
 class IDEController;
 
 static inline bool drivehead_is_lba48(uint8_t val) {
@@ -150,6 +170,8 @@ public:
 	virtual void writecommand(uint8_t cmd);
 	virtual Bitu data_read(Bitu iolen);	/* read from 1F0h data port from IDE device */
 	virtual void data_write(Bitu v,Bitu iolen);/* write to 1F0h data port to IDE device */
+	virtual Bitu data_read_block(unsigned char *dst,Bitu count,Bitu iolen);	/* REP INS from the data port, 0 if not possible */
+	virtual Bitu data_write_block(const unsigned char *src,Bitu count,Bitu iolen);/* REP OUTS to the data port, 0 if not possible */
 	virtual bool command_interruption_ok(uint8_t cmd);
 	virtual void abort_silent();
 };
@@ -168,13 +190,26 @@ public:
 	void update_from_biosdisk();
 	virtual Bitu data_read(Bitu iolen);	/* read from 1F0h data port from IDE device */
 	virtual void data_write(Bitu v,Bitu iolen);/* write to 1F0h data port to IDE device */
+	virtual Bitu data_read_block(unsigned char *dst,Bitu count,Bitu iolen);
+	virtual Bitu data_write_block(const unsigned char *src,Bitu count,Bitu iolen);
 	virtual void generate_identify_device();
 	virtual void prepare_read(Bitu offset,Bitu size);
 	virtual void prepare_write(Bitu offset,Bitu size);
 	virtual void io_completion();
 	virtual bool increment_current_address(Bitu count=1);
+	virtual void dma_transfer();
+	void dma_continue();
+	bool get_current_sector(uint32_t &sectorn);
+	bool disk_io(imageDisk *disk,uint32_t sectorn,Bitu n,bool write);
+	void disk_io_cancel();
 public:
 	Bitu multiple_sector_max,multiple_sector_count;
+	uint8_t transfer_mode;		/* mode chosen by SET FEATURES 03h, 0 if never set */
+	bool dma_pending;		/* READ/WRITE DMA waiting for the bus master to start */
+	uint32_t dma_sectorn;		/* next sector of the DMA transfer in progress */
+	Bitu dma_left,dma_total;	/* sectors left and in total, dma_left != 0 while in progress */
+	DiskIORequest disk_req;		/* sector[] transfer on the disk I/O thread */
+	double disk_poll_delay;		/* ms until IDE_DelayedCommand looks at disk_req again */
 	Bitu heads,sects,cyls,headshr,progress_count;
 	Bitu phys_heads,phys_sects,phys_cyls;
 	unsigned char sector[512*128];
@@ -205,6 +240,7 @@ public:
 	void update_from_cdrom();
 	virtual Bitu data_read(Bitu iolen);	/* read from 1F0h data port from IDE device */
 	virtual void data_write(Bitu v,Bitu iolen);/* write to 1F0h data port to IDE device */
+	virtual Bitu data_read_block(unsigned char *dst,Bitu count,Bitu iolen);
 	virtual void generate_identify_device();
 	virtual void generate_mmc_inquiry();
 	virtual void prepare_read(Bitu offset,Bitu size);
@@ -266,12 +302,21 @@ public:
 	double spinup_time;
 	double spindown_timeout;
 	double cd_insertion_time;
+	/* PCI bus master DMA (primary and secondary interface only) */
+	bool busmaster_dma;
+	uint8_t bm_command,bm_status;	/* bus master command (+0h) and status (+2h) registers */
+	uint32_t bm_prd;		/* physical address of the PRD table (+4h) */
+	uint32_t bm_prd_cur;		/* next PRD entry to fetch */
+	uint32_t bm_seg_addr,bm_seg_left;/* memory region described by the current PRD entry */
+	bool bm_eot;			/* current PRD entry is the last one */
 public:
 	IDEController(Section* configuration,unsigned char index);
     void register_isapnp();
 	void install_io_port();
 	void raise_irq();
 	void lower_irq();
+	void busmaster_begin();
+	bool busmaster_xfer(unsigned char *buf,Bitu len,bool to_memory);
 	~IDEController();
 };
 
@@ -280,6 +325,12 @@ static IDEController* idecontroller[MAX_IDE_CONTROLLERS]={NULL,NULL,NULL,NULL,NU
 static void IDE_DelayedCommand(Bitu idx/*which IDE controller*/);
 static IDEController* GetIDEController(Bitu idx);
 
+/* PCI bus master registers, decoded through BAR4 of the PCI IDE device (see pci_bus.cpp) */
+static Bitu ide_busmaster_base = 0;
+static bool ide_busmaster_enable = false;	/* PCI command register bus master enable */
+static IO_ReadHandleObject ide_busmaster_rh;
+static IO_WriteHandleObject ide_busmaster_wh;
+
 static void IDE_ATAPI_SpinDown(Bitu idx/*which IDE controller*/) {
 	IDEController *ctrl = GetIDEController(idx);
 	if (ctrl == NULL) return;
@@ -1430,6 +1481,176 @@ void IDEATADevice::io_completion() {
 	}
 }
 
+/* current sector address from the LBA or C/H/S registers, false if out of range */
+bool IDEATADevice::get_current_sector(uint32_t &sectorn) {
+	if (drivehead_is_lba(drivehead)) {
+		/* LBA */
+		sectorn = ((drivehead & 0xF) << 24) | lba[0] |
+			(lba[1] << 8) |
+			(lba[2] << 16);
+	}
+	else {
+		/* C/H/S */
+		if (lba[0] == 0) {
+			LOG_MSG("WARNING C/H/S access mode and sector==0\n");
+			return false;
+		}
+		else if ((unsigned int)(drivehead & 0xF) >= (unsigned int)heads ||
+			(unsigned int)lba[0] > (unsigned int)sects ||
+			(unsigned int)(lba[1] | (lba[2] << 8)) >= (unsigned int)cyls) {
+			LOG_MSG("C/H/S %u/%u/%u out of bounds %u/%u/%u\n",
+				(unsigned int)(lba[1] | (lba[2] << 8)),
+				(unsigned int)(drivehead&0xF),
+				(unsigned int)lba[0],
+				(unsigned int)cyls,
+				(unsigned int)heads,
+				(unsigned int)sects);
+			return false;
+		}
+
+		sectorn = ((drivehead & 0xF) * sects) +
+			((lba[1] | (lba[2] << 8)) * sects * heads) +
+			(lba[0] - 1);
+	}
+
+	return true;
+}
+
+static void IDE_BusMasterError(IDEATADevice *ata) {
+	ata->abort_error();
+	ata->controller->bm_status &= ~IDE_BM_STATUS_ACTIVE;
+	ata->controller->bm_status |= IDE_BM_STATUS_ERROR|IDE_BM_STATUS_INTERRUPT;
+	ata->controller->raise_irq();
+}
+
+/* Start or poll the disk transfer for the current command, to or from sector[]. While the
+ * disk I/O thread is still at it this returns false with the drive busy and IDE_DelayedCommand
+ * scheduled to look again, so the command is simply re-entered until the data is there. */
+bool IDEATADevice::disk_io(imageDisk *disk,uint32_t sectorn,Bitu n,bool write) {
+	if (!disk_req.busy) {
+		disk_req.disk = disk;
+		disk_req.data = sector;
+		disk_req.write = write;
+		disk_req.sectnum = sectorn;
+		disk_req.count = (Bit32u)n;
+		DISKIO_Submit(&disk_req);
+		disk_poll_delay = IDE_DISKIO_POLL_MIN;
+	}
+
+	if (!DISKIO_Complete(&disk_req)) {
+		state = IDE_DEV_BUSY;
+		status = IDE_STATUS_BUSY;
+		PIC_AddEvent(IDE_DelayedCommand,disk_poll_delay,controller->interface_index);
+		disk_poll_delay = std::min(disk_poll_delay * 2,IDE_DISKIO_POLL_MAX);
+		return false;
+	}
+
+	return true;
+}
+
+/* forget the transfer of an interrupted command, once the I/O thread is done with sector[] */
+void IDEATADevice::disk_io_cancel() {
+	DISKIO_Wait(&disk_req);
+	dma_left = 0;
+}
+
+/* READ/WRITE DMA: move the whole transfer between the disk and the memory described
+ * by the bus master PRD table, then signal completion with one IRQ */
+void IDEATADevice::dma_transfer() {
+	const bool to_memory = (command == 0xC8 || command == 0xC9);
+
+	if (getBIOSdisk() == NULL) {
+		LOG_MSG("ATA DMA fail, bios disk N/A\n");
+		IDE_BusMasterError(this);
+		return;
+	}
+
+	if (!get_current_sector(dma_sectorn)) {
+		IDE_BusMasterError(this);
+		return;
+	}
+
+	if (to_memory != ((controller->bm_command & IDE_BM_CMD_TO_MEMORY) != 0)) {
+		LOG_MSG("ATA DMA direction does not match bus master direction\n");
+		IDE_BusMasterError(this);
+		return;
+	}
+
+	dma_total = dma_left = (count & 0xFF) == 0 ? 256 : (count & 0xFF);
+	controller->busmaster_begin();
+	dma_continue();
+}
+
+/* transfer what is left of the DMA command, in chunks of sector[]. Returns early while a
+ * chunk is on the disk I/O thread and is called again from IDE_DelayedCommand. */
+void IDEATADevice::dma_continue() {
+	const bool to_memory = (command == 0xC8 || command == 0xC9);
+	imageDisk *disk;
+	Bitu n;
+
+	while (dma_left != 0) {
+		n = MIN(dma_left,(Bitu)(sizeof(sector) / 512));
+
+		disk = getBIOSdisk();
+		if (disk == NULL || !(controller->bm_command & IDE_BM_CMD_START)) {
+			LOG_MSG("ATA DMA aborted, %s\n",disk == NULL ? "bios disk N/A" : "bus master stopped");
+			disk_io_cancel();
+			IDE_BusMasterError(this);
+			return;
+		}
+
+		if (!to_memory && !disk_req.busy) {
+			if (!controller->busmaster_xfer(sector,n*512,false)) {
+				LOG_MSG("ATA DMA PRD table smaller than transfer\n");
+				dma_left = 0;
+				IDE_BusMasterError(this);
+				return;
+			}
+		}
+
+		if (!disk_io(disk,dma_sectorn,n,!to_memory))
+			return;
+
+		if (disk_req.result != 0) {
+			LOG_MSG(to_memory ? "ATA read failed\n" : "Failed to write sector\n");
+			dma_left = 0;
+			IDE_BusMasterError(this);
+			return;
+		}
+
+		if (to_memory) {
+			if (!controller->busmaster_xfer(sector,n*512,true)) {
+				LOG_MSG("ATA DMA PRD table smaller than transfer\n");
+				dma_left = 0;
+				IDE_BusMasterError(this);
+				return;
+			}
+		}
+
+		dma_sectorn += (uint32_t)n;
+		dma_left -= n;
+		progress_count += n;
+	}
+
+	/* leave the address registers on the last sector transferred, as the PIO commands do */
+	if (dma_total > 1 && !increment_current_address(dma_total - 1)) {
+		LOG_MSG("DMA advance error\n");
+		IDE_BusMasterError(this);
+		return;
+	}
+
+	count = 0;
+	status = IDE_STATUS_DRIVE_READY|IDE_STATUS_DRIVE_SEEK_COMPLETE;
+	state = IDE_DEV_READY;
+	allow_writing = true;
+
+	/* a PRD table larger than the transfer leaves the bus master active */
+	if (controller->bm_eot && controller->bm_seg_left == 0)
+		controller->bm_status &= ~IDE_BM_STATUS_ACTIVE;
+	controller->bm_status |= IDE_BM_STATUS_INTERRUPT;
+	controller->raise_irq();
+}
+
 Bitu IDEATAPICDROMDevice::data_read(Bitu iolen) {
 	Bitu w = ~0;
 
@@ -1463,6 +1684,24 @@ Bitu IDEATAPICDROMDevice::data_read(Bitu iolen) {
 	return w;
 }
 
+/* same as data_read() count times, stopping at the end of the buffer */
+Bitu IDEATAPICDROMDevice::data_read_block(unsigned char *dst,Bitu count,Bitu iolen) {
+	if (state != IDE_DEV_DATA_READ || !(status & IDE_STATUS_DRQ) || sector_i >= sector_total)
+		return 0;
+
+	Bitu n = (sector_total - sector_i) / iolen;
+	if (n > count) n = count;
+	if (n == 0) return 0;
+
+	memcpy(dst,sector+sector_i,n*iolen);
+	sector_i += n*iolen;
+
+	if (sector_i >= sector_total)
+		io_completion();
+
+	return n;
+}
+
 /* TODO: Your code should also be paying attention to the "transfer length" field
          in many of the commands here. Right now it doesn't matter. */
 void IDEATAPICDROMDevice::atapi_cmd_completion() {
@@ -1798,6 +2037,41 @@ void IDEATADevice::data_write(Bitu v,Bitu iolen) {
 	if (sector_i >= sector_total)
 		io_completion();
 }
+
+/* same as data_read()/data_write() count times, stopping at the end of the sector buffer */
+Bitu IDEATADevice::data_read_block(unsigned char *dst,Bitu count,Bitu iolen) {
+	if (state != IDE_DEV_DATA_READ || !(status & IDE_STATUS_DRQ) || sector_i >= sector_total)
+		return 0;
+
+	Bitu n = (sector_total - sector_i) / iolen;
+	if (n > count) n = count;
+	if (n == 0) return 0;
+
+	memcpy(dst,sector+sector_i,n*iolen);
+	sector_i += n*iolen;
+
+	if (sector_i >= sector_total)
+		io_completion();
+
+	return n;
+}
+
+Bitu IDEATADevice::data_write_block(const unsigned char *src,Bitu count,Bitu iolen) {
+	if (state != IDE_DEV_DATA_WRITE || !(status & IDE_STATUS_DRQ) || sector_i >= sector_total)
+		return 0;
+
+	Bitu n = (sector_total - sector_i) / iolen;
+	if (n > count) n = count;
+	if (n == 0) return 0;
+
+	memcpy(sector+sector_i,src,n*iolen);
+	sector_i += n*iolen;
+
+	if (sector_i >= sector_total)
+		io_completion();
+
+	return n;
+}
 		
 void IDEATAPICDROMDevice::prepare_read(Bitu offset,Bitu size) {
 	/* I/O must be WORD ALIGNED */
@@ -1969,11 +2243,12 @@ void IDEATADevice::generate_identify_device() {
 		host_writew(sector+(47*2),0x80|multiple_sector_max); /* <- READ/WRITE MULTIPLE MAX SECTORS */
 
 	host_writew(sector+(48*2),0x0000);	/* :0  0=we do not support doubleword (32-bit) PIO */
-	host_writew(sector+(49*2),0x0A00);	/* :13 0=Standby timer values managed by device */
+	host_writew(sector+(49*2),controller->busmaster_dma ? 0x0B00 : 0x0A00);
+						/* :13 0=Standby timer values managed by device */
 						/* :11 1=IORDY supported */
 						/* :10 0=IORDY not disabled */
 						/* :9  1=LBA supported */
-						/* :8  0=DMA not supported */
+						/* :8  1=DMA supported (only with PCI bus master) */
 	host_writew(sector+(50*2),0x4000);	/* FIXME: ??? */
 	host_writew(sector+(51*2),0x00F0);	/* PIO data transfer cycle timing mode */
 	host_writew(sector+(52*2),0x00F0);	/* DMA data transfer cycle timing mode */
@@ -1991,8 +2266,13 @@ void IDEATADevice::generate_identify_device() {
 
 	host_writed(sector+(60*2),ptotal);	/* total user addressable sectors (LBA) */
 	host_writew(sector+(62*2),0x0000);	/* FIXME: ??? */
-	host_writew(sector+(63*2),0x0000);	/* :10 0=Multiword DMA mode 2 not selected */
-						/* TODO: Basically, we don't do DMA. Fill out this comment */
+	if (controller->busmaster_dma) {
+		/* 10:8 Multiword DMA mode selected, 2:0 Multiword DMA modes 0-2 supported */
+		host_writew(sector+(63*2),0x0007 | ((transfer_mode & 0xF8) == 0x20 ? (0x100 << (transfer_mode & 7)) : 0));
+	}
+	else {
+		host_writew(sector+(63*2),0x0000);	/* no DMA */
+	}
 	host_writew(sector+(64*2),0x0003);	/* 7:0 PIO modes supported (FIXME ???) */
 	host_writew(sector+(65*2),0x0000);	/* FIXME: ??? */
 	host_writew(sector+(66*2),0x0000);	/* FIXME: ??? */
@@ -2006,7 +2286,13 @@ void IDEATADevice::generate_identify_device() {
 	host_writew(sector+(85*2),0x4208);	/* commands in 82 enabled */
 	host_writew(sector+(86*2),0x4000);	/* commands in 83 enabled */
 	host_writew(sector+(87*2),0x4000);	/* FIXME: ??? */
-	host_writew(sector+(88*2),0x0000);	/* FIXME: ??? */
+	if (controller->busmaster_dma) {
+		/* 14:8 Ultra DMA mode selected, 2:0 Ultra DMA modes 0-2 supported */
+		host_writew(sector+(88*2),0x0007 | ((transfer_mode & 0xF8) == 0x40 ? (0x100 << (transfer_mode & 7)) : 0));
+	}
+	else {
+		host_writew(sector+(88*2),0x0000);	/* FIXME: ??? */
+	}
 	host_writew(sector+(93*3),0x0000);	/* FIXME: ??? */
 
 	/* ATA-8 integrity checksum */
@@ -2027,9 +2313,15 @@ IDEATADevice::IDEATADevice(IDEController *c,unsigned char bios_disk_index) : IDE
 	multiple_sector_max = sizeof(sector) / 512;
 	multiple_sector_count = 1;
 	geo_translate = false;
+	transfer_mode = 0;
+	dma_pending = false;
+	dma_sectorn = 0;
+	dma_left = dma_total = 0;
+	disk_poll_delay = IDE_DISKIO_POLL_MIN;
 }
 
 IDEATADevice::~IDEATADevice() {
+	disk_io_cancel();
 }
 
 imageDisk *IDEATADevice::getBIOSdisk() {
@@ -2707,7 +2999,9 @@ static void IDE_DelayedCommand(Bitu idx/*which IDE controller*/) {
 						(ata->lba[0] - 1);
 				}
 
-				if (disk->Write_AbsoluteSector(sectorn, ata->sector) != 0) {
+				if (!ata->disk_io(disk,sectorn,1,true))
+					return;
+				if (ata->disk_req.result != 0) {
 					LOG_MSG("Failed to write sector\n");
 					ata->abort_error();
 					dev->controller->raise_irq();
@@ -2789,7 +3083,9 @@ static void IDE_DelayedCommand(Bitu idx/*which IDE controller*/) {
 						(ata->lba[0] - 1);
 				}
 
-				if (disk->Read_AbsoluteSector(sectorn, ata->sector) != 0) {
+				if (!ata->disk_io(disk,sectorn,1,false))
+					return;
+				if (ata->disk_req.result != 0) {
 					LOG_MSG("ATA read failed\n");
 					ata->abort_error();
 					dev->controller->raise_irq();
@@ -2853,7 +3149,9 @@ static void IDE_DelayedCommand(Bitu idx/*which IDE controller*/) {
 						(ata->lba[0] - 1);
 				}
 
-				if (disk->Read_AbsoluteSector(sectorn, ata->sector) != 0) {
+				if (!ata->disk_io(disk,sectorn,1,false))
+					return;
+				if (ata->disk_req.result != 0) {
 					LOG_MSG("ATA read failed\n");
 					ata->abort_error();
 					dev->controller->raise_irq();
@@ -2932,14 +3230,13 @@ static void IDE_DelayedCommand(Bitu idx/*which IDE controller*/) {
 				if ((512*ata->multiple_sector_count) > sizeof(ata->sector))
 					E_Exit("SECTOR OVERFLOW");
 
-				for (unsigned int cc=0;cc < MIN((Bitu)ata->multiple_sector_count,(Bitu)sectcount);cc++) {
-					/* it would be great if the disk object had a "read multiple sectors" member function */
-					if (disk->Read_AbsoluteSector(sectorn+cc, ata->sector+(cc*512)) != 0) {
-						LOG_MSG("ATA read failed\n");
-						ata->abort_error();
-						dev->controller->raise_irq();
-						return;
-					}
+				if (!ata->disk_io(disk,sectorn,MIN((Bitu)ata->multiple_sector_count,(Bitu)sectcount),false))
+					return;
+				if (ata->disk_req.result != 0) {
+					LOG_MSG("ATA read failed\n");
+					ata->abort_error();
+					dev->controller->raise_irq();
+					return;
 				}
 
 				/* NTS: the way this command works is that the drive reads ONE sector, then fires the IRQ
@@ -2998,14 +3295,13 @@ static void IDE_DelayedCommand(Bitu idx/*which IDE controller*/) {
 						(ata->lba[0] - 1);
 				}
 
-				for (unsigned int cc=0;cc < MIN((Bitu)ata->multiple_sector_count,(Bitu)sectcount);cc++) {
-					/* it would be great if the disk object had a "write multiple sectors" member function */
-					if (disk->Write_AbsoluteSector(sectorn+cc, ata->sector+(cc*512)) != 0) {
-						LOG_MSG("Failed to write sector\n");
-						ata->abort_error();
-						dev->controller->raise_irq();
-						return;
-					}
+				if (!ata->disk_io(disk,sectorn,MIN((Bitu)ata->multiple_sector_count,(Bitu)sectcount),true))
+					return;
+				if (ata->disk_req.result != 0) {
+					LOG_MSG("Failed to write sector\n");
+					ata->abort_error();
+					dev->controller->raise_irq();
+					return;
 				}
 
 				for (unsigned int cc=0;cc < MIN((Bitu)ata->multiple_sector_count,(Bitu)sectcount);cc++) {
@@ -3038,6 +3334,27 @@ static void IDE_DelayedCommand(Bitu idx/*which IDE controller*/) {
 				dev->controller->raise_irq();
 				break;
 
+			case 0xC8:/* READ DMA */
+			case 0xC9:/* READ DMA WITHOUT RETRY */
+			case 0xCA:/* WRITE DMA */
+			case 0xCB:/* WRITE DMA WITHOUT RETRY */
+				if (ata->dma_left != 0) {
+					/* a chunk of the transfer came back from the disk I/O thread */
+					ata->dma_continue();
+					break;
+				}
+				if (!(dev->controller->bm_command & IDE_BM_CMD_START) || !ide_busmaster_enable) {
+					/* the transfer starts when the host starts the bus master. DMA commands
+					 * never assert DRQ, the drive stays busy until then */
+					ata->dma_pending = true;
+					dev->status = IDE_STATUS_BUSY;
+					break;
+				}
+
+				ata->dma_pending = false;
+				ata->dma_transfer();
+				break;
+
 			case 0xEC:/*IDENTIFY DEVICE (CONTINUED) */
 				dev->state = IDE_DEV_DATA_READ;
 				dev->status = IDE_STATUS_DRQ|IDE_STATUS_DRIVE_READY|IDE_STATUS_DRIVE_SEEK_COMPLETE;
@@ -3152,6 +3469,14 @@ Bitu IDEDevice::data_read(Bitu iolen) {
 void IDEDevice::data_write(Bitu v,Bitu iolen) {
 }
 
+Bitu IDEDevice::data_read_block(unsigned char *dst,Bitu count,Bitu iolen) {
+	return 0;
+}
+
+Bitu IDEDevice::data_write_block(const unsigned char *src,Bitu count,Bitu iolen) {
+	return 0;
+}
+
 IDEDevice::IDEDevice(IDEController *c) {
 	type = IDE_TYPE_NONE;
 	status = 0x00;
@@ -3369,7 +3694,9 @@ void IDEATADevice::writecommand(uint8_t cmd) {
 	/* FIXME: OAKCDROM.SYS is sending the hard disk command 0xA0 (ATAPI packet) for some reason. Why? */
 
 	/* drive is ready to accept command */
+	disk_io_cancel();
 	allow_writing = false;
+	dma_pending = false;
 	command = cmd;
 	switch (cmd) {
 		case 0x00: /* NOP */
@@ -3467,6 +3794,26 @@ void IDEATADevice::writecommand(uint8_t cmd) {
 			status = IDE_STATUS_DRIVE_READY|IDE_STATUS_DRQ;
 			prepare_write(0UL,512UL*MIN((unsigned long)multiple_sector_count,(unsigned long)(count == 0 ? 256 : count)));
 			break;
+		case 0xC8: /* READ DMA */
+		case 0xC9: /* READ DMA WITHOUT RETRY */
+		case 0xCA: /* WRITE DMA */
+		case 0xCB: /* WRITE DMA WITHOUT RETRY */
+			/* NTS: READ/WRITE DMA EXT (25h/35h) are not implemented, they need the LBA48
+			 *      register pairs this emulation does not have yet. IDENTIFY does not
+			 *      advertise LBA48, so they end up in the "unknown command" abort below. */
+			if (!controller->busmaster_dma) {
+				LOG_MSG("IDE: DMA command %02X without PCI bus master\n",cmd);
+				abort_error();
+				allow_writing = true;
+				controller->raise_irq();
+				break;
+			}
+			/* the transfer happens once the host has also started the bus master */
+			progress_count = 0;
+			state = IDE_DEV_BUSY;
+			status = IDE_STATUS_BUSY;
+			PIC_AddEvent(IDE_DelayedCommand,(faked_command ? 0.000001 : 0.1)/*ms*/,controller->interface_index);
+			break;
 		case 0xC6: /* SET MULTIPLE MODE */
 			/* only sector counts 1, 2, 4, 8, 16, 32, 64, and 128 are legal by standard.
 			 * NTS: There's a bug in VirtualBox that makes 0 legal too! */
@@ -3507,6 +3854,20 @@ void IDEATADevice::writecommand(uint8_t cmd) {
 			status = IDE_STATUS_BUSY;
 			PIC_AddEvent(IDE_DelayedCommand,(faked_command ? 0.000001 : ide_identify_command_delay),controller->interface_index);
 			break;
+		case 0xEF: /* SET FEATURES */
+			/* only "set transfer mode" is supported. PIO modes are always accepted,
+			 * Multiword and Ultra DMA modes 0-2 only if there is a PCI bus master */
+			if ((feature&0xFF) == 0x03 && ((count&0xF8) == 0x00 || (count&0xF8) == 0x08 ||
+				(controller->busmaster_dma && ((count&0xF8) == 0x20 || (count&0xF8) == 0x40) && (count&7) <= 2))) {
+				transfer_mode = count&0xFF;
+				status = IDE_STATUS_DRIVE_READY|IDE_STATUS_DRIVE_SEEK_COMPLETE;
+			}
+			else {
+				abort_error();
+			}
+			controller->raise_irq();
+			allow_writing = true;
+			break;
 		default:
 			LOG_MSG("Unknown IDE/ATA command %02X\n",cmd);
 			abort_error();
@@ -3543,6 +3904,14 @@ IDEController::IDEController(Section* configuration,unsigned char index):Module_
 	spindown_timeout = section->Get_int("cd-rom spindown timeout");
 	cd_insertion_time = section->Get_int("cd-rom insertion delay");
 
+	/* the PCI bus master only serves the two compatibility mode interfaces */
+	busmaster_dma = section->Get_bool("busmaster dma") && index < 2 && !IS_PC98_ARCH && has_pcibus_enable();
+	bm_command = 0;
+	bm_status = 0;
+	bm_prd = bm_prd_cur = 0;
+	bm_seg_addr = bm_seg_left = 0;
+	bm_eot = false;
+
 	status = 0x00;
 	host_reset = false;
 	irq_pending = false;
@@ -3657,6 +4026,9 @@ void IDEController::install_io_port(){
 			WriteHandler[i].Install(base_io+i,ide_baseio_w,IO_MA);
 			ReadHandler[i].Install(base_io+i,ide_baseio_r,IO_MA);
 		}
+
+		IO_RegisterReadBlockHandler(base_io,ide_baseio_r,ide_baseio_readblock);
+		IO_RegisterWriteBlockHandler(base_io,ide_baseio_w,ide_baseio_writeblock);
 	}
 
 	if (alt_io != 0) {
@@ -3678,6 +4050,11 @@ void IDEController::install_io_port(){
 IDEController::~IDEController() {
 	unsigned int i;
 
+	if (base_io != 0 && !IS_PC98_ARCH) {
+		IO_FreeReadBlockHandler(base_io);
+		IO_FreeWriteBlockHandler(base_io);
+	}
+
 	for (i=0;i < 2;i++) {
 		if (device[i] != NULL) {
 			delete device[i];
@@ -3686,6 +4063,131 @@ IDEController::~IDEController() {
 	}
 }
 
+void IDEController::busmaster_begin() {
+	bm_prd_cur = bm_prd;
+	bm_seg_addr = bm_seg_left = 0;
+	bm_eot = false;
+}
+
+/* move len bytes between buf and the memory described by the PRD table.
+ * returns false if the table ends before len bytes were moved. */
+bool IDEController::busmaster_xfer(unsigned char *buf,Bitu len,bool to_memory) {
+	while (len != 0) {
+		if (bm_seg_left == 0) {
+			unsigned char prd[8];
+
+			if (bm_eot) return false;
+
+			/* PRD entry: physical base address, byte count (0 = 64KB), bit 31 end of table */
+			MEM_PhysBlockRead(bm_prd_cur,prd,8);
+			bm_seg_addr = host_readd(prd+0) & ~1u;
+			bm_seg_left = host_readw(prd+4) & ~1u;
+			if (bm_seg_left == 0) bm_seg_left = 0x10000;
+			bm_eot = (prd[7] & 0x80) != 0;
+			bm_prd_cur += 8;
+		}
+
+		const Bitu n = MIN(len,(Bitu)bm_seg_left);
+		if (to_memory)
+			MEM_PhysBlockWrite(bm_seg_addr,buf,n);
+		else
+			MEM_PhysBlockRead(bm_seg_addr,buf,n);
+
+		buf += n;
+		len -= n;
+		bm_seg_addr += (uint32_t)n;
+		bm_seg_left -= (uint32_t)n;
+	}
+
+	return true;
+}
+
+static IDEController *ide_busmaster_controller(Bitu port) {
+	IDEController *ide = GetIDEController((port - ide_busmaster_base) >> 3);
+	if (ide == NULL || !ide->busmaster_dma) return NULL;
+	return ide;
+}
+
+static Bitu ide_busmaster_r(Bitu port,Bitu iolen) {
+	if (iolen == 4) return ide_busmaster_r(port,2) | (ide_busmaster_r(port+2,2) << 16);
+	if (iolen == 2) return ide_busmaster_r(port,1) | (ide_busmaster_r(port+1,1) << 8);
+
+	IDEController *ide = ide_busmaster_controller(port);
+	if (ide == NULL) return 0xFF;
+
+	switch (port & 7) {
+		case 0: return ide->bm_command;
+		case 2: return ide->bm_status;
+		case 4: case 5: case 6: case 7:
+			return (ide->bm_prd >> ((port & 3) * 8)) & 0xFF;
+		default:
+			break;
+	}
+
+	return 0x00;
+}
+
+static void ide_busmaster_w(Bitu port,Bitu val,Bitu iolen) {
+	if (iolen == 4) {
+		ide_busmaster_w(port,val&0xFFFF,2);
+		ide_busmaster_w(port+2,(val>>16)&0xFFFF,2);
+		return;
+	}
+	if (iolen == 2) {
+		ide_busmaster_w(port,val&0xFF,1);
+		ide_busmaster_w(port+1,(val>>8)&0xFF,1);
+		return;
+	}
+
+	IDEController *ide = ide_busmaster_controller(port);
+	if (ide == NULL) return;
+
+	switch (port & 7) {
+		case 0: { /* command */
+			const bool was_started = (ide->bm_command & IDE_BM_CMD_START) != 0;
+			ide->bm_command = val & (IDE_BM_CMD_START|IDE_BM_CMD_TO_MEMORY);
+			if (!(val & IDE_BM_CMD_START)) {
+				/* stopping the bus master aborts whatever is left of the transfer */
+				ide->bm_status &= ~IDE_BM_STATUS_ACTIVE;
+			}
+			else if (!was_started) {
+				ide->bm_status |= IDE_BM_STATUS_ACTIVE;
+
+				/* a DMA command may already be waiting for us */
+				IDEDevice *dev = GetIDESelectedDevice(ide);
+				if (dev != NULL && dev->type == IDE_TYPE_HDD && dev->state == IDE_DEV_BUSY && ((IDEATADevice*)dev)->dma_pending)
+					PIC_AddEvent(IDE_DelayedCommand,0.00001/*ms*/,ide->interface_index);
+			}
+			} break;
+		case 2: /* status: drive DMA capable bits are R/W, error and interrupt are write 1 to clear */
+			ide->bm_status = (ide->bm_status & ~IDE_BM_STATUS_DRIVE_DMA) | (val & IDE_BM_STATUS_DRIVE_DMA);
+			ide->bm_status &= ~(val & (IDE_BM_STATUS_ERROR|IDE_BM_STATUS_INTERRUPT));
+			break;
+		case 4: case 5: case 6: case 7: { /* PRD table address, dword aligned */
+			const unsigned int shf = (port & 3) * 8;
+			ide->bm_prd = (ide->bm_prd & ~(0xFFu << shf)) | ((uint32_t)(val & 0xFF) << shf);
+			ide->bm_prd &= ~3u;
+			} break;
+		default:
+			break;
+	}
+}
+
+/* called by the PCI IDE device when BAR4 or its command register changes, base 0 = not decoded */
+void IDE_BusMaster_SetIOBase(Bitu base,bool bus_master) {
+	ide_busmaster_enable = bus_master;
+	if (base == ide_busmaster_base) return;
+
+	ide_busmaster_rh.Uninstall();
+	ide_busmaster_wh.Uninstall();
+	ide_busmaster_base = base;
+
+	if (base != 0) {
+		ide_busmaster_rh.Install(base,ide_busmaster_r,IO_MA,16);
+		ide_busmaster_wh.Install(base,ide_busmaster_w,IO_MA,16);
+	}
+}
+
 static void IDE_PC98_Select(Bitu val) {
 	val &= 1;
 	if (pc98_ide_select != val) {
@@ -3876,6 +4378,27 @@ static Bitu ide_baseio_r(Bitu port,Bitu iolen) {
 	return ret;
 }
 
+/* REP INSW/OUTSW on the data port, registered for the data port only */
+static Bitu ide_baseio_readblock(Bitu port,void *dst,Bitu count,Bitu iolen) {
+	IDEController *ide = match_ide_controller(port);
+	if (ide == NULL) return 0;
+	if (iolen == 4 && (!ide->enable_pio32 || ide->ignore_pio32)) return 0;
+
+	IDEDevice *dev = ide->device[ide->select];
+	if (dev == NULL) return 0;
+	return dev->data_read_block((unsigned char*)dst,count,iolen);
+}
+
+static Bitu ide_baseio_writeblock(Bitu port,const void *src,Bitu count,Bitu iolen) {
+	IDEController *ide = match_ide_controller(port);
+	if (ide == NULL) return 0;
+	if (iolen == 4 && (!ide->enable_pio32 || ide->ignore_pio32)) return 0;
+
+	IDEDevice *dev = ide->device[ide->select];
+	if (dev == NULL) return 0;
+	return dev->data_write_block((const unsigned char*)src,count,iolen);
+}
+
 static void ide_baseio_w(Bitu port,Bitu val,Bitu iolen) {
 	IDEController *ide = match_ide_controller(port);
 	IDEDevice *dev;
@@ -3985,6 +4508,8 @@ static void ide_baseio_w(Bitu port,Bitu val,Bitu iolen) {
 }
 
 static void IDE_Destroy(Section* sec) {
+	PCI_RemoveIDE_Device();
+
 	for (unsigned int i=0;i < MAX_IDE_CONTROLLERS;i++) {
 		if (idecontroller[i] != NULL) {
 			delete idecontroller[i];
@@ -4098,6 +4623,12 @@ void PC98_IDE_UpdateIRQ(void) {
 void IDE_OnReset(Section *sec) {
 
 	for (size_t i=0;i < MAX_IDE_CONTROLLERS;i++) ide_inits[i](control->GetSection(ide_names[i]));
+
+	/* PCI bus master IDE if the primary or secondary interface asks for it */
+	PCI_RemoveIDE_Device();
+	if ((idecontroller[0] != NULL && idecontroller[0]->busmaster_dma) ||
+		(idecontroller[1] != NULL && idecontroller[1]->busmaster_dma))
+		PCI_AddIDE_Device();
 	
 	if (IS_PC98_ARCH) {//TODO: Only if any IDE interfaces are enabled
 		for (size_t i=0;i < 8;i++) {
@@ -4107,6 +4638,9 @@ void IDE_OnReset(Section *sec) {
 			PC98_ReadHandler[i].Install(0x640+(i*2),ide_baseio_r,IO_MA);
 		}
 
+		IO_RegisterReadBlockHandler(0x640,ide_baseio_r,ide_baseio_readblock);
+		IO_RegisterWriteBlockHandler(0x640,ide_baseio_w,ide_baseio_writeblock);
+
 		for (size_t i=0;i < 2;i++) {
 			PC98_WriteHandlerAlt[i].Uninstall();
 			PC98_ReadHandlerAlt[i].Uninstall();
@@ -547,6 +547,114 @@ Bitu IO_ReadD(Bitu port) {
 	return retval;
 }
 
+/* Block handlers for string I/O. Few devices provide them, so a short list is searched.
+ * An entry only applies while the regular handler it was registered with is the one in
+ * the handler table, so a device replaced at the same port falls back to per-element I/O. */
+#define IO_BLOCKHANDLERS_MAX 16
+
+static struct IO_ReadBlockEntry {
+	Bitu port,range;
+	IO_ReadHandler *handler;
+	IO_ReadBlockHandler *block;
+} io_readblock[IO_BLOCKHANDLERS_MAX];
+static Bitu io_readblock_count = 0;
+
+static struct IO_WriteBlockEntry {
+	Bitu port,range;
+	IO_WriteHandler *handler;
+	IO_WriteBlockHandler *block;
+} io_writeblock[IO_BLOCKHANDLERS_MAX];
+static Bitu io_writeblock_count = 0;
+
+void IO_RegisterReadBlockHandler(Bitu port,IO_ReadHandler * handler,IO_ReadBlockHandler * block,Bitu range) {
+	IO_FreeReadBlockHandler(port,range);
+	if (io_readblock_count >= IO_BLOCKHANDLERS_MAX) {
+		LOG(LOG_IO,LOG_WARN)("Too many block I/O read handlers, port %x will use per-element I/O",(int)port);
+		return;
+	}
+	io_readblock[io_readblock_count].port = port;
+	io_readblock[io_readblock_count].range = range;
+	io_readblock[io_readblock_count].handler = handler;
+	io_readblock[io_readblock_count].block = block;
+	io_readblock_count++;
+}
+
+void IO_RegisterWriteBlockHandler(Bitu port,IO_WriteHandler * handler,IO_WriteBlockHandler * block,Bitu range) {
+	IO_FreeWriteBlockHandler(port,range);
+	if (io_writeblock_count >= IO_BLOCKHANDLERS_MAX) {
+		LOG(LOG_IO,LOG_WARN)("Too many block I/O write handlers, port %x will use per-element I/O",(int)port);
+		return;
+	}
+	io_writeblock[io_writeblock_count].port = port;
+	io_writeblock[io_writeblock_count].range = range;
+	io_writeblock[io_writeblock_count].handler = handler;
+	io_writeblock[io_writeblock_count].block = block;
+	io_writeblock_count++;
+}
+
+void IO_FreeReadBlockHandler(Bitu port,Bitu range) {
+	for (Bitu i=0;i < io_readblock_count;) {
+		if (io_readblock[i].port < (port+range) && port < (io_readblock[i].port+io_readblock[i].range))
+			io_readblock[i] = io_readblock[--io_readblock_count];
+		else
+			i++;
+	}
+}
+
+void IO_FreeWriteBlockHandler(Bitu port,Bitu range) {
+	for (Bitu i=0;i < io_writeblock_count;) {
+		if (io_writeblock[i].port < (port+range) && port < (io_writeblock[i].port+io_writeblock[i].range))
+			io_writeblock[i] = io_writeblock[--io_writeblock_count];
+		else
+			i++;
+	}
+}
+
+/* Returns the number of elements transferred, 0 if the caller has to use IO_Read[BWD].
+ * Not used with port logging or in virtual 8086 mode, where every access has to be
+ * looked at (I/O permission bitmap, fake I/O traps). */
+Bitu IO_ReadBlock(Bitu port,void *dst,Bitu count,Bitu iolen) {
+#ifdef ENABLE_PORTLOG
+	return 0;
+#else
+	const unsigned int szidx = (iolen >= 4) ? 2 : (iolen - 1);
+
+	if (count == 0 || GETFLAG(VM)) return 0;
+
+	for (Bitu i=0;i < io_readblock_count;i++) {
+		const IO_ReadBlockEntry &e = io_readblock[i];
+		if (port >= e.port && port < (e.port+e.range) && io_readhandlers[szidx][port] == e.handler) {
+			const Bitu n = e.block(port,dst,count,iolen);
+			for (Bitu j=0;j < n;j++) IO_USEC_read_delay(szidx);
+			return n;
+		}
+	}
+
+	return 0;
+#endif
+}
+
+Bitu IO_WriteBlock(Bitu port,const void *src,Bitu count,Bitu iolen) {
+#ifdef ENABLE_PORTLOG
+	return 0;
+#else
+	const unsigned int szidx = (iolen >= 4) ? 2 : (iolen - 1);
+
+	if (count == 0 || GETFLAG(VM)) return 0;
+
+	for (Bitu i=0;i < io_writeblock_count;i++) {
+		const IO_WriteBlockEntry &e = io_writeblock[i];
+		if (port >= e.port && port < (e.port+e.range) && io_writehandlers[szidx][port] == e.handler) {
+			const Bitu n = e.block(port,src,count,iolen);
+			for (Bitu j=0;j < n;j++) IO_USEC_write_delay(szidx);
+			return n;
+		}
+	}
+
+	return 0;
+#endif
+}
+
 void IO_Reset(Section * /*sec*/) { // Reset or power on
 	Section_prop * section=static_cast<Section_prop *>(control->GetSection("dosbox"));
 
@@ -688,63 +688,131 @@ void mem_strcpy(PhysPt dest,PhysPt src) {
 	mem_writeb_inline(dest,0);
 }
 
+Bitu MEM_HostSpan(const PhysPt pt,const Bitu size,const bool write,HostPt * const host) {
+	Bitu span = 0x1000 - (pt & 0xfff);
+	if (span > size) span = size;
+
+	HostPt tlb_addr = write ? get_tlb_write(pt) : get_tlb_read(pt);
+	if (tlb_addr == NULL) {
+		*host = NULL;
+		return span;
+	}
+
+	/* extend across following pages as long as they are direct and contiguous on the host */
+	*host = tlb_addr + pt;
+	while (span < size) {
+		const PhysPt a = pt + (PhysPt)span;
+		if (a == 0) break; /* wrapped around the address space */
+		tlb_addr = write ? get_tlb_write(a) : get_tlb_read(a);
+		if (tlb_addr == NULL || (tlb_addr + a) != (*host + span)) break;
+		span += 0x1000;
+	}
+	if (span > size) span = size;
+	return span;
+}
+
 void mem_memcpy(PhysPt dest,PhysPt src,Bitu size) {
-	while (size--) mem_writeb_inline(dest++,mem_readb_inline(src++));
+	HostPt hs,hd;
+	while (size) {
+		Bitu span = MEM_HostSpan(src,size,false,&hs);
+		if (hs != NULL) span = MEM_HostSpan(dest,span,true,&hd);
+		else hd = NULL;
+
+		/* go through the handlers a byte at a time when either side is not plain memory */
+		if (hs == NULL || hd == NULL) {
+			mem_writeb_inline(dest++,mem_readb_inline(src++));
+			size--;
+			continue;
+		}
+
+		/* guests may rely on the forward byte copy repeating a pattern when dest overlaps
+		 * just past src, copying in chunks no larger than the distance gives the same result */
+		if (hd > hs && hd < hs + span) span = (Bitu)(hd - hs);
+		memmove(hd,hs,span);
+		dest += (PhysPt)span;
+		src += (PhysPt)span;
+		size -= span;
+	}
 }
 
 void MEM_BlockRead(PhysPt pt,void * data,Bitu size) {
 	Bit8u * write=reinterpret_cast<Bit8u *>(data);
-	while (size--) {
-		*write++=mem_readb_inline(pt++);
+	HostPt host;
+	while (size) {
+		Bitu span=MEM_HostSpan(pt,size,false,&host);
+		if (host == NULL) {
+			/* the handler access may link the page into the TLB, the rest of it can then be copied */
+			*write++=mem_readb_inline(pt++);
+			size--;
+			if (--span == 0) continue;
+			span=MEM_HostSpan(pt,span,false,&host);
+			if (host == NULL) {
+				// Slow path
+				size-=span;
+				while (span--) *write++=mem_readb_inline(pt++);
+				continue;
+			}
+		}
+		// Fast path
+		memcpy(write,host,span);
+		write+=span; pt+=(PhysPt)span; size-=span;
 	}
 }
 
 void MEM_BlockWrite(PhysPt pt,void const * const data,Bitu size) {
 	Bit8u const * read = reinterpret_cast<Bit8u const * const>(data);
-	if (size==0)
-		return;
-
-	if ((pt >> 12) == ((pt+size-1)>>12)) { // Always same TLB entry
-		HostPt tlb_addr=get_tlb_write(pt);
-		if (!tlb_addr) {
-			Bit8u val = *read++;
-			get_tlb_writehandler(pt)->writeb(pt,val);
-			tlb_addr=get_tlb_write(pt);
-			pt++; size--;
-			if (!tlb_addr) {
+	HostPt host;
+	while (size) {
+		Bitu span=MEM_HostSpan(pt,size,true,&host);
+		if (host == NULL) {
+			mem_writeb_inline(pt++,*read++);
+			size--;
+			if (--span == 0) continue;
+			span=MEM_HostSpan(pt,span,true,&host);
+			if (host == NULL) {
 				// Slow path
-				while (size--) {
-					mem_writeb_inline(pt++,*read++);
-				}
-				return;
+				size-=span;
+				while (span--) mem_writeb_inline(pt++,*read++);
+				continue;
 			}
 		}
 		// Fast path
-		memcpy(tlb_addr+pt, read, size);
-	}
-	else {
-		const Bitu current = (((pt>>12)+1)<<12) - pt;
-		Bitu remainder = size - current;
-		MEM_BlockWrite(pt, data, current);
-		MEM_BlockWrite(pt+current, reinterpret_cast<Bit8u const * const>(data)+current, remainder);
+		memcpy(host,read,span);
+		read+=span; pt+=(PhysPt)span; size-=span;
 	}
 }
 
+/* The 32-bit variants keep dword accesses for memory behind handlers (MMIO, VGA),
+ * plain memory is copied directly. */
 void MEM_BlockRead32(PhysPt pt,void * data,Bitu size) {
-	Bit32u * write=(Bit32u *) data;
-	size>>=2;
-	while (size--) {
-		*write++=mem_readd_inline(pt);
-		pt+=4;
+	Bit8u * write=(Bit8u *) data;
+	HostPt host;
+	size&=~((Bitu)3);
+	while (size) {
+		Bitu span=MEM_HostSpan(pt,size,false,&host) & ~((Bitu)3);
+		if (host == NULL || span == 0) {
+			host_writed(write,mem_readd_inline(pt));
+			write+=4; pt+=4; size-=4;
+			continue;
+		}
+		memcpy(write,host,span);
+		write+=span; pt+=(PhysPt)span; size-=span;
 	}
 }
 
 void MEM_BlockWrite32(PhysPt pt,void * data,Bitu size) {
-	Bit32u * read=(Bit32u *) data;
-	size>>=2;
-	while (size--) {
-		mem_writed_inline(pt,*read++);
-		pt+=4;
+	Bit8u * read=(Bit8u *) data;
+	HostPt host;
+	size&=~((Bitu)3);
+	while (size) {
+		Bitu span=MEM_HostSpan(pt,size,true,&host) & ~((Bitu)3);
+		if (host == NULL || span == 0) {
+			mem_writed_inline(pt,host_readd(read));
+			read+=4; pt+=4; size-=4;
+			continue;
+		}
+		memcpy(host,read,span);
+		read+=span; pt+=(PhysPt)span; size-=span;
 	}
 }
 
@@ -752,6 +820,42 @@ void MEM_BlockCopy(PhysPt dest,PhysPt src,Bitu size) {
 	mem_memcpy(dest,src,size);
 }
 
+/* Bus master DMA addresses physical memory, bypassing paging. RAM is copied
+ * directly, anything else goes through the page handler a byte at a time. */
+void MEM_PhysBlockRead(PhysPt pt,void * data,Bitu size) {
+	Bit8u * write=reinterpret_cast<Bit8u *>(data);
+	while (size) {
+		const Bitu page = pt >> 12;
+		Bitu span = 0x1000 - (pt & 0xfff);
+		if (span > size) span = size;
+
+		PageHandler *ph = MEM_GetPageHandler(page);
+		if (ph->getFlags() & PFLAG_READABLE)
+			memcpy(write,ph->GetHostReadPt(page)+(pt & 0xfff),span);
+		else
+			for (Bitu i=0;i < span;i++) write[i]=(Bit8u)ph->readb(pt+(PhysPt)i);
+
+		write+=span; pt+=(PhysPt)span; size-=span;
+	}
+}
+
+void MEM_PhysBlockWrite(PhysPt pt,void const * const data,Bitu size) {
+	Bit8u const * read = reinterpret_cast<Bit8u const *>(data);
+	while (size) {
+		const Bitu page = pt >> 12;
+		Bitu span = 0x1000 - (pt & 0xfff);
+		if (span > size) span = size;
+
+		PageHandler *ph = MEM_GetPageHandler(page);
+		if (ph->getFlags() & PFLAG_WRITEABLE)
+			memcpy(ph->GetHostWritePt(page)+(pt & 0xfff),read,span);
+		else
+			for (Bitu i=0;i < span;i++) ph->writeb(pt+(PhysPt)i,read[i]);
+
+		read+=span; pt+=(PhysPt)span; size-=span;
+	}
+}
+
 void MEM_StrCopy(PhysPt pt,char * data,Bitu size) {
 	while (size--) {
 		Bit8u r=mem_readb_inline(pt++);
@@ -1182,6 +1286,47 @@ void mem_writed(PhysPt address,Bit32u val) {
 	mem_writed_inline(address,val);
 }
 
+/* Returns the number of elements written, or 0 if the page handler cannot do block transfers
+ * and the caller has to fall back to mem_write*() one element at a time. */
+Bitu mem_fillblock(PhysPt address,Bit32u val,Bitu size,Bitu count) {
+	const HostPt tlb_addr=get_tlb_write(address);
+	if (tlb_addr) {
+		HostPt p=tlb_addr+address;
+		if (size == 1)
+			memset(p,(int)(val&0xFF),count);
+		else if (size == 2)
+			for (Bitu i=0;i < count;i++) host_writew(p+(i*2u),(Bit16u)val);
+		else
+			for (Bitu i=0;i < count;i++) host_writed(p+(i*4u),val);
+		return count;
+	}
+	return (get_tlb_writehandler(address))->writeblock_fill(address,val,size,count);
+}
+
+Bitu mem_copyblock(PhysPt dest,PhysPt src,Bitu size,Bitu count) {
+	/* the source must be plain RAM/ROM, so that the copy can't change its own source through a device */
+	const HostPt tlb_src=get_tlb_read(src);
+	if (tlb_src == NULL || ((get_tlb_readhandler(src))->flags & PFLAG_NOCODE)) return 0;
+
+	ConstHostPt s=tlb_src+src;
+	const Bitu len=size*count;
+	const HostPt tlb_dest=get_tlb_write(dest);
+	if (tlb_dest) {
+		HostPt d=tlb_dest+dest;
+		/* a forward REP MOVS where the destination overlaps ahead of the source replicates data, memmove doesn't */
+		if (d > s && d < (s+len)) return 0;
+		memmove(d,s,len);
+		return count;
+	}
+	return (get_tlb_writehandler(dest))->writeblock_copy(dest,s,size,count);
+}
+
+HostPt MEM_GetBlockHostPt(const PhysPt pt,const Bitu size,const bool write) {
+	HostPt host;
+	if (size == 0 || MEM_HostSpan(pt,size,write,&host) != size) return NULL;
+	return host;
+}
+
 void phys_writes(PhysPt addr, const char* string, Bitu length) {
 	for(Bitu i = 0; i < length; i++) host_writeb(MemBase+addr+i,string[i]);
 }
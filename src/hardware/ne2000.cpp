@@ -1365,6 +1365,28 @@ void dosbox_write(Bitu port, Bitu val, Bitu len) {
 	theNE2kDevice->write(port, val, len);
 }
 
+// REP INSW/OUTSW on the remote DMA data port (base+10h). Stops once the remote
+// byte count runs out, the CPU then carries on one access at a time as before.
+static Bitu dosbox_readblock(Bitu port, void *dst, Bitu count, Bitu len) {
+	Bit8u *d = (Bit8u*)dst;
+	Bitu i;
+	for (i = 0; i < count && theNE2kDevice->s.remote_bytes != 0; i++) {
+		Bitu val = theNE2kDevice->read(port,len);
+		if (len == 1) d[i] = (Bit8u)val;
+		else host_writew(d+(i*2),(Bit16u)val);
+	}
+	return i;
+}
+static Bitu dosbox_writeblock(Bitu port, const void *src, Bitu count, Bitu len) {
+	const Bit8u *d = (const Bit8u*)src;
+	Bitu i;
+	for (i = 0; i < count && theNE2kDevice->s.remote_bytes != 0; i++) {
+		if (len == 1) theNE2kDevice->write(port,d[i],len);
+		else theNE2kDevice->write(port,host_readw(d+(i*2)),len);
+	}
+	return i;
+}
+
 void bx_ne2k_c::init()
 {
   //BX_DEBUG(("Init $Id: ne2k.cc,v 1.56.2.1 2004/02/02 22:37:22 cbothamy Exp $"));
@@ -1651,13 +1673,19 @@ public:
 			WriteHandler8[i].Install((i+theNE2kDevice->s.base_address),
 				dosbox_write,IO_MB|IO_MW);
 		}
+		IO_RegisterReadBlockHandler(theNE2kDevice->s.base_address+0x10,dosbox_read,dosbox_readblock);
+		IO_RegisterWriteBlockHandler(theNE2kDevice->s.base_address+0x10,dosbox_write,dosbox_writeblock);
 		TIMER_AddTickHandler(NE2000_Poller);
 	}	
 	
 	~NE2K() {
 		if(adhandle) pcap_close(adhandle);
 		adhandle=0;
-		if(theNE2kDevice != 0) delete theNE2kDevice;
+		if(theNE2kDevice != 0) {
+			IO_FreeReadBlockHandler(theNE2kDevice->s.base_address+0x10);
+			IO_FreeWriteBlockHandler(theNE2kDevice->s.base_address+0x10);
+			delete theNE2kDevice;
+		}
 		theNE2kDevice=0;
 		TIMER_DelTickHandler(NE2000_Poller);
 		PIC_RemoveEvents(NE2000_TX_Event);
@@ -30,6 +30,7 @@
 #include "../ints/int10.h"
 #include "voodoo.h"
 #include "control.h"
+#include "ide.h"
 
 bool pcibus_enable = false;
 bool log_pci = false;
@@ -264,6 +265,77 @@ public:
 	}
 };
 
+/* PCI bus master IDE function of the Intel PIIX. On real hardware this is function 1
+ * of the PCI-ISA bridge, this bus emulation does not do functions so it gets a slot of its own.
+ * Both interfaces stay in compatibility mode (1F0h/170h, IRQ 14/15), only the bus master
+ * registers in BAR4 are new. */
+#define PCI_IDE_BUSMASTER_BASE		0xFFA0
+
+class PCI_IDEDevice:public PCI_Device {
+private:
+	static const Bit16u vendor=0x8086;		// Intel
+	static const Bit16u device=0x1230;		// 82371FB PIIX IDE
+public:
+	PCI_IDEDevice():PCI_Device(vendor,device) {
+		config[0x08] = 0x02;	// revision ID
+		config[0x09] = 0x80;	// interface (bus master, both channels in compatibility mode)
+		config[0x0a] = 0x01;	// subclass type (IDE controller)
+		config[0x0b] = 0x01;	// class type (mass storage controller)
+		config[0x0d] = 0x00;	// latency timer
+		config[0x0e] = 0x00;	// header type (other)
+
+		config[0x3c] = 0xff;	// no irq (compatibility mode uses IRQ 14/15)
+
+		// reset
+		config[0x04] = 0x05;	// command register (I/O space enabled, bus master enabled)
+		config[0x05] = 0x00;
+		config[0x06] = 0x80;	// status register (medium timing, fast back-to-back)
+		config[0x07] = 0x02;
+
+		host_writew(config_writemask+0x04,0x0005);	/* allow changing I/O enable and bus master enable */
+
+		host_writed(config_writemask+0x20,0x0000FFF0);	/* BAR4: I/O resource, 16 ports */
+		host_writed(config+0x20,PCI_IDE_BUSMASTER_BASE | 0x1);
+
+		host_writew(config_writemask+0x40,0xB3FF);	/* IDETIM primary */
+		host_writew(config+0x40,0x8000);		/* IDE decode enable */
+		host_writew(config_writemask+0x42,0xB3FF);	/* IDETIM secondary */
+		host_writew(config+0x42,0x8000);
+
+		update_busmaster();
+	}
+	virtual ~PCI_IDEDevice() {
+		IDE_BusMaster_SetIOBase(0,false);
+	}
+
+	void update_busmaster() {
+		if (config[0x04] & 0x01)
+			IDE_BusMaster_SetIOBase(host_readd(config+0x20)&0xFFF0,(config[0x04] & 0x04) != 0);
+		else
+			IDE_BusMaster_SetIOBase(0,false);
+	}
+
+	virtual void config_write(Bit8u regnum,Bitu iolen,Bit32u value) {
+		if (iolen == 1) {
+			config[regnum] = (value & config_writemask[regnum]) +
+				(config[regnum] & (~config_writemask[regnum]));
+
+			switch (regnum) {
+				case 0x04:
+				case 0x20:
+				case 0x21:
+					update_busmaster();
+					break;
+				default:
+					break;
+			}
+		}
+		else {
+			PCI_Device::config_write(regnum,iolen,value); /* which will break down I/O into 8-bit */
+		}
+	}
+};
+
 static bool initialized = false;
 
 static IO_WriteHandleObject PCI_WriteHandler[5];
@@ -433,6 +505,29 @@ void PCI_RemoveSST_Device(void) {
 	}
 }
 
+static PCI_Device *IDE_PCI=NULL;
+
+void PCI_AddIDE_Device(void) {
+	if (!pcibus_enable) return;
+
+	if (IDE_PCI == NULL) {
+		LOG(LOG_MISC,LOG_DEBUG)("Initializing PCI bus master IDE device");
+		if ((IDE_PCI=new PCI_IDEDevice()) == NULL)
+			return;
+
+		RegisterPCIDevice(IDE_PCI);
+	}
+}
+
+void PCI_RemoveIDE_Device(void) {
+	if (IDE_PCI != NULL) {
+		/* if the bus was torn down the device is already gone */
+		if (UnregisterPCIDevice(IDE_PCI))
+			delete IDE_PCI;
+		IDE_PCI = NULL;
+	}
+}
+
 PhysPt PCI_GetPModeInterface(void) {
 	if (!pcibus_enable) return 0;
 	return GetPModeCallbackPointer();
@@ -206,6 +206,8 @@ bool non_cga_ignore_oddeven = false;
 bool non_cga_ignore_oddeven_engage = false;
 bool vga_palette_update_on_full_load = true;
 bool vga_double_buffered_line_compare = false;
+bool vga_batched_draw = false;
+bool vga_skip_unchanged_lines = true;
 bool pc98_allow_scanline_effect = true;
 bool pc98_allow_4_display_partitions = false;
 bool pc98_graphics_hide_odd_raster_200line = false;
@@ -769,6 +771,8 @@ void VGA_Reset(Section*) {
 	non_cga_ignore_oddeven = section->Get_bool("ignore odd-even mode in non-cga modes");
 	enable_vretrace_poll_debugging_marker = section->Get_bool("vertical retrace poll debug line");
 	vga_double_buffered_line_compare = section->Get_bool("double-buffered line compare");
+	vga_batched_draw = section->Get_bool("batched scanline rendering");
+	vga_skip_unchanged_lines = section->Get_bool("skip unchanged scanlines");
 	hack_lfb_yadjust = section->Get_int("vesa lfb base scanline adjust");
 	allow_vesa_lowres_modes = section->Get_bool("allow low resolution vesa modes");
 	vesa12_modes_32bpp = section->Get_bool("vesa vbe 1.2 modes are 32bpp");
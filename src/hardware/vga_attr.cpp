@@ -128,6 +128,7 @@ Bitu read_p3c0(Bitu /*port*/,Bitu /*iolen*/) {
 }
  
 void write_p3c0(Bitu /*port*/,Bitu val,Bitu iolen) {
+	VGA_RasterRegisterWrite();
 	if (!vga.internal.attrindex) {
 		attr(index)=val & 0x1F;
 		vga.internal.attrindex=true;
@@ -63,6 +63,7 @@ Bitu vga_read_p3d4(Bitu port,Bitu iolen) {
 void vga_write_p3d5(Bitu port,Bitu val,Bitu iolen) {
 //	if((crtc(index)!=0xe)&&(crtc(index)!=0xf)) 
 //		LOG_MSG("CRTC w #%2x val %2x",crtc(index),val);
+	VGA_RasterRegisterWrite();
 	switch(crtc(index)) {
 	case 0x00:	/* Horizontal Total Register */
 		if (crtc(read_only)) break;
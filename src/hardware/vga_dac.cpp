@@ -53,6 +53,8 @@ Note:  Each read or write of this register will cycle through first the
 enum {DAC_READ,DAC_WRITE};
 
 static void VGA_DAC_SendColor( Bitu index, Bitu src ) {
+	VGA_InvalidateLineCache();
+
 	/* NTS: Don't forget red/green/blue are 6-bit RGB not 8-bit RGB */
 	const Bit8u red = vga.dac.rgb[src].red;
 	const Bit8u green = vga.dac.rgb[src].green;
@@ -131,6 +133,7 @@ void VGA_DAC_UpdateColorPalette() {
 }
 
 void write_p3c6(Bitu port,Bitu val,Bitu iolen) {
+	VGA_RasterRegisterWrite();
 	if((IS_VGA_ARCH) && (vga.dac.hidac_counter>3)) {
 		vga.dac.reg02=val;
 		vga.dac.hidac_counter=0;
@@ -190,6 +193,8 @@ static unsigned char tmp_dac[3] = {0,0,0};
 void write_p3c9(Bitu port,Bitu val,Bitu iolen) {
 	bool update = false;
 
+	VGA_RasterRegisterWrite();
+
 	vga.dac.hidac_counter=0;
 	val&=0x3f;
 	if (vga.dac.pel_index < 3) {
@@ -20,6 +20,7 @@
 #include <string.h>
 #include <math.h>
 #include <stdio.h>
+#include <vector>
 #include "dosbox.h"
 #if defined (WIN32)
 #include <d3d9.h>
@@ -39,6 +40,13 @@
 #include "pc98_cg.h"
 #include "pc98_gdc.h"
 #include "pc98_gdc_const.h"
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#include <emmintrin.h>
+#endif
+#if defined(C_TARGET_SSSE3_AVX2)
+#include <immintrin.h>
+#endif
 
 bool mcga_double_scan = false;
 
@@ -63,6 +71,8 @@ extern unsigned int vga_display_start_hretrace;
 extern float hretrace_fx_avg_weight;
 extern bool ignore_vblank_wraparound;
 extern bool vga_double_buffered_line_compare;
+extern bool vga_batched_draw;
+extern bool vga_skip_unchanged_lines;
 extern bool pc98_crt_mode;      // see port 6Ah command 40h/41h.
 
 extern bool pc98_31khz_mode;
@@ -98,6 +108,104 @@ static VGA_Line_Handler VGA_DrawLine;
 static Bit8u TempLine[SCALER_MAXWIDTH * 4 + 256];
 static float hretrace_fx_avg = 0;
 
+#if defined(__SSE__)
+/* one 8 pixel wide character cell row: font bit 7 is the leftmost pixel */
+static inline void VGA_Text_Expand8_SSE2(Bit32u *draw,const Bitu font,const Bit32u fg,const Bit32u bg) {
+	const __m128i f = _mm_set1_epi32((int)font);
+	const __m128i m0 = _mm_set_epi32(0x10,0x20,0x40,0x80);
+	const __m128i m1 = _mm_set_epi32(0x01,0x02,0x04,0x08);
+	const __m128i vfg = _mm_set1_epi32((int)fg);
+	const __m128i vbg = _mm_set1_epi32((int)bg);
+	__m128i sel;
+
+	sel = _mm_cmpeq_epi32(_mm_and_si128(f,m0),m0);
+	_mm_storeu_si128((__m128i*)(draw+0),_mm_or_si128(_mm_and_si128(sel,vfg),_mm_andnot_si128(sel,vbg)));
+	sel = _mm_cmpeq_epi32(_mm_and_si128(f,m1),m1);
+	_mm_storeu_si128((__m128i*)(draw+4),_mm_or_si128(_mm_and_si128(sel,vfg),_mm_andnot_si128(sel,vbg)));
+}
+
+/* planar to packed: the four bitplane bytes of one VGA memory address (plane 0 in the low byte)
+ * become 8 pixel indices in the low 8 bytes of the result, leftmost pixel first */
+static inline __m128i VGA_Planar_To_Packed_SSE2(const Bit32u t) {
+	const __m128i bits = _mm_set_epi8(1,2,4,8,16,32,64,-128,1,2,4,8,16,32,64,-128);
+	const __m128i w01 = _mm_set_epi8(2,2,2,2,2,2,2,2,1,1,1,1,1,1,1,1);
+	const __m128i w23 = _mm_set_epi8(8,8,8,8,8,8,8,8,4,4,4,4,4,4,4,4);
+	__m128i v,lo,hi;
+
+	v = _mm_cvtsi32_si128((int)t);
+	v = _mm_unpacklo_epi8(v,v);
+	v = _mm_unpacklo_epi16(v,v);
+	lo = _mm_unpacklo_epi32(v,v); /* plane 0 x8, plane 1 x8 */
+	hi = _mm_unpackhi_epi32(v,v); /* plane 2 x8, plane 3 x8 */
+	lo = _mm_and_si128(_mm_cmpeq_epi8(_mm_and_si128(lo,bits),bits),w01);
+	hi = _mm_and_si128(_mm_cmpeq_epi8(_mm_and_si128(hi,bits),bits),w23);
+	lo = _mm_or_si128(lo,hi);
+	return _mm_or_si128(lo,_mm_srli_si128(lo,8));
+}
+#endif
+
+#if defined(C_TARGET_SSSE3_AVX2)
+/* 8bpp to 32bpp palette lookup, eight pixels per gather */
+__attribute__((target("avx2"))) static void VGA_Xlat32_Run_AVX2(Bit32u *draw,const Bit8u *src,Bitu count) {
+	const int *xlat = (const int*)vga.dac.xlat32;
+
+	while (count >= 8) {
+		const __m256i idx = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)src));
+		_mm256_storeu_si256((__m256i*)draw,_mm256_i32gather_epi32(xlat,idx,4));
+		draw += 8; src += 8; count -= 8;
+	}
+	while (count-- > 0)
+		*draw++ = vga.dac.xlat32[*src++];
+}
+
+/* 16 colour planar line: the first 16 palette entries are split into one table per byte of
+ * the 32bpp colour, so that pshufb looks up one byte of 16 pixels at once */
+__attribute__((target("ssse3"))) static void VGA_Planar_Xlat32_Run_SSSE3(Bit32u *draw,Bitu vidstart,Bitu count) {
+	const __m128i bytes = _mm_set_epi8(15,11,7,3,14,10,6,2,13,9,5,1,12,8,4,0);
+	const Bitu step = (Bitu)4 << (Bitu)vga.config.addr_shift;
+	__m128i r0,r1,r2,r3,t0,t1,t2,t3;
+
+	/* each row: byte 0 of four entries, then byte 1, ... transposed into one row per byte */
+	r0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)&vga.dac.xlat32[0]),bytes);
+	r1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)&vga.dac.xlat32[4]),bytes);
+	r2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)&vga.dac.xlat32[8]),bytes);
+	r3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)&vga.dac.xlat32[12]),bytes);
+	t0 = _mm_unpacklo_epi32(r0,r1);
+	t1 = _mm_unpacklo_epi32(r2,r3);
+	t2 = _mm_unpackhi_epi32(r0,r1);
+	t3 = _mm_unpackhi_epi32(r2,r3);
+	const __m128i b0 = _mm_unpacklo_epi64(t0,t1);
+	const __m128i b1 = _mm_unpackhi_epi64(t0,t1);
+	const __m128i b2 = _mm_unpacklo_epi64(t2,t3);
+	const __m128i b3 = _mm_unpackhi_epi64(t2,t3);
+
+	while (count > 0) {
+		/* two addresses, 16 pixels, when there are two left */
+		__m128i idx = VGA_Planar_To_Packed_SSE2(*((Bit32u*)(&vga.draw.linear_base[ vidstart & vga.draw.linear_mask ])));
+		vidstart += step;
+		if (count >= 2) {
+			idx = _mm_unpacklo_epi64(idx,VGA_Planar_To_Packed_SSE2(*((Bit32u*)(&vga.draw.linear_base[ vidstart & vga.draw.linear_mask ]))));
+			vidstart += step;
+		}
+
+		const __m128i c0 = _mm_shuffle_epi8(b0,idx);
+		const __m128i c1 = _mm_shuffle_epi8(b1,idx);
+		const __m128i c2 = _mm_shuffle_epi8(b2,idx);
+		const __m128i c3 = _mm_shuffle_epi8(b3,idx);
+		const __m128i lo01 = _mm_unpacklo_epi8(c0,c1),lo23 = _mm_unpacklo_epi8(c2,c3);
+		_mm_storeu_si128((__m128i*)(draw+0),_mm_unpacklo_epi16(lo01,lo23));
+		_mm_storeu_si128((__m128i*)(draw+4),_mm_unpackhi_epi16(lo01,lo23));
+		if (count < 2) break;
+
+		const __m128i hi01 = _mm_unpackhi_epi8(c0,c1),hi23 = _mm_unpackhi_epi8(c2,c3);
+		_mm_storeu_si128((__m128i*)(draw+8),_mm_unpacklo_epi16(hi01,hi23));
+		_mm_storeu_si128((__m128i*)(draw+12),_mm_unpackhi_epi16(hi01,hi23));
+		draw += 16;
+		count -= 2;
+	}
+}
+#endif
+
 static Bit8u * VGA_Draw_AMS_4BPP_Line(Bitu vidstart, Bitu line) {
 	const Bit8u *base = vga.tandy.draw_base + ((line & vga.tandy.line_mask) << vga.tandy.line_shift);
 	const Bit8u *lbase;
@@ -537,7 +645,23 @@ static Bit8u * VGA_Draw_Xlat32_Linear_Line(Bitu vidstart, Bitu /*line*/) {
 		vidstart += (Bitu)((int)x);
 	}
 
-	for(Bitu i = 0; i < (vga.draw.line_length>>2); i++)
+	const Bitu count = vga.draw.line_length>>2;
+
+	/* the common case, where the line does not wrap around the end of video memory */
+	if (((vidstart&vga.draw.linear_mask)+count) <= (vga.draw.linear_mask+1)) {
+		const Bit8u *src = &vga.draw.linear_base[vidstart&vga.draw.linear_mask];
+#if defined(C_TARGET_SSSE3_AVX2)
+		if (avx2_available) {
+			VGA_Xlat32_Run_AVX2(temps,src,count);
+			return TempLine;
+		}
+#endif
+		for (Bitu i = 0; i < count; i++)
+			temps[i]=vga.dac.xlat32[src[i]];
+		return TempLine;
+	}
+
+	for(Bitu i = 0; i < count; i++)
 		temps[i]=vga.dac.xlat32[vga.draw.linear_base[(vidstart+i)&vga.draw.linear_mask]];
 
 	return TempLine;
@@ -585,6 +709,13 @@ template <const unsigned int card,typename templine_type_t> static Bit8u * EGA_P
     // TODO: Odd/even mode i.e. 64KB EGA 640x350 4-color mode
     // if (vga.seq.clocking_mode&4) { /* odd/even mode serialization */
 
+#if defined(C_TARGET_SSSE3_AVX2)
+    if (card == MCH_VGA && ssse3_available) {
+        VGA_Planar_Xlat32_Run_SSSE3((Bit32u*)temps,vidstart,count);
+        return TempLine + (vga.draw.panning*sizeof(templine_type_t));
+    }
+#endif
+
     while (count > 0u) {
         t1 = t2 = *((Bit32u*)(&vga.draw.linear_base[ vidstart & vga.draw.linear_mask ]));
         t1 = (t1 >> 4) & 0x0f0f0f0f;
@@ -1073,6 +1204,15 @@ template <const unsigned int card,typename templine_type_t> static inline Bit8u*
 			// extend to the 9th pixel if needed
 			if ((font&0x2) && (vga.attr.mode_control&0x04) &&
 				(chr>=0xc0) && (chr<=0xdf)) font |= 1;
+#if defined(__SSE__)
+			if (card == MCH_VGA && sse2_available) {
+				const Bit32u fg = vga.dac.xlat32[foreground],bg = vga.dac.xlat32[background];
+				VGA_Text_Expand8_SSE2((Bit32u*)draw,font>>1,fg,bg);
+				draw[8] = (font&1) ? fg : bg;
+				draw += 9;
+				continue;
+			}
+#endif
 			for (Bitu n = 0; n < 9; n++) {
                 if (card == MCH_VGA)
                     *draw++ = vga.dac.xlat32[(font&0x100)? foreground:background];
@@ -1082,6 +1222,13 @@ template <const unsigned int card,typename templine_type_t> static inline Bit8u*
 				font <<= 1;
 			}
 		} else {
+#if defined(__SSE__)
+			if (card == MCH_VGA && sse2_available) {
+				VGA_Text_Expand8_SSE2((Bit32u*)draw,font,vga.dac.xlat32[foreground],vga.dac.xlat32[background]);
+				draw += 8;
+				continue;
+			}
+#endif
 			for (Bitu n = 0; n < 8; n++) {
                 if (card == MCH_VGA)
                     *draw++ = vga.dac.xlat32[(font&0x80)? foreground:background];
@@ -1595,6 +1742,126 @@ void VGA_Update_SplitLineCompare() {
 	vga.draw.split_line -= vga.draw.vblank_skip;
 }
 
+/* Unchanged scanline skipping. The planar write handlers stamp every page of video memory they write
+ * with vga.mem.write_serial, which advances once per rendered frame. Each scanline remembers the serial
+ * of the frame it was last drawn in and the address it was drawn from. If no page the line reads from
+ * was written since then, and no register affecting the picture was written (VGA_InvalidateLineCache),
+ * the line is not drawn at all. The renderer gets back its own cached copy of the line from the last
+ * frame instead, which every line handler sees as unchanged. */
+struct VGA_LineGen {
+	Bit32u serial;		/* write_serial of the frame the line was last drawn in, 0 if it must be redrawn */
+	Bitu address;
+	Bitu panning;
+};
+
+static std::vector<VGA_LineGen> vga_line_gen;
+static Bit32u vga_line_gen_flush = 0;	/* lines drawn in this frame serial or earlier must be redrawn */
+static Bitu vga_line_gen_span = 0;	/* bytes of video memory one scanline reads, 0 if not tracked this frame */
+static bool vga_line_gen_skip = false;	/* the render cache holds last frame's lines this frame */
+
+void VGA_InvalidateLineCache(void) {
+	vga_line_gen_flush = vga.mem.write_serial;
+}
+
+static Bitu VGA_LineGenSpan(void) {
+	if (!vga_skip_unchanged_lines || !IS_EGAVGA_ARCH) return 0;
+	if (!vga.mem.write_tracked || vga.mem.write_gen == NULL || vga.lfb.handler != NULL) return 0;
+	if (vga.draw.linear_base != vga.mem.linear || vga_enable_hretrace_effects) return 0;
+
+	if (VGA_DrawLine == VGA_Draw_VGA_Planar_Xlat32_Line || VGA_DrawLine == EGA_Draw_VGA_Planar_Xlat8_Line)
+		return (vga.draw.blocks + 2u) * ((Bitu)4u << vga.config.addr_shift);
+	if (VGA_DrawLine == VGA_Draw_Xlat32_VGA_CRTC_bmode_Line)
+		return ((vga.draw.line_length >> 4u) + 2u) * ((Bitu)4u << vga.config.addr_shift);
+	if (VGA_DrawLine == VGA_Draw_Xlat32_Linear_Line)
+		return (vga.draw.line_length >> 2u) + 4u;
+
+	return 0;
+}
+
+/* returns true if the scanline about to be drawn from address is known to be the same as last frame */
+static bool VGA_LineUnchanged(Bitu address) {
+	if (vga_line_gen_span == 0) return false;
+
+	const Bitu line = vga.draw.lines_done;
+	if (line >= vga_line_gen.size()) vga_line_gen.resize(line + 1);
+	VGA_LineGen &lg = vga_line_gen[line];
+
+	if (vga_line_gen_skip && lg.serial > vga_line_gen_flush && lg.address == address && lg.panning == vga.draw.panning &&
+		!vga_page_flip_occurred && !vga_3da_polled) {
+		const Bitu start = address & ~((Bitu)3u);
+		const Bitu first = start >> VGA_WRITE_GEN_SHIFT;
+		const Bitu last = (start + vga_line_gen_span - 1u) >> VGA_WRITE_GEN_SHIFT;
+		const Bitu pages = vga.vmemsize >> VGA_WRITE_GEN_SHIFT;
+		Bitu p;
+
+		for (p=first;p <= last;p++) {
+			const Bitu page = ((p << VGA_WRITE_GEN_SHIFT) & vga.draw.linear_mask) >> VGA_WRITE_GEN_SHIFT;
+			if (page >= pages || vga.mem.write_gen[page] >= lg.serial) break;
+		}
+		if (p > last) return true;
+	}
+
+	lg.serial = vga.mem.write_serial;
+	lg.address = address;
+	lg.panning = vga.draw.panning;
+	return false;
+}
+
+/* Batched frame rendering. If the guest has not written CRTC, attribute controller or DAC registers
+ * during the active display of recent frames, the whole frame is drawn in one pass at display end
+ * instead of scheduling one PIC event per scanline. A register write during active display draws
+ * the lines the beam has already passed with the old register values, then falls back to per-line
+ * events for the rest of the frame and for the next VGA_BATCH_COOLDOWN_FRAMES frames. */
+#define VGA_BATCH_COOLDOWN_FRAMES 30
+
+static bool vga_batch_pending = false;		/* lines of the current frame are being deferred */
+static double vga_batch_linestart = 0;		/* PIC time the first line event would have fired */
+static Bitu vga_batch_events = 0;		/* line events emulated so far in the current frame */
+static unsigned int vga_batch_cooldown = 0;	/* frames left before batching is tried again */
+
+static void VGA_DrawSingleLine(Bitu /*blah*/);
+static void VGA_DrawEGASingleLine(Bitu /*blah*/);
+
+static void VGA_DrawBatchedLines(Bitu events) {
+	while (vga_batch_events < events && vga.draw.lines_done < vga.draw.lines_total) {
+		vga_batch_events++;
+		if (vga.draw.mode == EGALINE) VGA_DrawEGASingleLine(0);
+		else VGA_DrawSingleLine(0);
+	}
+}
+
+static void VGA_DrawBatchedFrame(Bitu /*val*/) {
+	VGA_DrawBatchedLines(~((Bitu)0));
+	vga_batch_pending = false;
+}
+
+/* must be called BEFORE the register write takes effect */
+void VGA_RasterRegisterWrite(void) {
+	VGA_InvalidateLineCache();
+
+	if (vga_batch_pending) {
+		const double now = PIC_FullIndex();
+		if (now < vga_batch_linestart) return; /* still above the first displayed line */
+
+		const Bitu passed = (Bitu)((now - vga_batch_linestart) / vga.draw.delay.singleline_delay) + 1;
+
+		VGA_DrawBatchedLines(passed);
+		PIC_RemoveEvents(VGA_DrawBatchedFrame);
+		vga_batch_pending = false;
+		vga_batch_cooldown = VGA_BATCH_COOLDOWN_FRAMES;
+
+		if (vga.draw.lines_done < vga.draw.lines_total) {
+			double next = vga_batch_linestart + ((double)passed * vga.draw.delay.singleline_delay) - now;
+			if (next < 0) next = 0;
+			if (vga.draw.mode == EGALINE) PIC_AddEvent(VGA_DrawEGASingleLine,(float)next);
+			else PIC_AddEvent(VGA_DrawSingleLine,(float)next);
+		}
+	}
+	else if (vga.draw.lines_done > 0 && vga.draw.lines_done < vga.draw.lines_total) {
+		vga_batch_cooldown = VGA_BATCH_COOLDOWN_FRAMES;
+	}
+}
+
 static void VGA_DrawSingleLine(Bitu /*blah*/) {
 	unsigned int lines = 0;
     bool skiprender;
@@ -1675,9 +1942,10 @@ again:
                     memxor_greendotted_16bpp((uint16_t*)TempLine,(vga.draw.width>>1)*(vga.draw.bpp>>3),vga.draw.lines_done);
                 vga_3da_polled = false;
             }
+            VGA_InvalidateLineCache();
             RENDER_DrawLine(TempLine);
         } else {
-            Bit8u * data=VGA_DrawLine( vga.draw.address, vga.draw.address_line );
+            Bit8u * data=VGA_LineUnchanged(vga.draw.address) ? render.scale.cacheRead : VGA_DrawLine( vga.draw.address, vga.draw.address_line );
             if (vga_page_flip_occurred) {
                 memxor(data,0xFF,vga.draw.width*(vga.draw.bpp>>3));
                 vga_page_flip_occurred = false;
@@ -1712,7 +1980,7 @@ again:
 	}
 	
     if (vga.draw.lines_done < vga.draw.lines_total) {
-        PIC_AddEvent(VGA_DrawSingleLine,(float)vga.draw.delay.singleline_delay);
+        if (!vga_batch_pending) PIC_AddEvent(VGA_DrawSingleLine,(float)vga.draw.delay.singleline_delay);
     } else {
         vga_mode_frames_since_time_base++;
         RENDER_EndUpdate(false);
@@ -1756,6 +2024,7 @@ static void VGA_DrawEGASingleLine(Bitu /*blah*/) {
     if (!skiprender) {
         if (GCC_UNLIKELY(vga.attr.disabled)) {
             memset(TempLine, 0, sizeof(TempLine));
+            VGA_InvalidateLineCache();
             RENDER_DrawLine(TempLine);
         } else {
             Bitu address = vga.draw.address;
@@ -1772,7 +2041,7 @@ static void VGA_DrawEGASingleLine(Bitu /*blah*/) {
                         break;
                 }
             }
-            Bit8u * data=VGA_DrawLine(address, vga.draw.address_line );	
+            Bit8u * data=VGA_LineUnchanged(address) ? render.scale.cacheRead : VGA_DrawLine(address, vga.draw.address_line );
             RENDER_DrawLine(data);
         }
     }
@@ -1789,7 +2058,7 @@ static void VGA_DrawEGASingleLine(Bitu /*blah*/) {
     }
 
     if (vga.draw.lines_done < vga.draw.lines_total) {
-        PIC_AddEvent(VGA_DrawEGASingleLine,(float)vga.draw.delay.singleline_delay);
+        if (!vga_batch_pending) PIC_AddEvent(VGA_DrawEGASingleLine,(float)vga.draw.delay.singleline_delay);
     } else {
         vga_mode_frames_since_time_base++;
         RENDER_EndUpdate(false);
@@ -2054,6 +2323,12 @@ static void VGA_VerticalTimer(Bitu /*val*/) {
 	//Check if we can actually render, else skip the rest
 	if (vga.draw.vga_override || !RENDER_StartUpdate()) return;
 
+	vga.mem.write_serial++;
+	vga_line_gen_span = VGA_LineGenSpan();
+	/* the render cache only holds last frame's lines when it is not being cleared or fully redrawn,
+	 * and the complex scalers keep more state per line than the source cache */
+	vga_line_gen_skip = vga_line_gen_span != 0 && !render.fullFrame && render.scale.complexHandler == NULL;
+
 	vga.draw.address_line = vga.config.hlines_skip;
 	if (IS_EGAVGA_ARCH) VGA_Update_SplitLineCompare();
 	vga.draw.address = vga.config.real_start;
@@ -2206,11 +2481,23 @@ static void VGA_VerticalTimer(Bitu /*val*/) {
 				(int)(vga.draw.lines_total-vga.draw.lines_done));
 			if (vga.draw.mode==EGALINE) PIC_RemoveEvents(VGA_DrawEGASingleLine);
 			else PIC_RemoveEvents(VGA_DrawSingleLine);
+			PIC_RemoveEvents(VGA_DrawBatchedFrame);
+			vga_batch_pending = false;
 			vga_mode_frames_since_time_base++;
 			RENDER_EndUpdate(true);
 		}
 		vga.draw.lines_done = 0;
-		if (vga.draw.mode==EGALINE)
+		vga_batch_events = 0;
+		if (vga_batch_cooldown > 0) vga_batch_cooldown--;
+		if (vga_batched_draw && vga_batch_cooldown == 0 && IS_EGAVGA_ARCH) {
+			/* draw the whole frame at display end, unless a raster register write says otherwise */
+			double fv = vga.draw.delay.htotal/4.0 + draw_skip;
+			vga_batch_linestart = PIC_FullIndex() + fv;
+			vga_batch_pending = true;
+			if (fv < vga.draw.delay.vdend) fv = vga.draw.delay.vdend;
+			PIC_AddEvent(VGA_DrawBatchedFrame,(float)fv);
+		}
+		else if (vga.draw.mode==EGALINE)
 			PIC_AddEvent(VGA_DrawEGASingleLine,(float)(vga.draw.delay.htotal/4.0 + draw_skip));
 		else PIC_AddEvent(VGA_DrawSingleLine,(float)(vga.draw.delay.htotal/4.0 + draw_skip));
 		break;
@@ -2374,6 +2661,8 @@ void VGA_SetupDrawing(Bitu /*val*/) {
 		PIC_RemoveEvents(VGA_DisplayStartLatch);
 		return;
 	}
+	VGA_InvalidateLineCache();
+
 	// user choosable special trick support
 	// multiscan -- zooming effects - only makes sense if linewise is enabled
 	// linewise -- scan display line by line instead of 4 blocks
@@ -3299,6 +3588,8 @@ void VGA_SetupDrawing(Bitu /*val*/) {
 void VGA_KillDrawing(void) {
 	PIC_RemoveEvents(VGA_DrawSingleLine);
 	PIC_RemoveEvents(VGA_DrawEGASingleLine);
+	PIC_RemoveEvents(VGA_DrawBatchedFrame);
+	vga_batch_pending = false;
 }
 
 void VGA_SetOverride(bool vga_override) {
@@ -72,6 +72,7 @@ static void write_p3cf(Bitu port,Bitu val,Bitu iolen) {
 		gfx(data_rotate)=val;
 		vga.config.data_rotate=val & 7;
 		vga.config.raster_op=(val>>3) & 3;
+		VGA_CheckWriteFunc();
 		/* 
 			0-2	Number of positions to rotate data right before it is written to
 				display memory. Only active in Write Mode 0.
@@ -97,6 +98,7 @@ static void write_p3cf(Bitu port,Bitu val,Bitu iolen) {
 		} else gfx(mode)=val;
 		vga.config.write_mode=val & 3;
 		vga.config.read_mode=(val >> 3) & 1;
+		VGA_CheckWriteFunc();
 //		LOG_DEBUG("Write Mode %d Read Mode %d val %d",vga.config.write_mode,vga.config.read_mode,val);
 		/*
 			0-1	Write Mode: Controls how data from the CPU is transformed before
@@ -168,9 +170,8 @@ static void write_p3cf(Bitu port,Bitu val,Bitu iolen) {
 		gfx(bit_mask)=val;
 		vga.config.full_bit_mask=ExpandTable[val];
 
-		/* check for unusual use of the bit mask register in chained 320x200x256 mode and switch to the slow & accurate emulation */
-		if (vga.mode == M_VGA && vga.config.chained)
-			VGA_SetupHandlers();
+		/* leaving or returning to the "all bits" bit mask switches between the generic and specialized write paths */
+		VGA_CheckWriteFunc();
 
 //		LOG_DEBUG("Bit mask %2X",val);
 		/*
@@ -152,6 +152,53 @@ INLINE static Bit32u ModeOperation(Bit8u val) {
 	return full;
 }
 
+/* Specialized write paths. VGA_CheckWriteFunc() picks one whenever the Graphics Controller
+ * write mode, data rotate, raster op or bit mask changes and caches it in vga.config.write_func,
+ * so the common cases do not re-examine the whole write path on every byte written. The page
+ * handlers stay mapped, as planar code toggles these registers far too often for a remap. */
+enum {
+	VGA_WFUNC_GENERIC=0,		/* anything else, through ModeOperation() */
+	VGA_WFUNC_MODE0_PLAIN,		/* write mode 0, no rotate, no raster op, bit mask FFh */
+	VGA_WFUNC_MODE1,		/* write mode 1, latch copy */
+	VGA_WFUNC_MODE2_PLAIN		/* write mode 2, no raster op, bit mask FFh */
+};
+
+static INLINE Bit32u ModeOperationFast(Bit8u val) {
+	switch (vga.config.write_func) {
+	case VGA_WFUNC_MODE0_PLAIN:
+		// Same as write mode 0 above, with the rotate, raster op and bit mask steps being no-ops
+		return (ExpandTable[val] & vga.config.full_not_enable_set_reset) | vga.config.full_enable_and_set_reset;
+	case VGA_WFUNC_MODE1:
+		return vga.latch.d;
+	case VGA_WFUNC_MODE2_PLAIN:
+		return FillTable[val&0xF];
+	default:
+		return ModeOperation(val);
+	}
+}
+
+static unsigned int VGA_DetermineWriteFunc(void) {
+	switch (vga.config.write_mode) {
+	case 0x00:
+		if (vga.config.data_rotate == 0 && vga.config.raster_op == 0 && vga.config.full_bit_mask == 0xFFFFFFFFu)
+			return VGA_WFUNC_MODE0_PLAIN;
+		break;
+	case 0x01:
+		return VGA_WFUNC_MODE1;
+	case 0x02:
+		if (vga.config.raster_op == 0 && vga.config.full_bit_mask == 0xFFFFFFFFu)
+			return VGA_WFUNC_MODE2_PLAIN;
+		break;
+	}
+
+	return VGA_WFUNC_GENERIC;
+}
+
+/* called by the Graphics Controller when a register affecting the write path changes */
+void VGA_CheckWriteFunc(void) {
+	vga.config.write_func = VGA_DetermineWriteFunc();
+}
+
 bool pc98_pegc_linear_framebuffer_enabled(void) {
 	return !!(pc98_pegc_mmio[0x102] & 1);
 }
@@ -332,7 +379,7 @@ template <const bool chained> static inline void VGA_Generic_Write_Handler(PhysP
 		planeaddr &= mask & (vga.mem.memmask >> 2u);
 	}
 
-	Bit32u data=ModeOperation(val);
+	Bit32u data=ModeOperationFast(val);
 	VGA_Latch pixels;
 
 	pixels.d =((Bit32u*)vga.mem.linear)[planeaddr];
@@ -345,6 +392,31 @@ template <const bool chained> static inline void VGA_Generic_Write_Handler(PhysP
 	vga.draw.font[planeaddr] = pixels.b[2];
 
 	((Bit32u*)vga.mem.linear)[planeaddr]=pixels.d;
+
+	/* let the scanline renderer know this page changed (planeaddr is in units of 4 bytes) */
+	vga.mem.write_gen[planeaddr >> (VGA_WRITE_GEN_SHIFT - 2u)] = vga.mem.write_serial;
+}
+
+/* REP STOSx/MOVSx into the planar handlers: the same byte writes as count writeb/w/d calls,
+ * translating the address once. writeByte is the handler's own per-byte write. */
+template <void (*writeByte)(PhysPt,Bitu)> static inline Bitu VGA_Planar_WriteBlock_Fill(PhysPt addr,Bitu val,Bitu size,Bitu count) {
+	addr = PAGING_GetPhysicalAddress(addr) & vgapages.mask;
+	addr += vga.svga.bank_write_full;
+	for (Bitu i=0;i < count;i++) {
+		VGAMEM_USEC_write_delay();
+		for (Bitu b=0;b < size;b++) writeByte(addr++, val >> (b*8u));
+	}
+	return count;
+}
+
+template <void (*writeByte)(PhysPt,Bitu)> static inline Bitu VGA_Planar_WriteBlock_Copy(PhysPt addr,ConstHostPt src,Bitu size,Bitu count) {
+	addr = PAGING_GetPhysicalAddress(addr) & vgapages.mask;
+	addr += vga.svga.bank_write_full;
+	for (Bitu i=0;i < count;i++) {
+		VGAMEM_USEC_write_delay();
+		for (Bitu b=0;b < size;b++) writeByte(addr++, *src++);
+	}
+	return count;
 }
 
 // Slow accurate emulation.
@@ -424,6 +496,12 @@ public:
 		writeHandler8( addr+2, val >> 16 );
 		writeHandler8( addr+3, val >> 24 );
 	}
+	Bitu writeblock_fill(PhysPt addr,Bitu val,Bitu size,Bitu count) {
+		return VGA_Planar_WriteBlock_Fill<writeHandler8>(addr,val,size,count);
+	}
+	Bitu writeblock_copy(PhysPt addr,ConstHostPt src,Bitu size,Bitu count) {
+		return VGA_Planar_WriteBlock_Copy<writeHandler8>(addr,src,size,count);
+	}
 };
 
 class VGA_ET4000_ChainedVGA_Slow_Handler : public PageHandler {
@@ -491,6 +569,12 @@ public:
 		writeHandler8( addr+2, val >> 16 );
 		writeHandler8( addr+3, val >> 24 );
 	}
+	Bitu writeblock_fill(PhysPt addr,Bitu val,Bitu size,Bitu count) {
+		return VGA_Planar_WriteBlock_Fill<writeHandler8>(addr,val,size,count);
+	}
+	Bitu writeblock_copy(PhysPt addr,ConstHostPt src,Bitu size,Bitu count) {
+		return VGA_Planar_WriteBlock_Copy<writeHandler8>(addr,src,size,count);
+	}
 };
 
 class VGA_UnchainedVGA_Handler : public PageHandler {
@@ -527,8 +611,8 @@ public:
 		return ret;
 	}
 public:
-	void writeHandler(PhysPt start, Bit8u val) {
-		VGA_Generic_Write_Handler<false/*chained*/>(start, start, val);
+	static INLINE void writeHandler(PhysPt start, Bitu val) {
+		VGA_Generic_Write_Handler<false/*chained*/>(start, start, (Bit8u)val);
 	}
 public:
 	VGA_UnchainedVGA_Handler() : PageHandler(PFLAG_NOCODE) {}
@@ -557,6 +641,12 @@ public:
 		writeHandler(addr+2,(Bit8u)(val >> 16));
 		writeHandler(addr+3,(Bit8u)(val >> 24));
 	}
+	Bitu writeblock_fill(PhysPt addr,Bitu val,Bitu size,Bitu count) {
+		return VGA_Planar_WriteBlock_Fill<writeHandler>(addr,val,size,count);
+	}
+	Bitu writeblock_copy(PhysPt addr,ConstHostPt src,Bitu size,Bitu count) {
+		return VGA_Planar_WriteBlock_Copy<writeHandler>(addr,src,size,count);
+	}
 };
 
 #include <stdio.h>
@@ -1860,6 +1950,24 @@ public:
 		Bitu port = PAGING_GetPhysicalAddress(addr) & 0xffff;
 		XGA_Write(port, val, 4);
 	}
+	Bitu writeblock_fill(PhysPt addr,Bitu val,Bitu size,Bitu count) {
+		Bitu port = PAGING_GetPhysicalAddress(addr) & 0xffff;
+		for (Bitu i=0;i < count;i++,port += size) {
+			VGAMEM_USEC_write_delay();
+			XGA_Write(port, val, size);
+		}
+		return count;
+	}
+	Bitu writeblock_copy(PhysPt addr,ConstHostPt src,Bitu size,Bitu count) {
+		Bitu port = PAGING_GetPhysicalAddress(addr) & 0xffff;
+		for (Bitu i=0;i < count;i++,port += size,src += size) {
+			VGAMEM_USEC_write_delay();
+			if (size == 1) XGA_Write(port, host_readb(src), 1);
+			else if (size == 2) XGA_Write(port, host_readw(src), 2);
+			else XGA_Write(port, host_readd(src), 4);
+		}
+		return count;
+	}
 
 	Bitu readb(PhysPt addr) {
 		VGAMEM_USEC_read_delay();
@@ -2159,8 +2267,14 @@ void MEM_ResetPageHandler_RAM(Bitu phys_page, Bitu pages);
 void VGA_SetupHandlers(void) {
 	vga.svga.bank_read_full = vga.svga.bank_read*vga.svga.bank_size;
 	vga.svga.bank_write_full = vga.svga.bank_write*vga.svga.bank_size;
+	vga.config.write_func = VGA_DetermineWriteFunc();
 
 	PageHandler *newHandler;
+
+	/* anything could have happened to display memory while the handlers were different */
+	vga.mem.write_tracked = false;
+	VGA_InvalidateLineCache();
+
 	switch (machine) {
 	case MCH_CGA:
 		if (enableCGASnow && (vga.mode == M_TEXT || vga.mode == M_TANDY_TEXT))
@@ -2317,6 +2431,7 @@ void VGA_SetupHandlers(void) {
 		} else {
 			newHandler = &vgaph.uvga;
 		}
+		vga.mem.write_tracked = (newHandler != &vgaph.map);
 		break;
 	case M_AMSTRAD:
 		newHandler = &vgaph.map;
@@ -2357,8 +2472,10 @@ void VGA_SetupHandlers(void) {
 		MEM_ResetPageHandler_Unmapped( VGA_PAGE_B0, 8 );
 		break;
 	}
-	if(svgaCard == SVGA_S3Trio && (vga.s3.ext_mem_ctrl & 0x10))
+	if(svgaCard == SVGA_S3Trio && (vga.s3.ext_mem_ctrl & 0x10)) {
 		MEM_SetPageHandler(VGA_PAGE_A0, 16, &vgaph.mmio);
+		vga.mem.write_tracked = false;
+	}
 		
 	non_cga_ignore_oddeven_engage = (non_cga_ignore_oddeven && !(vga.mode == M_TEXT || vga.mode == M_CGA2 || vga.mode == M_CGA4));
 	
@@ -2423,6 +2540,11 @@ static void VGA_Memory_ShutDown(Section * /*sec*/) {
 		vga.mem.linear_orgptr = NULL;
 		vga.mem.linear = NULL;
 	}
+	if (vga.mem.write_gen != NULL) {
+		delete[] vga.mem.write_gen;
+		vga.mem.write_gen = NULL;
+	}
+	vga.mem.write_tracked = false;
 }
 
 void VGAMEM_LoadState(Section *sec) {
@@ -2432,8 +2554,10 @@ void VGAMEM_LoadState(Section *sec) {
 		ZIPFileEntry *ent = savestate_zip.get_entry("vga.memory.bin");
 		if (ent != NULL) {
 			ent->rewind();
-			if (vga.vmemsize == ent->file_length)
+			if (vga.vmemsize == ent->file_length) {
 				ent->read(vga.mem.linear, vga.vmemsize);
+				VGA_InvalidateLineCache();
+			}
 			else
 				LOG_MSG("VGA Memory load state failure: VGA Memory size mismatch");
 		}
@@ -2464,6 +2588,10 @@ void VGA_SetupMemory() {
         vga.mem.linear=(Bit8u*)(((uintptr_t)vga.mem.linear_orgptr + 16-1) & ~(16-1));
         vga.vmemsize_alloced = vga.vmemsize;
 
+        vga.mem.write_gen = new Bit32u[(vga.vmemsize >> VGA_WRITE_GEN_SHIFT) + 1];
+        memset(vga.mem.write_gen,0,sizeof(Bit32u) * ((vga.vmemsize >> VGA_WRITE_GEN_SHIFT) + 1));
+        vga.mem.write_serial = 1;
+
         /* HACK. try to avoid stale pointers */
 	    vga.draw.linear_base = vga.mem.linear;
         vga.tandy.draw_base = vga.mem.linear;
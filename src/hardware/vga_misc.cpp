@@ -72,6 +72,7 @@ Bitu vga_read_p3da(Bitu port,Bitu iolen) {
 }
 
 static void write_p3c2(Bitu port,Bitu val,Bitu iolen) {
+	VGA_RasterRegisterWrite();
 	if((machine==MCH_EGA) && ((vga.misc_output^val)&0xc)) VGA_StartResize();
 	vga.misc_output=val;
 	if (val & 0x1) {
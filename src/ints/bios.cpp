@@ -3465,6 +3465,8 @@ void PC98_BIOS_SCSI_CALL(void) {
     Bit32u sector;
     int idx;
 
+    DISKIO_Sync();
+
 #if 0
             LOG_MSG("PC-98 INT 1Bh SCSI BIOS call AX=%04X BX=%04X CX=%04X DX=%04X SI=%04X DI=%04X DS=%04X ES=%04X",
                     reg_ax,
@@ -3520,6 +3522,7 @@ void PC98_BIOS_SCSI_CALL(void) {
 
                     for (i=0;i < ssize;i++) PC98_BIOS_FLOPPY_BUFFER[i] = mem_readb(memaddr+i);
 
+                    floppy->write_generation++;
                     if (floppy->Write_AbsoluteSector(sector,PC98_BIOS_FLOPPY_BUFFER) == 0) {
                     }
                     else {
@@ -3695,6 +3698,8 @@ void PC98_BIOS_FDC_CALL(unsigned int flags) {
     unsigned long memaddr;
     imageDisk *floppy;
 
+    DISKIO_Sync();
+
     /* AL bits[1:0] = which floppy drive */
     if ((reg_al & 3) >= 2) {
         /* This emulation only supports up to 2 floppy drives */
@@ -3976,6 +3981,7 @@ void PC98_BIOS_FDC_CALL(unsigned int flags) {
                 for (unsigned int i=0;i < accsize;i++)
                     PC98_BIOS_FLOPPY_BUFFER[i] = mem_readb(memaddr+i);
 
+                floppy->write_generation++;
                 if (floppy->Write_Sector(fdc_head[drive],fdc_cyl[drive],fdc_sect[drive],PC98_BIOS_FLOPPY_BUFFER,unitsize) != 0) {
                     CALLBACK_SCF(true);
                     reg_ah = 0x00;
@@ -26,6 +26,20 @@
 #include "../dos/drives.h"
 #include "mapper.h"
 #include "ide.h"
+#include "hunk_image.h"
+#include <map>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <assert.h>
+#include "SDL.h"
+#include "SDL_thread.h"
+#if defined(C_HAVE_MMAP)
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#endif
 
 extern bool int13_extensions_enable;
 
@@ -222,6 +236,444 @@ void swapInNextCD(bool pressed) {
 }
 
 
+/* Block cache for raw disk images.
+ *
+ * The image is cached in DISK_CACHE_BLOCK_SIZE blocks, shared by all images up to a configurable
+ * total, least recently used first out. A miss reads the whole block, and a miss on the block
+ * following the previous miss also reads the next one ahead. Writes go into the cached block and
+ * the dirty range is written back in one piece when a write goes to a different block, when the
+ * block is evicted, or when the image is closed, so at most one block of writes is pending. A block
+ * whose write-back fails stays dirty and resident, and the write that needed it gone fails. */
+#define DISK_CACHE_BLOCK_SIZE (32u*1024u)
+
+class imageDiskCache {
+public:
+	struct Block {
+		imageDisk*	disk;
+		Bit64u		index;		/* block number, relative to image_base */
+		Bit32u		length;		/* valid bytes, shorter than a block at the end of the image */
+		Bit32u		dirty_lo,dirty_hi;	/* byte range not yet written back, empty if equal */
+		Block*		prev;		/* LRU list, most recently used first */
+		Block*		next;
+		Bit8u		data[DISK_CACHE_BLOCK_SIZE];
+	};
+	typedef std::pair<imageDisk*,Bit64u> Key;
+	typedef std::map<Key,Block*> BlockMap;
+	struct Stats {
+		unsigned long	hits,misses,readaheads,writebacks;
+
+		Stats() : hits(0), misses(0), readaheads(0), writebacks(0) { }
+	};
+	typedef std::map<imageDisk*,Stats> StatsMap;
+
+	imageDiskCache() : max_blocks(0), readahead(true), dirty(NULL), lru_head(NULL), lru_tail(NULL),
+		last_miss_disk(NULL), last_miss(0) { }
+
+	bool Enabled(void) const {
+		return max_blocks != 0;
+	}
+	void Configure(Bitu size_kb,bool ra) {
+		max_blocks = (size_kb * 1024u) / DISK_CACHE_BLOCK_SIZE;
+		readahead = ra;
+		while (blocks.size() > max_blocks) {
+			if (!Evict(lru_tail)) break; /* stays over the limit until the write-back succeeds */
+		}
+	}
+	Bit8u Read(imageDisk *disk,Bit64u offset,void *data,Bitu len) {
+		Bit8u *d = (Bit8u*)data;
+		while (len > 0) {
+			const Bit64u index = offset / DISK_CACHE_BLOCK_SIZE;
+			const Bit32u in = (Bit32u)(offset % DISK_CACHE_BLOCK_SIZE);
+			const Bitu n = std::min(len,(Bitu)(DISK_CACHE_BLOCK_SIZE - in));
+			Block *b = Get(disk,index,true);
+			if (b != NULL && (in + n) <= b->length) {
+				memcpy(d,b->data+in,n);
+			}
+			else {
+				/* not cacheable (i.e. past the end of the file), go to the file directly */
+				if (!Evict(b)) return 0x05;
+				if (disk->Read_Raw(offset,d,n) != n) return 0x05;
+			}
+			d += n; offset += n; len -= n;
+		}
+		return 0x00;
+	}
+	Bit8u Write(imageDisk *disk,Bit64u offset,const void *data,Bitu len) {
+		const Bit8u *s = (const Bit8u*)data;
+		while (len > 0) {
+			const Bit64u index = offset / DISK_CACHE_BLOCK_SIZE;
+			const Bit32u in = (Bit32u)(offset % DISK_CACHE_BLOCK_SIZE);
+			const Bitu n = std::min(len,(Bitu)(DISK_CACHE_BLOCK_SIZE - in));
+			Block *b = Get(disk,index,false);
+			if (dirty != b && !WriteBack(dirty)) return 0x05;
+			if (b == NULL || (in + n) > b->length) {
+				if (!Evict(b)) return 0x05;
+				if (!disk->Write_Raw(offset,s,n)) return 0x05;
+				s += n; offset += n; len -= n;
+				continue;
+			}
+			memcpy(b->data+in,s,n);
+			if (b->dirty_lo == b->dirty_hi) {
+				b->dirty_lo = in;
+				b->dirty_hi = (Bit32u)(in + n);
+			}
+			else {
+				b->dirty_lo = std::min(b->dirty_lo,in);
+				b->dirty_hi = std::max(b->dirty_hi,(Bit32u)(in + n));
+			}
+			dirty = b;
+			s += n; offset += n; len -= n;
+		}
+		return 0x00;
+	}
+	/* write back and forget everything cached for the disk, which is being closed */
+	void Drop(imageDisk *disk) {
+		BlockMap::iterator i = blocks.lower_bound(Key(disk,0));
+		while (i != blocks.end() && i->first.first == disk) {
+			Block *b = i->second;
+			++i;
+			if (!Evict(b)) {
+				/* nobody is left to report this to */
+				LOG_MSG("Disk image cache: write-back of %u bytes to %s failed, the data is lost",
+					(unsigned int)(b->dirty_hi - b->dirty_lo),disk->diskname.c_str());
+				b->dirty_lo = b->dirty_hi = 0;
+				Evict(b);
+			}
+		}
+		if (last_miss_disk == disk) last_miss_disk = NULL;
+
+		StatsMap::iterator st = stats.find(disk);
+		if (st != stats.end()) {
+			LOG(LOG_BIOS,LOG_NORMAL)("Disk image cache: %s: %lu hits, %lu misses, %lu blocks read ahead, %lu write-backs",
+				disk->diskname.c_str(),st->second.hits,st->second.misses,st->second.readaheads,st->second.writebacks);
+			stats.erase(st);
+		}
+	}
+private:
+	Block *Get(imageDisk *disk,Bit64u index,bool reading) {
+		BlockMap::iterator i = blocks.find(Key(disk,index));
+		if (i != blocks.end()) {
+			if (reading) stats[disk].hits++;
+			Touch(i->second);
+			return i->second;
+		}
+
+		if (reading) stats[disk].misses++;
+		Block *b = Load(disk,index);
+		if (b != NULL && reading && readahead) {
+			/* sequential access: fetch the following block too */
+			if (last_miss_disk == disk && last_miss + 1u == index && blocks.find(Key(disk,index+1u)) == blocks.end() &&
+				((index + 1u) * DISK_CACHE_BLOCK_SIZE) < disk->image_length && blocks.size() + 1u < max_blocks) {
+				if (Load(disk,index+1u) != NULL) stats[disk].readaheads++;
+				Touch(b);
+			}
+			last_miss_disk = disk;
+			last_miss = index;
+		}
+		return b;
+	}
+	Block *Load(imageDisk *disk,Bit64u index) {
+		const Bit64u start = index * DISK_CACHE_BLOCK_SIZE;
+		if (start >= disk->image_length) return NULL;
+
+		/* a block that cannot be written back stays, take the next least recently used one */
+		Block *victim = lru_tail;
+		while (victim != NULL && blocks.size() >= max_blocks) {
+			Block *prev = victim->prev;
+			Evict(victim);
+			victim = prev;
+		}
+		if (blocks.size() >= max_blocks) return NULL;
+
+		Block *b = new Block;
+		b->disk = disk;
+		b->index = index;
+		b->dirty_lo = b->dirty_hi = 0;
+		b->length = (Bit32u)std::min((Bit64u)DISK_CACHE_BLOCK_SIZE,disk->image_length - start);
+		/* the image file may be shorter than the geometry says, only what was read is valid */
+		b->length = (Bit32u)disk->Read_Raw(start,b->data,b->length);
+		if (b->length == 0) {
+			delete b;
+			return NULL;
+		}
+
+		b->prev = NULL;
+		b->next = lru_head;
+		if (lru_head != NULL) lru_head->prev = b;
+		else lru_tail = b;
+		lru_head = b;
+		blocks[Key(disk,index)] = b;
+		return b;
+	}
+	void Touch(Block *b) {
+		if (b == lru_head) return;
+		b->prev->next = b->next;
+		if (b->next != NULL) b->next->prev = b->prev;
+		else lru_tail = b->prev;
+		b->prev = NULL;
+		b->next = lru_head;
+		lru_head->prev = b;
+		lru_head = b;
+	}
+	/* on failure the block keeps its dirty range and stays the pending block */
+	bool WriteBack(Block *b) {
+		if (b == NULL) return true;
+		if (b->dirty_lo != b->dirty_hi) {
+			const Bit32u lo = b->dirty_lo,hi = b->dirty_hi;
+			if (!b->disk->Write_Raw((b->index * DISK_CACHE_BLOCK_SIZE) + lo,b->data + lo,hi - lo))
+				return false;
+			b->dirty_lo = b->dirty_hi = 0;
+			stats[b->disk].writebacks++;
+		}
+		if (b == dirty) dirty = NULL;
+		return true;
+	}
+	/* false if the block has writes that could not be written back, it then stays cached */
+	bool Evict(Block *b) {
+		if (b == NULL) return true;
+		if (!WriteBack(b)) return false;
+		blocks.erase(Key(b->disk,b->index));
+		if (b->prev != NULL) b->prev->next = b->next;
+		else lru_head = b->next;
+		if (b->next != NULL) b->next->prev = b->prev;
+		else lru_tail = b->prev;
+		delete b;
+		return true;
+	}
+
+	Bitu		max_blocks;
+	bool		readahead;
+	Block*		dirty;		/* the only block with writes pending, if any */
+	BlockMap	blocks;
+	Block*		lru_head;
+	Block*		lru_tail;
+	imageDisk*	last_miss_disk;
+	Bit64u		last_miss;
+	StatsMap	stats;		/* per image, logged when the image is closed */
+};
+
+static imageDiskCache disk_cache;
+
+void imageDiskCache_Configure(Bitu size_kb,bool readahead) {
+	DISKIO_Sync();
+	disk_cache.Configure(size_kb,readahead);
+}
+
+/* Disk I/O thread. Requests are run one at a time in submission order, so at most one
+ * thread is ever inside imageDisk code: the emulation thread calls DISKIO_Sync() before
+ * it touches a disk itself. The emulation thread holds a reference on the disk of every
+ * request until it has seen the request complete. */
+static SDL_Thread*	diskio_thread = NULL;
+static SDL_mutex*	diskio_mutex = NULL;
+static SDL_cond*	diskio_wake = NULL;	/* signalled when a request is queued or on shutdown */
+static SDL_cond*	diskio_idle = NULL;	/* signalled when a request completes */
+static DiskIORequest*	diskio_head = NULL;
+static DiskIORequest*	diskio_tail = NULL;
+static DiskIORequest*	diskio_running = NULL;
+static bool		diskio_quit = false;
+static volatile unsigned long diskio_thread_id = 0;
+static std::vector<std::string> diskio_log;	/* messages from the I/O thread, under diskio_mutex */
+
+bool DISKIO_DeferLog(const char *msg) {
+	if (diskio_thread_id == 0 || (unsigned long)SDL_ThreadID() != diskio_thread_id) return false;
+
+	SDL_LockMutex(diskio_mutex);
+	diskio_log.push_back(msg);
+	SDL_UnlockMutex(diskio_mutex);
+	return true;
+}
+
+/* emulation thread: log what the I/O thread had to say */
+static void DISKIO_FlushLog(void) {
+	std::vector<std::string> msgs;
+
+	SDL_LockMutex(diskio_mutex);
+	msgs.swap(diskio_log);
+	SDL_UnlockMutex(diskio_mutex);
+
+	for (size_t i=0;i < msgs.size();i++)
+		LOG_MSG("%s",msgs[i].c_str());
+}
+
+static void DISKIO_Run(DiskIORequest *req) {
+	imageDisk *disk = req->disk;
+
+	req->result = 0;
+	if (req->chs) {
+		Bit8u *d = (Bit8u*)req->data;
+		for (req->completed=0;req->completed < req->count;req->completed++) {
+			if (req->write)
+				req->result = disk->Write_Sector(req->head,req->cylinder,req->sectnum+req->completed,d);
+			else
+				req->result = disk->Read_Sector(req->head,req->cylinder,req->sectnum+req->completed,d);
+			if (req->result != 0) break;
+			d += req->sector_size;
+		}
+	}
+	else {
+		if (req->write)
+			req->result = disk->Write_Sectors(req->sectnum,req->count,req->data);
+		else
+			req->result = disk->Read_Sectors(req->sectnum,req->count,req->data);
+		req->completed = (req->result == 0) ? req->count : 0;
+	}
+}
+
+static int DISKIO_Thread(void * /*arg*/) {
+	diskio_thread_id = (unsigned long)SDL_ThreadID();
+	SDL_LockMutex(diskio_mutex);
+	for (;;) {
+		while (diskio_head == NULL && !diskio_quit)
+			SDL_CondWait(diskio_wake,diskio_mutex);
+		if (diskio_head == NULL) break;
+
+		DiskIORequest *req = diskio_head;
+		diskio_head = req->next;
+		if (diskio_head == NULL) diskio_tail = NULL;
+		diskio_running = req;
+		SDL_UnlockMutex(diskio_mutex);
+
+		DISKIO_Run(req);
+
+		SDL_LockMutex(diskio_mutex);
+		diskio_running = NULL;
+		req->done = true;
+		SDL_CondBroadcast(diskio_idle);
+	}
+	SDL_UnlockMutex(diskio_mutex);
+	return 0;
+}
+
+bool DISKIO_Async(void) {
+	return diskio_thread != NULL;
+}
+
+void DISKIO_Configure(bool enable) {
+	if (enable == (diskio_thread != NULL)) return;
+
+	if (!enable) {
+		SDL_LockMutex(diskio_mutex);
+		diskio_quit = true;
+		SDL_CondSignal(diskio_wake);
+		SDL_UnlockMutex(diskio_mutex);
+		SDL_WaitThread(diskio_thread,NULL);
+		diskio_thread = NULL;
+		diskio_thread_id = 0;
+		/* the thread drains the queue before it leaves */
+		DISKIO_FlushLog();
+		return;
+	}
+
+	if (diskio_mutex == NULL) {
+		diskio_mutex = SDL_CreateMutex();
+		diskio_wake = SDL_CreateCond();
+		diskio_idle = SDL_CreateCond();
+		if (diskio_mutex == NULL || diskio_wake == NULL || diskio_idle == NULL) {
+			LOG_MSG("Disk I/O thread: unable to create synchronization objects, disk access stays synchronous");
+			return;
+		}
+	}
+
+	diskio_quit = false;
+#if defined(C_SDL2)
+	diskio_thread = SDL_CreateThread(DISKIO_Thread,"Disk I/O",NULL);
+#else
+	diskio_thread = SDL_CreateThread(DISKIO_Thread,NULL);
+#endif
+	if (diskio_thread == NULL)
+		LOG_MSG("Disk I/O thread: unable to start, disk access stays synchronous");
+}
+
+void DISKIO_Submit(DiskIORequest *req) {
+	assert(!req->busy);
+	assert(req->disk != NULL);
+
+	req->disk->Addref();
+	if (req->write) req->disk->write_generation++;
+	req->busy = true;
+	req->done = false;
+	req->next = NULL;
+
+	if (diskio_thread == NULL) {
+		DISKIO_Run(req);
+		req->done = true;
+		return;
+	}
+
+	SDL_LockMutex(diskio_mutex);
+	if (diskio_tail != NULL) diskio_tail->next = req;
+	else diskio_head = req;
+	diskio_tail = req;
+	SDL_CondSignal(diskio_wake);
+	SDL_UnlockMutex(diskio_mutex);
+}
+
+bool DISKIO_Complete(DiskIORequest *req) {
+	if (!req->busy) return true;
+
+	if (diskio_thread != NULL) {
+		SDL_LockMutex(diskio_mutex);
+		const bool done = req->done;
+		SDL_UnlockMutex(diskio_mutex);
+		if (!done) return false;
+		DISKIO_FlushLog();
+	}
+
+	req->busy = false;
+	req->disk->Release();
+	return true;
+}
+
+void DISKIO_Wait(DiskIORequest *req) {
+	if (!req->busy) return;
+
+	if (diskio_thread != NULL) {
+		SDL_LockMutex(diskio_mutex);
+		while (!req->done) SDL_CondWait(diskio_idle,diskio_mutex);
+		SDL_UnlockMutex(diskio_mutex);
+		DISKIO_FlushLog();
+	}
+
+	DISKIO_Complete(req);
+}
+
+void DISKIO_Sync(void) {
+	if (diskio_thread == NULL) return;
+
+	SDL_LockMutex(diskio_mutex);
+	while (diskio_head != NULL || diskio_running != NULL)
+		SDL_CondWait(diskio_idle,diskio_mutex);
+	SDL_UnlockMutex(diskio_mutex);
+	DISKIO_FlushLog();
+}
+
+size_t imageDisk::Read_Raw(Bit64u offset,void *data,size_t len) {
+	offset += image_base;
+	if (fseeko64(diskimg,offset,SEEK_SET) != 0 || (Bit64u)ftello64(diskimg) != offset) {
+		LOG_MSG("fseek() failed in Read_Raw at %llu\n",(unsigned long long)offset);
+		return 0;
+	}
+	return fread(data,1,len,diskimg);
+}
+
+bool imageDisk::Write_Raw(Bit64u offset,const void *data,size_t len) {
+	offset += image_base;
+	if (fseeko64(diskimg,offset,SEEK_SET) != 0 || (Bit64u)ftello64(diskimg) != offset) {
+		LOG_MSG("WARNING: fseek() failed in Write_Raw at %llu\n",(unsigned long long)offset);
+		return false;
+	}
+	return fwrite(data,1,len,diskimg) == len;
+}
+
+imageDisk::~imageDisk() {
+	DISKIO_Sync();
+	disk_cache.Drop(this);
+	if (diskimg != NULL) {
+		fclose(diskimg);
+		diskimg = NULL;
+	}
+}
+
 Bit8u imageDisk::Read_Sector(Bit32u head,Bit32u cylinder,Bit32u sector,void * data,unsigned int req_sector_size) {
 	Bit32u sectnum;
 	
@@ -244,6 +696,9 @@ Bit8u imageDisk::Read_AbsoluteSector(Bit32u sectnum, void * data) {
 		LOG_MSG("Attempt to read invalid sector in Read_AbsoluteSector for sector %lu.\n", (unsigned long)sectnum);
 		return 0x05;
 	}
+	if (disk_cache.Enabled() && diskimg != NULL)
+		return disk_cache.Read(this,bytenum,data,sector_size);
+
 	bytenum += image_base;
 
 	//LOG_MSG("Reading sectors %ld at bytenum %I64d", sectnum, bytenum);
@@ -288,6 +743,9 @@ Bit8u imageDisk::Write_AbsoluteSector(Bit32u sectnum, void *data) {
 		LOG_MSG("Attempt to read invalid sector in Write_AbsoluteSector for sector %lu.\n", (unsigned long)sectnum);
 		return 0x05;
 	}
+	if (disk_cache.Enabled() && diskimg != NULL)
+		return disk_cache.Write(this,bytenum,data,sector_size);
+
 	bytenum += image_base;
 
 	//LOG_MSG("Writing sectors to %ld at bytenum %d", sectnum, bytenum);
@@ -302,6 +760,52 @@ Bit8u imageDisk::Write_AbsoluteSector(Bit32u sectnum, void *data) {
 
 }
 
+Bit8u imageDisk::Read_Sectors(Bit32u sectnum, Bit32u count, void * data) {
+	if (class_id != ID_BASE || diskimg == NULL) {
+		for (Bit32u i=0;i < count;i++) {
+			Bit8u ret = Read_AbsoluteSector(sectnum+i, (Bit8u*)data + (i * sector_size));
+			if (ret != 0x00) return ret;
+		}
+		return 0x00;
+	}
+
+	Bit64u bytenum = (Bit64u)sectnum * (Bit64u)sector_size;
+	Bit64u len = (Bit64u)count * (Bit64u)sector_size;
+	if ((bytenum + len) > this->image_length) {
+		LOG_MSG("Attempt to read invalid sectors in Read_Sectors for sectors %lu-%lu.\n",
+			(unsigned long)sectnum,(unsigned long)(sectnum+count-1u));
+		return 0x05;
+	}
+	if (count == 0) return 0x00;
+	if (disk_cache.Enabled())
+		return disk_cache.Read(this,bytenum,data,(Bitu)len);
+
+	return (Read_Raw(bytenum,data,(size_t)len) == len) ? 0x00 : 0x05;
+}
+
+Bit8u imageDisk::Write_Sectors(Bit32u sectnum, Bit32u count, void * data) {
+	if (class_id != ID_BASE || diskimg == NULL) {
+		for (Bit32u i=0;i < count;i++) {
+			Bit8u ret = Write_AbsoluteSector(sectnum+i, (Bit8u*)data + (i * sector_size));
+			if (ret != 0x00) return ret;
+		}
+		return 0x00;
+	}
+
+	Bit64u bytenum = (Bit64u)sectnum * (Bit64u)sector_size;
+	Bit64u len = (Bit64u)count * (Bit64u)sector_size;
+	if ((bytenum + len) > this->image_length) {
+		LOG_MSG("Attempt to write invalid sectors in Write_Sectors for sectors %lu-%lu.\n",
+			(unsigned long)sectnum,(unsigned long)(sectnum+count-1u));
+		return 0x05;
+	}
+	if (count == 0) return 0x00;
+	if (disk_cache.Enabled())
+		return disk_cache.Write(this,bytenum,data,(Bitu)len);
+
+	return Write_Raw(bytenum,data,(size_t)len) ? 0x00 : 0x05;
+}
+
 void imageDisk::Set_Reserved_Cylinders(Bitu resCyl) {
 	reserved_cylinders = resCyl;
 }
@@ -316,6 +820,7 @@ imageDisk::imageDisk(IMAGE_TYPE class_id) {
     image_base = 0;
     sectors = 0;
 	refcount = 0;
+	write_generation = 0;
 	sector_size = 512;
 	image_length = 0;
 	reserved_cylinders = 0;
@@ -333,6 +838,7 @@ imageDisk::imageDisk(FILE* diskimg, const char* diskName, Bit32u cylinders, Bit3
 	image_base = 0;
 	this->image_length = (Bit64u)cylinders * heads * sectors * sector_size;
 	refcount = 0;
+	write_generation = 0;
 	this->sector_size = sector_size;
 	this->diskSizeK = this->image_length / 1024;
 	reserved_cylinders = 0;
@@ -424,6 +930,7 @@ imageDisk::imageDisk(FILE *imgFile, Bit8u *imgName, Bit32u imgSizeK, bool isHard
 	image_length = (Bit64u)imgSizeK * (Bit64u)1024;
     sectors = 0;
 	refcount = 0;
+	write_generation = 0;
 	sector_size = 512;
 	reserved_cylinders = 0;
 	diskimg = imgFile;
@@ -656,6 +1163,183 @@ Bit32u imageDisk::getSectSize(void) {
 	return sector_size;
 }
 
+static bool disk_mmap_enable = true;
+
+void imageDiskMapped_Configure(bool enable) {
+	disk_mmap_enable = enable;
+}
+
+imageDiskMapped::imageDiskMapped(FILE *imgFile, Bit8u *imgName, Bit32u imgSizeK, bool isHardDisk) :
+	imageDisk(imgFile, imgName, imgSizeK, isHardDisk), map_base(NULL), map_length(0), map_writable(false) {
+	Map();
+}
+
+imageDiskMapped::~imageDiskMapped() {
+	Unmap();
+}
+
+void imageDiskMapped::Map(void) {
+#if defined(C_HAVE_MMAP)
+	if (!disk_mmap_enable || diskimg == NULL || image_length == 0)
+		return;
+
+	int fd = fileno(diskimg);
+	struct stat st;
+	if (fd < 0 || fstat(fd,&st) != 0 || !S_ISREG(st.st_mode))
+		return;
+
+	/* never map past the end of the file, touching those pages raises SIGBUS */
+	Bit64u len = image_base + image_length;
+	if ((Bit64u)st.st_size < len || (Bit64u)((size_t)len) != len)
+		return;
+
+	int flags = fcntl(fd,F_GETFL);
+	bool writable = (flags != -1 && (flags & O_ACCMODE) == O_RDWR);
+
+	fflush(diskimg);
+	void *p = mmap(NULL,(size_t)len,PROT_READ|(writable ? PROT_WRITE : 0),MAP_SHARED,fd,0);
+	if (p == MAP_FAILED) {
+		LOG_MSG("Unable to memory map disk image, using file I/O instead");
+		return;
+	}
+
+	map_base = (Bit8u*)p;
+	map_length = len;
+	map_writable = writable;
+#endif
+}
+
+void imageDiskMapped::Unmap(void) {
+#if defined(C_HAVE_MMAP)
+	if (map_base != NULL) {
+		if (map_writable) msync(map_base,(size_t)map_length,MS_ASYNC);
+		munmap(map_base,(size_t)map_length);
+	}
+#endif
+	map_base = NULL;
+	map_length = 0;
+	map_writable = false;
+}
+
+Bit8u imageDiskMapped::Read_AbsoluteSector(Bit32u sectnum, void * data) {
+	if (map_base == NULL)
+		return imageDisk::Read_AbsoluteSector(sectnum, data);
+
+	Bit64u bytenum = (Bit64u)sectnum * (Bit64u)sector_size;
+	if ((bytenum + sector_size) > image_length) {
+		LOG_MSG("Attempt to read invalid sector in Read_AbsoluteSector for sector %lu.\n", (unsigned long)sectnum);
+		return 0x05;
+	}
+
+	memcpy(data, map_base + image_base + bytenum, sector_size);
+	return 0x00;
+}
+
+Bit8u imageDiskMapped::Write_AbsoluteSector(Bit32u sectnum, void * data) {
+	if (map_base == NULL)
+		return imageDisk::Write_AbsoluteSector(sectnum, data);
+
+	Bit64u bytenum = (Bit64u)sectnum * (Bit64u)sector_size;
+	if ((bytenum + sector_size) > image_length) {
+		LOG_MSG("Attempt to read invalid sector in Write_AbsoluteSector for sector %lu.\n", (unsigned long)sectnum);
+		return 0x05;
+	}
+	if (!map_writable)
+		return 0x05;
+
+	memcpy(map_base + image_base + bytenum, data, sector_size);
+	return 0x00;
+}
+
+Bit8u imageDiskMapped::Read_Sectors(Bit32u sectnum, Bit32u count, void * data) {
+	if (map_base == NULL)
+		return imageDisk::Read_Sectors(sectnum, count, data);
+
+	Bit64u bytenum = (Bit64u)sectnum * (Bit64u)sector_size;
+	Bit64u len = (Bit64u)count * (Bit64u)sector_size;
+	if ((bytenum + len) > image_length) {
+		LOG_MSG("Attempt to read invalid sectors in Read_Sectors for sectors %lu-%lu.\n",
+			(unsigned long)sectnum,(unsigned long)(sectnum+count-1u));
+		return 0x05;
+	}
+
+	memcpy(data, map_base + image_base + bytenum, (size_t)len);
+	return 0x00;
+}
+
+Bit8u imageDiskMapped::Write_Sectors(Bit32u sectnum, Bit32u count, void * data) {
+	if (map_base == NULL)
+		return imageDisk::Write_Sectors(sectnum, count, data);
+
+	Bit64u bytenum = (Bit64u)sectnum * (Bit64u)sector_size;
+	Bit64u len = (Bit64u)count * (Bit64u)sector_size;
+	if ((bytenum + len) > image_length) {
+		LOG_MSG("Attempt to write invalid sectors in Write_Sectors for sectors %lu-%lu.\n",
+			(unsigned long)sectnum,(unsigned long)(sectnum+count-1u));
+		return 0x05;
+	}
+	if (!map_writable)
+		return 0x05;
+
+	memcpy(map_base + image_base + bytenum, data, (size_t)len);
+	return 0x00;
+}
+
+imageDiskHunk::imageDiskHunk(HunkImage *image, const char *imgName, bool isHardDisk) : imageDisk(ID_HUNK), image(image) {
+	if (imgName != NULL) diskname = imgName;
+	image_length = image->GetSize();
+	diskSizeK = image_length / 1024;
+	hardDrive = isHardDisk;
+	floppytype = 0;
+
+	/* floppies are recognized by size like raw images, hard disks get their geometry from IMGMOUNT */
+	if (!isHardDisk) {
+		for (Bit8u i=0;DiskGeometryList[i].ksize != 0;i++) {
+			if (DiskGeometryList[i].ksize == diskSizeK || DiskGeometryList[i].ksize+1 == diskSizeK) {
+				active = true;
+				floppytype = i;
+				heads = DiskGeometryList[i].headscyl;
+				cylinders = DiskGeometryList[i].cylcount;
+				sectors = DiskGeometryList[i].secttrack;
+				sector_size = DiskGeometryList[i].bytespersect;
+				LOG_MSG("Identified '%s' as C/H/S %u/%u/%u %u bytes/sector",
+					diskname.c_str(),cylinders,heads,sectors,sector_size);
+				break;
+			}
+		}
+	}
+}
+
+imageDiskHunk::~imageDiskHunk() {
+	DISKIO_Sync();
+	delete image;
+	image = NULL;
+}
+
+Bit8u imageDiskHunk::Read_AbsoluteSector(Bit32u sectnum, void * data) {
+	return Read_Sectors(sectnum, 1, data);
+}
+
+Bit8u imageDiskHunk::Write_AbsoluteSector(Bit32u /*sectnum*/, void * /*data*/) {
+	return 0x03; /* write protected */
+}
+
+Bit8u imageDiskHunk::Read_Sectors(Bit32u sectnum, Bit32u count, void * data) {
+	Bit64u bytenum = (Bit64u)sectnum * (Bit64u)sector_size;
+	Bit64u len = (Bit64u)count * (Bit64u)sector_size;
+	if ((bytenum + len) > image_length) {
+		LOG_MSG("Attempt to read invalid sectors in Read_Sectors for sectors %lu-%lu.\n",
+			(unsigned long)sectnum,(unsigned long)(sectnum+count-1u));
+		return 0x05;
+	}
+
+	return image->Read(bytenum, data, (size_t)len) ? 0x00 : 0x05;
+}
+
+Bit8u imageDiskHunk::Write_Sectors(Bit32u /*sectnum*/, Bit32u /*count*/, void * /*data*/) {
+	return 0x03; /* write protected */
+}
+
 static Bitu GetDosDriveNumber(Bitu biosNum) {
 	switch(biosNum) {
 		case 0x0:
@@ -697,7 +1381,7 @@ static bool driveInactive(Bitu driveNum) {
 	return false;
 }
 
-static struct {
+static struct DAP {
 	Bit8u sz;
 	Bit8u res;
 	Bit16u num;
@@ -725,6 +1409,34 @@ void IDE_ResetDiskByBIOS(unsigned char disk);
 void IDE_EmuINT13DiskReadByBIOS(unsigned char disk,unsigned int cyl,unsigned int head,unsigned sect);
 void IDE_EmuINT13DiskReadByBIOS_LBA(unsigned char disk,uint64_t lba);
 
+/* bounce buffers for multi-sector INT 13h transfers. int13_async_buf belongs to the
+ * transfer that is waiting on the disk I/O thread, int13_xferbuf to any INT 13h call
+ * made meanwhile from an interrupt handler */
+static Bit8u int13_xferbuf[64*512];
+static Bit8u int13_async_buf[64*512];
+static bool int13_in_transfer = false;
+
+static Bit8u *INT13_Buffer(void) {
+	return int13_in_transfer ? int13_xferbuf : int13_async_buf;
+}
+
+/* Run the transfer on the disk I/O thread and, like a real BIOS waiting on the disk
+ * controller, service interrupts until it completes. A nested INT 13h call just waits. */
+static void INT13_Transfer(DiskIORequest &req) {
+	DISKIO_Submit(&req);
+	if (int13_in_transfer) {
+		DISKIO_Wait(&req);
+		return;
+	}
+
+	/* an INT 13h extended call from an interrupt handler reads its own DAP */
+	const DAP saved_dap = dap;
+	int13_in_transfer = true;
+	while (!DISKIO_Complete(&req)) CALLBACK_Idle();
+	int13_in_transfer = false;
+	dap = saved_dap;
+}
+
 static Bitu INT13_DiskHandler(void) {
 	Bit16u segat, bufptr;
 	Bit8u sectbuf[512];
@@ -740,6 +1452,9 @@ static Bitu INT13_DiskHandler(void) {
 	// unconditionally enable the interrupt flag
 	CALLBACK_SIF(true);
 
+	/* disk images are not touched here while the disk I/O thread works on them */
+	DISKIO_Sync();
+
 	/* map out functions 0x40-0x48 if not emulating INT 13h extensions */
 	if (!int13_extensions_enable && reg_ah >= 0x40 && reg_ah <= 0x48) {
 		LOG_MSG("Warning: Guest is attempting to use INT 13h extensions (AH=0x%02X). Set 'int 13 extensions=1' if you want to enable them.\n",reg_ah);
@@ -845,22 +1560,36 @@ static Bitu INT13_DiskHandler(void) {
 		 
 		segat = SegValue(es);
 		bufptr = reg_bx;
-		for(i=0;i<reg_al;i++) {
-			last_status = imageDiskList[drivenum]->Read_Sector((Bit32u)reg_dh, (Bit32u)(reg_ch | ((reg_cl & 0xc0)<< 2)), (Bit32u)((reg_cl & 63)+i), sectbuf);
-
-			/* IDE emulation: simulate change of IDE state that would occur on a real machine after INT 13h */
-			IDE_EmuINT13DiskReadByBIOS(reg_dl, (Bit32u)(reg_ch | ((reg_cl & 0xc0)<< 2)), (Bit32u)reg_dh, (Bit32u)((reg_cl & 63)+i));
-
-			if((last_status != 0x00) || (killRead)) {
-				LOG_MSG("Error in disk read");
-				killRead = false;
-				reg_ah = 0x04;
-				CALLBACK_SCF(true);
-				return CBRET_NONE;
-			}
-			for(t=0;t<512;t++) {
-				real_writeb(segat,bufptr,sectbuf[t]);
-				bufptr++;
+		for(i=0;i<reg_al;) {
+			Bit8u *buf = INT13_Buffer();
+			DiskIORequest req;
+			req.disk = imageDiskList[drivenum];
+			req.data = buf;
+			req.chs = true;
+			req.head = (Bit32u)reg_dh;
+			req.cylinder = (Bit32u)(reg_ch | ((reg_cl & 0xc0)<< 2));
+			req.sectnum = (Bit32u)((reg_cl & 63)+i);
+			req.count = (Bit32u)std::min((Bitu)reg_al - i,(Bitu)(sizeof(int13_xferbuf) / 512));
+			req.sector_size = 512;
+			INT13_Transfer(req);
+
+			for(Bitu s=0;s < req.count;s++,i++) {
+				last_status = (s < req.completed) ? 0x00 : req.result;
+
+				/* IDE emulation: simulate change of IDE state that would occur on a real machine after INT 13h */
+				IDE_EmuINT13DiskReadByBIOS(reg_dl, (Bit32u)(reg_ch | ((reg_cl & 0xc0)<< 2)), (Bit32u)reg_dh, (Bit32u)((reg_cl & 63)+i));
+
+				if((last_status != 0x00) || (killRead)) {
+					LOG_MSG("Error in disk read");
+					killRead = false;
+					reg_ah = 0x04;
+					CALLBACK_SCF(true);
+					return CBRET_NONE;
+				}
+				for(t=0;t<512;t++) {
+					real_writeb(segat,bufptr,buf[(s*512)+t]);
+					bufptr++;
+				}
 			}
 		}
 		reg_ah = 0x00;
@@ -889,17 +1618,33 @@ static Bitu INT13_DiskHandler(void) {
         }
 		 
 		bufptr = reg_bx;
-		for(i=0;i<reg_al;i++) {
-			for(t=0;t<imageDiskList[drivenum]->getSectSize();t++) {
-				sectbuf[t] = real_readb(SegValue(es),bufptr);
-				bufptr++;
+		for(i=0;i<reg_al;) {
+			const Bitu sectsize = imageDiskList[drivenum]->getSectSize();
+			Bit8u *buf = INT13_Buffer();
+			DiskIORequest req;
+			req.disk = imageDiskList[drivenum];
+			req.data = buf;
+			req.write = true;
+			req.chs = true;
+			req.head = (Bit32u)reg_dh;
+			req.cylinder = (Bit32u)(reg_ch | ((reg_cl & 0xc0) << 2));
+			req.sectnum = (Bit32u)((reg_cl & 63) + i);
+			req.count = (Bit32u)std::min((Bitu)reg_al - i,(Bitu)(sizeof(int13_xferbuf) / 512));
+			req.sector_size = 512;
+			for(Bitu s=0;s < req.count;s++) {
+				for(t=0;t<sectsize;t++) {
+					buf[(s*512)+t] = real_readb(SegValue(es),bufptr);
+					bufptr++;
+				}
 			}
 
-			last_status = imageDiskList[drivenum]->Write_Sector((Bit32u)reg_dh, (Bit32u)(reg_ch | ((reg_cl & 0xc0) << 2)), (Bit32u)((reg_cl & 63) + i), &sectbuf[0]);
+			INT13_Transfer(req);
+			last_status = req.result;
 			if(last_status != 0x00) {
             CALLBACK_SCF(true);
 				return CBRET_NONE;
 			}
+			i += req.count;
         }
 		reg_ah = 0x00;
 		CALLBACK_SCF(false);
@@ -1083,21 +1828,38 @@ static Bitu INT13_DiskHandler(void) {
 
 		segat = dap.seg;
 		bufptr = dap.off;
-		for(i=0;i<dap.num;i++) {
-			last_status = imageDiskList[drivenum]->Read_AbsoluteSector(dap.sector+i, sectbuf);
-
-			IDE_EmuINT13DiskReadByBIOS_LBA(reg_dl,dap.sector+i);
-
-			if((last_status != 0x00) || (killRead)) {
-				LOG_MSG("Error in disk read");
-				killRead = false;
+		for(i=0;i<dap.num;) {
+			/* read as many sectors as fit in the transfer buffer in one go */
+			const Bitu sectsize = imageDiskList[drivenum]->getSectSize();
+			const Bitu n = std::min((Bitu)dap.num - i,(Bitu)(sizeof(int13_xferbuf) / sectsize));
+			if (n == 0) {
 				reg_ah = 0x04;
 				CALLBACK_SCF(true);
 				return CBRET_NONE;
 			}
-			for(t=0;t<512;t++) {
-				real_writeb(segat,bufptr,sectbuf[t]);
-				bufptr++;
+			Bit8u *buf = INT13_Buffer();
+			DiskIORequest req;
+			req.disk = imageDiskList[drivenum];
+			req.data = buf;
+			req.sectnum = (Bit32u)(dap.sector+i);
+			req.count = (Bit32u)n;
+			INT13_Transfer(req);
+			last_status = req.result;
+
+			for(Bitu s=0;s < n;s++,i++) {
+				IDE_EmuINT13DiskReadByBIOS_LBA(reg_dl,dap.sector+i);
+
+				if((last_status != 0x00) || (killRead)) {
+					LOG_MSG("Error in disk read");
+					killRead = false;
+					reg_ah = 0x04;
+					CALLBACK_SCF(true);
+					return CBRET_NONE;
+				}
+				for(t=0;t<sectsize;t++) {
+					real_writeb(segat,bufptr,buf[(s*sectsize)+t]);
+					bufptr++;
+				}
 			}
 		}
 		reg_ah = 0x00;
@@ -1113,17 +1875,32 @@ static Bitu INT13_DiskHandler(void) {
 		/* Read Disk Address Packet */
 		readDAP(SegValue(ds),reg_si);
 		bufptr = dap.off;
-		for(i=0;i<dap.num;i++) {
-			for(t=0;t<imageDiskList[drivenum]->getSectSize();t++) {
-				sectbuf[t] = real_readb(dap.seg,bufptr);
+		for(i=0;i<dap.num;) {
+			const Bitu sectsize = imageDiskList[drivenum]->getSectSize();
+			const Bitu n = std::min((Bitu)dap.num - i,(Bitu)(sizeof(int13_xferbuf) / sectsize));
+			if (n == 0) {
+				CALLBACK_SCF(true);
+				return CBRET_NONE;
+			}
+			Bit8u *buf = INT13_Buffer();
+			for(t=0;t<(n*sectsize);t++) {
+				buf[t] = real_readb(dap.seg,bufptr);
 				bufptr++;
 			}
 
-			last_status = imageDiskList[drivenum]->Write_AbsoluteSector(dap.sector+i, &sectbuf[0]);
+			DiskIORequest req;
+			req.disk = imageDiskList[drivenum];
+			req.data = buf;
+			req.write = true;
+			req.sectnum = (Bit32u)(dap.sector+i);
+			req.count = (Bit32u)n;
+			INT13_Transfer(req);
+			last_status = req.result;
 			if(last_status != 0x00) {
 				CALLBACK_SCF(true);
 				return CBRET_NONE;
 			}
+			i += n;
 		}
 		reg_ah = 0x00;
 		CALLBACK_SCF(false);
@@ -331,11 +331,7 @@ Bit8u imageDiskMemory::Write_AbsoluteSector(Bit32u sectnum, void * data) {
 			//if this is the last chunk, don't read past the end of the original image
 			if ((chunknum + 1) == this->total_chunks) sectorsToCopy = this->total_sectors - chunkFirstSector;
 			//copy the sectors
-			Bit8u* target = datalocation;
-			for (Bit32u i = 0; i < sectorsToCopy; i++) {
-				this->underlyingImage->Read_AbsoluteSector(i + chunkFirstSector, target);
-				datalocation += this->sector_size;
-			}
+			this->underlyingImage->Read_Sectors(chunkFirstSector, sectorsToCopy, datalocation);
 		}
 	}
 
@@ -347,6 +343,74 @@ Bit8u imageDiskMemory::Write_AbsoluteSector(Bit32u sectnum, void * data) {
 	return 0x00;
 }
 
+// Read consecutive sectors from the ramdrive, one copy per chunk
+Bit8u imageDiskMemory::Read_Sectors(Bit32u sectnum, Bit32u count, void * data) {
+	//verify the sector range is valid
+	if (sectnum >= total_sectors || count > (total_sectors - sectnum)) {
+		LOG_MSG("Invalid sector number in Read_Sectors for sector %lu.\n", (unsigned long)sectnum);
+		return 0x05;
+	}
+
+	Bit8u* target = (Bit8u*)data;
+	while (count > 0) {
+		Bit32u chunknum = sectnum / sectors_per_chunk;
+		Bit32u chunksect = sectnum % sectors_per_chunk;
+		Bit32u run = sectors_per_chunk - chunksect;
+		if (run > count) run = count;
+
+		Bit8u* datalocation = ChunkMap[chunknum];
+		if (datalocation == 0) {
+			//not allocated: underlying image if any, or else zeros
+			if (this->underlyingImage) {
+				if (this->underlyingImage->Read_Sectors(sectnum, run, target) != 0x00) return 0x05;
+			}
+			else {
+				memset(target, 0, run * sector_size);
+			}
+		}
+		else {
+			memcpy(target, &datalocation[chunksect * sector_size], run * sector_size);
+		}
+
+		target += run * sector_size;
+		sectnum += run;
+		count -= run;
+	}
+	return 0x00;
+}
+
+// Write consecutive sectors to the ramdrive, one copy per allocated chunk
+Bit8u imageDiskMemory::Write_Sectors(Bit32u sectnum, Bit32u count, void * data) {
+	//verify the sector range is valid
+	if (sectnum >= total_sectors || count > (total_sectors - sectnum)) {
+		LOG_MSG("Invalid sector number in Write_Sectors for sector %lu.\n", (unsigned long)sectnum);
+		return 0x05;
+	}
+
+	Bit8u* source = (Bit8u*)data;
+	while (count > 0) {
+		Bit32u chunknum = sectnum / sectors_per_chunk;
+		Bit32u chunksect = sectnum % sectors_per_chunk;
+		Bit32u run = sectors_per_chunk - chunksect;
+		if (run > count) run = count;
+
+		Bit8u* datalocation = ChunkMap[chunknum];
+		if (datalocation == NULL) {
+			//let the single sector path decide whether to allocate the chunk
+			if (Write_AbsoluteSector(sectnum, source) != 0x00) return 0x05;
+			run = 1;
+		}
+		else {
+			memcpy(&datalocation[chunksect * sector_size], source, run * sector_size);
+		}
+
+		source += run * sector_size;
+		sectnum += run;
+		count -= run;
+	}
+	return 0x00;
+}
+
 // Parition and format the ramdrive
 Bit8u imageDiskMemory::Format() {
 	//verify that the geometry of the drive is valid
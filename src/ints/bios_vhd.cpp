@@ -187,8 +187,18 @@ imageDiskVHD::ErrorCodes imageDiskVHD::Open(const char* fileName, const bool rea
 	vhd->blockMapSectors = blockMapSectors;
 	vhd->blockMapSize = blockMapSectors * 512;
 	vhd->sectorsPerBlock = sectorsPerBlock;
-	vhd->currentBlockDirtyMap = (Bit8u*)malloc(vhd->blockMapSize);
-	if (vhd->currentBlockDirtyMap == 0) { delete vhd; return INVALID_DATA; }
+	//keep the BAT in memory, every sector lookup needs it
+	vhd->blockTable.resize(dynHeader.maxTableEntries);
+	if (dynHeader.maxTableEntries) {
+		if (fseeko64(file, dynHeader.tableOffset, SEEK_SET)) { delete vhd; return INVALID_DATA; }
+		if (fread(&vhd->blockTable[0], sizeof(Bit32u), dynHeader.maxTableEntries, file) != dynHeader.maxTableEntries) { delete vhd; return INVALID_DATA; }
+		for (Bit32u i = 0; i < dynHeader.maxTableEntries; i++) vhd->blockTable[i] = SDL_SwapBE32(vhd->blockTable[i]);
+	}
+	vhd->blockMaps.resize(BLOCK_MAP_CACHE_SIZE);
+	for (size_t i = 0; i < vhd->blockMaps.size(); i++) {
+		vhd->blockMaps[i].block = 0xFFFFFFFF;
+		vhd->blockMaps[i].lastUse = 0;
+	}
 
 	//try loading the first block
 	if (!vhd->loadBlock(0)) { 
@@ -301,26 +311,7 @@ imageDiskVHD::ErrorCodes imageDiskVHD::TryOpenParent(const char* childFileName,
 }
 
 Bit8u imageDiskVHD::Read_AbsoluteSector(Bit32u sectnum, void * data) {
-	Bit32u blockNumber = sectnum / sectorsPerBlock;
-	Bit32u sectorOffset = sectnum % sectorsPerBlock;
-	if (!loadBlock(blockNumber)) return 0x05; //can't load block
-	if (currentBlockAllocated) {
-		Bit32u byteNum = sectorOffset / 8;
-		Bit32u bitNum = sectorOffset % 8;
-		bool hasData = currentBlockDirtyMap[byteNum] & (1 << (7 - bitNum));
-		if (hasData) {
-			if (fseeko64(diskimg, ((Bit64u)currentBlockSectorOffset + blockMapSectors + sectorOffset) * 512, SEEK_SET)) return 0x05; //can't seek
-			if (fread(data, sizeof(Bit8u), 512, diskimg) != 512) return 0x05; //can't read
-			return 0;
-		}
-	}
-	if (parentDisk) {
-		return parentDisk->Read_AbsoluteSector(sectnum, data);
-	}
-	else {
-		memset(data, 0, 512);
-		return 0;
-	}
+	return Read_Sectors(sectnum, 1, data);
 }
 
 Bit8u imageDiskVHD::Write_AbsoluteSector(Bit32u sectnum, void * data) {
@@ -346,8 +337,10 @@ Bit8u imageDiskVHD::Write_AbsoluteSector(Bit32u sectnum, void * data) {
 		//save the new block location and new footer position
 		Bit32u newBlockSectorNumber = (Bit32u)((footerPosition + 511) / 512);
 		footerPosition = newFooterPosition;
-		//clear the dirty flags for the new footer position
-		for (Bit32u i = 0; i < blockMapSize; i++) currentBlockDirtyMap[i] = 0;
+		//start the new block with all dirty flags clear
+		BlockMap* blockMap = getBlockMap(blockNumber, newBlockSectorNumber, true);
+		if (blockMap == NULL) return 0x05;
+		currentBlockDirtyMap = &blockMap->map[0];
 		//write the dirty map
 		if (fseeko64(diskimg, newBlockSectorNumber * 512, SEEK_SET)) return 0x05;
 		if (fwrite(currentBlockDirtyMap, sizeof(Bit8u), blockMapSize, diskimg) != blockMapSize) return 0x05;
@@ -356,7 +349,8 @@ Bit8u imageDiskVHD::Write_AbsoluteSector(Bit32u sectnum, void * data) {
 		//update the BAT
 		if (fseeko64(diskimg, dynamicHeader.tableOffset + (blockNumber * 4), SEEK_SET)) return 0x05;
 		Bit32u newBlockSectorNumberBE = SDL_SwapBE32(newBlockSectorNumber);
-		if (fwrite(&newBlockSectorNumberBE, sizeof(Bit8u), 4, diskimg) != 4) return false;
+		if (fwrite(&newBlockSectorNumberBE, sizeof(Bit8u), 4, diskimg) != 4) return 0x05;
+		blockTable[blockNumber] = newBlockSectorNumber;
 		currentBlockAllocated = true;
 		currentBlockSectorOffset = newBlockSectorNumber;
 		//flush the data to disk after allocating a block
@@ -379,6 +373,102 @@ Bit8u imageDiskVHD::Write_AbsoluteSector(Bit32u sectnum, void * data) {
 	return 0;
 }
 
+//find how many sectors starting at sectnum are all stored in this image, or all missing from it
+//a run of missing sectors may span several blocks, so the parent reads it in one call
+//a run of stored sectors ends at the block boundary and leaves its block loaded
+bool imageDiskVHD::findRun(const Bit32u sectnum, const Bit32u count, Bit32u &run, bool &hasData) {
+	Bit32u blockNumber = sectnum / sectorsPerBlock;
+	Bit32u sectorOffset = sectnum % sectorsPerBlock;
+	if (!loadBlock(blockNumber)) return false;
+	hasData = currentBlockAllocated && (currentBlockDirtyMap[sectorOffset / 8] & (1 << (7 - (sectorOffset % 8)))) != 0;
+	run = 0;
+	while (run < count) {
+		Bit32u limit = sectorsPerBlock - sectorOffset;
+		if (limit > count - run) limit = count - run;
+		Bit32u n = 0;
+		if (!currentBlockAllocated) {
+			n = limit;
+		}
+		else {
+			const Bit8u fill = hasData ? 0xFF : 0x00;
+			while (n < limit) {
+				Bit32u so = sectorOffset + n;
+				//skip whole bytes of the bitmap where possible
+				if ((so % 8) == 0 && (limit - n) >= 8 && currentBlockDirtyMap[so / 8] == fill) {
+					n += 8;
+					continue;
+				}
+				bool bit = (currentBlockDirtyMap[so / 8] & (1 << (7 - (so % 8)))) != 0;
+				if (bit != hasData) break;
+				n++;
+			}
+		}
+		run += n;
+		if (n < limit || hasData || run == count) break;
+		//missing up to the end of the block, carry on into the next one
+		blockNumber++;
+		sectorOffset = 0;
+		if (!loadBlock(blockNumber)) return false;
+	}
+	return true;
+}
+
+Bit8u imageDiskVHD::Read_Sectors(Bit32u sectnum, Bit32u count, void * data) {
+	Bit8u* buf = (Bit8u*)data;
+	while (count > 0) {
+		Bit32u n;
+		bool hasData;
+		if (!findRun(sectnum, count, n, hasData)) return 0x05; //can't load block
+		if (hasData) {
+			Bit32u sectorOffset = sectnum % sectorsPerBlock;
+			if (fseeko64(diskimg, ((Bit64u)currentBlockSectorOffset + blockMapSectors + sectorOffset) * 512, SEEK_SET)) return 0x05; //can't seek
+			if (fread(buf, sizeof(Bit8u), n * 512, diskimg) != n * 512) return 0x05; //can't read
+		}
+		else if (parentDisk) {
+			if (parentDisk->Read_Sectors(sectnum, n, buf)) return 0x05;
+		}
+		else {
+			memset(buf, 0, n * 512);
+		}
+		buf += n * 512;
+		sectnum += n;
+		count -= n;
+	}
+	return 0;
+}
+
+Bit8u imageDiskVHD::Write_Sectors(Bit32u sectnum, Bit32u count, void * data) {
+	Bit8u* buf = (Bit8u*)data;
+	while (count > 0) {
+		Bit32u sectorOffset = sectnum % sectorsPerBlock;
+		Bit32u run = sectorsPerBlock - sectorOffset;
+		if (run > count) run = count;
+		//the single sector path allocates the block if needed and marks the first sector
+		if (Write_AbsoluteSector(sectnum, buf)) return 0x05;
+		if (run > 1) {
+			//mark the rest of the run dirty with one bitmap update, then write it in one go
+			bool mapChanged = false;
+			for (Bit32u so = sectorOffset + 1; so < sectorOffset + run; so++) {
+				Bit8u mask = (Bit8u)(1 << (7 - (so % 8)));
+				if (!(currentBlockDirtyMap[so / 8] & mask)) {
+					currentBlockDirtyMap[so / 8] |= mask;
+					mapChanged = true;
+				}
+			}
+			if (mapChanged) {
+				if (fseeko64(diskimg, (Bit64u)currentBlockSectorOffset * 512, SEEK_SET)) return 0x05; //can't seek
+				if (fwrite(currentBlockDirtyMap, sizeof(Bit8u), blockMapSize, diskimg) != blockMapSize) return 0x05;
+			}
+			if (fseeko64(diskimg, ((Bit64u)currentBlockSectorOffset + blockMapSectors + sectorOffset + 1) * 512, SEEK_SET)) return 0x05; //can't seek
+			if (fwrite(buf + 512, sizeof(Bit8u), (run - 1) * 512, diskimg) != (run - 1) * 512) return 0x05; //can't write
+		}
+		buf += run * 512;
+		sectnum += run;
+		count -= run;
+	}
+	return 0;
+}
+
 imageDiskVHD::VHDTypes imageDiskVHD::GetVHDType(const char* fileName) {
 	imageDisk* disk;
 	if (Open(fileName, true, &disk)) return VHD_TYPE_NONE;
@@ -391,31 +481,54 @@ imageDiskVHD::VHDTypes imageDiskVHD::GetVHDType(const char* fileName) {
 
 bool imageDiskVHD::loadBlock(const Bit32u blockNumber) {
 	if (currentBlock == blockNumber) return true;
-	if (blockNumber >= dynamicHeader.maxTableEntries) return false;
-	if (fseeko64(diskimg, dynamicHeader.tableOffset + (blockNumber * 4), SEEK_SET)) return false;
-	Bit32u blockSectorOffset;
-	if (fread(&blockSectorOffset, sizeof(Bit8u), 4, diskimg) != 4) return false;
-	blockSectorOffset = SDL_SwapBE32(blockSectorOffset);
+	if (blockNumber >= blockTable.size()) return false;
+	Bit32u blockSectorOffset = blockTable[blockNumber];
+	currentBlock = 0xFFFFFFFF;
 	if (blockSectorOffset == 0xFFFFFFFF) {
-		currentBlock = blockNumber;
 		currentBlockAllocated = false;
 	}
 	else {
-		if (fseeko64(diskimg, blockSectorOffset * (Bit64u)512, SEEK_SET)) return false;
-		currentBlock = 0xFFFFFFFF;
+		BlockMap* blockMap = getBlockMap(blockNumber, blockSectorOffset, false);
+		if (blockMap == NULL) return false;
 		currentBlockAllocated = true;
 		currentBlockSectorOffset = blockSectorOffset;
-		if (fread(currentBlockDirtyMap, sizeof(Bit8u), blockMapSize, diskimg) != blockMapSize) return false;
-		currentBlock = blockNumber;
+		currentBlockDirtyMap = &blockMap->map[0];
 	}
+	currentBlock = blockNumber;
 	return true;
 }
 
-imageDiskVHD::~imageDiskVHD() {
-	if (currentBlockDirtyMap) {
-		free(currentBlockDirtyMap);
-		currentBlockDirtyMap = 0;
+//get the sector bitmap of an allocated block from the cache, reading it on a miss
+//fresh bitmaps belong to a block being allocated and start out clear
+imageDiskVHD::BlockMap* imageDiskVHD::getBlockMap(const Bit32u blockNumber, const Bit32u blockSectorOffset, const bool fresh) {
+	BlockMap* entry = NULL;
+	BlockMap* victim = &blockMaps[0];
+	for (size_t i = 0; i < blockMaps.size(); i++) {
+		if (blockMaps[i].block == blockNumber) {
+			entry = &blockMaps[i];
+			break;
+		}
+		if (blockMaps[i].lastUse < victim->lastUse) victim = &blockMaps[i];
 	}
+	if (entry == NULL || fresh) {
+		if (entry == NULL) entry = victim;
+		entry->block = 0xFFFFFFFF;
+		entry->map.resize(blockMapSize);
+		if (fresh) {
+			memset(&entry->map[0], 0, blockMapSize);
+		}
+		else {
+			if (fseeko64(diskimg, blockSectorOffset * (Bit64u)512, SEEK_SET)) return NULL;
+			if (fread(&entry->map[0], sizeof(Bit8u), blockMapSize, diskimg) != blockMapSize) return NULL;
+		}
+		entry->block = blockNumber;
+	}
+	entry->lastUse = ++blockMapClock;
+	return entry;
+}
+
+imageDiskVHD::~imageDiskVHD() {
+	currentBlockDirtyMap = 0;
 	if (parentDisk) {
 		parentDisk->Release();
 		parentDisk = 0;
@@ -53,7 +53,7 @@ using namespace std;
 
 
 //Public Constructor.
-	QCow2Image::QCow2Image(QCow2Image::QCow2Header qcow2Header, FILE *qcow2File, const char* imageName, Bit32u sectorSizeBytes) : file(qcow2File), header(qcow2Header), sector_size(sectorSizeBytes), backing_image(NULL)
+	QCow2Image::QCow2Image(QCow2Image::QCow2Header qcow2Header, FILE *qcow2File, const char* imageName, Bit32u sectorSizeBytes) : file(qcow2File), header(qcow2Header), sector_size(sectorSizeBytes), backing_image(NULL), cache_clock(0)
 	{
 		cluster_mask = mask64(header.cluster_bits);
 		cluster_size = cluster_mask + 1;
@@ -95,14 +95,31 @@ using namespace std;
 			}
 			delete[] backing_file_name;
 		}
+		if (0 != load_table(header.l1_table_offset, header.l1_size, l1_table)){
+			LOG_MSG("Failed to read QCow2 L1 table");
+		}
+		if (0 != load_table(header.refcount_table_offset, ((Bit64u)header.refcount_table_clusters * cluster_size) >> 3, refcount_table)){
+			LOG_MSG("Failed to read QCow2 refcount table");
+		}
+		l2_cache.resize(l2_cache_size);
+		refcount_cache.resize(refcount_cache_size);
+		const Bit64u data_cache_clusters = data_cache_bytes / cluster_size;
+		data_cache.resize(data_cache_clusters < 4 ? 4 : (size_t)data_cache_clusters);
+		for (size_t i = data_cache.size(); i > 0; i--){
+			data_cache_free.push_back(i - 1);
+		}
 	}
 
 
 //Public Destructor.
 	QCow2Image::~QCow2Image(){
+		if (0 != flush()){
+			LOG_MSG("Failed to write QCow2 metadata on close");
+		}
 		if (backing_image != NULL){
-			fclose(backing_image->file);
+			FILE* backing_file = backing_image->file;
 			delete backing_image;
+			fclose(backing_file);
 		}
 	}
 
@@ -113,21 +130,13 @@ using namespace std;
 		if (address >= header.size){
 			return 0x05;
 		}
-		Bit64u l2_table_offset;
-		if (0 != read_l1_table(address, l2_table_offset)){
+		CacheEntry* cluster = get_cached_cluster(address);
+		if (cluster == NULL){
 			return 0x05;
 		}
-		if (0 == l2_table_offset){
-			return read_unallocated_sector(sectnum, data);
-		}
-		Bit64u data_cluster_offset;
-		if (0 != read_l2_table(l2_table_offset, address, data_cluster_offset)){
-			return 0x05;
-		}
-		if (0 == data_cluster_offset){
-			return read_unallocated_sector(sectnum, data);
-		}
-		return read_allocated_data(data_cluster_offset + (address & cluster_mask), data, sector_size);
+		const Bit8u* sector = &cluster->data[address & cluster_mask];
+		std::copy(sector, sector + sector_size, data);
+		return 0;
 	}
 
 
@@ -137,61 +146,119 @@ using namespace std;
 		if (address >= header.size){
 			return 0x05;
 		}
-		Bit64u l2_table_offset;
-		if (0 != read_l1_table(address, l2_table_offset)){
+		if (0 != write_cluster_data(address, data, sector_size)){
+			flush();
 			return 0x05;
 		}
-		if (0 == l2_table_offset){
-			if (0 != pad_file(l2_table_offset)){
+		return flush();
+	}
+
+
+//Public function to read consecutive sectors. Whole clusters are read straight into the buffer, partial ones through the cluster cache.
+	Bit8u QCow2Image::read_sectors(Bit32u sectnum, Bit32u count, Bit8u* data){
+		while (count > 0){
+			const Bit64u address = (Bit64u)sectnum * sector_size;
+			if (address >= header.size){
 				return 0x05;
 			}
-			if (0 != write_l1_table_entry(address, l2_table_offset)){
-				return 0x05;
+			Bit64u run = (cluster_size - (address & cluster_mask)) / sector_size;
+			if (run == 0){
+				run = 1;
 			}
-			Bit8u* cluster_buffer = new Bit8u[cluster_size];
-			std::fill(cluster_buffer, cluster_buffer + cluster_size, 0);
-			if (0 != write_data(l2_table_offset, cluster_buffer, cluster_size)){
-				delete[] cluster_buffer;
-				return 0x05;
+			if (run > count){
+				run = count;
 			}
-			if (0 != update_reference_count(l2_table_offset, cluster_buffer)){
-				delete[] cluster_buffer;
-				return 0x05;
+			if (run * sector_size < cluster_size){
+				CacheEntry* cluster = get_cached_cluster(address);
+				if (cluster == NULL){
+					return 0x05;
+				}
+				const Bit8u* sectors = &cluster->data[address & cluster_mask];
+				std::copy(sectors, sectors + (run * sector_size), data);
 			}
-			delete[] cluster_buffer;
-		}
-		Bit64u data_cluster_offset;
-		if (0 != read_l2_table(l2_table_offset, address, data_cluster_offset)){
-			return 0x05;
+			else {
+				Bit64u l2_table_offset;
+				if (0 != read_l1_table(address, l2_table_offset)){
+					return 0x05;
+				}
+				Bit64u data_cluster_offset = 0;
+				if (0 != l2_table_offset && 0 != read_l2_table(l2_table_offset, address, data_cluster_offset)){
+					return 0x05;
+				}
+				if (0 != data_cluster_offset){
+					if (0 != read_allocated_data(data_cluster_offset + (address & cluster_mask), data, run * sector_size)){
+						return 0x05;
+					}
+				}
+				else if (backing_image != NULL){
+					if (0 != backing_image->read_sectors(sectnum, (Bit32u)run, data)){
+						return 0x05;
+					}
+				}
+				else {
+					std::fill(data, data + (run * sector_size), 0);
+				}
+			}
+			data += run * sector_size;
+			sectnum += (Bit32u)run;
+			count -= (Bit32u)run;
 		}
-		if (data_cluster_offset == 0){
-			if (0 != pad_file(data_cluster_offset)){
+		return 0;
+	}
+
+
+//Public function to write consecutive sectors, one piece per cluster. Metadata changes are flushed once at the end.
+	Bit8u QCow2Image::write_sectors(Bit32u sectnum, Bit32u count, Bit8u* data){
+		while (count > 0){
+			const Bit64u address = (Bit64u)sectnum * sector_size;
+			if (address >= header.size){
+				flush();
 				return 0x05;
 			}
-			if (0 != write_l2_table_entry(l2_table_offset, address, data_cluster_offset)){
-				return 0x05;
+			Bit64u run = (cluster_size - (address & cluster_mask)) / sector_size;
+			if (run == 0){
+				run = 1;
 			}
-			Bit8u* cluster_buffer = new Bit8u[cluster_size];
-			if ( 0 != read_unallocated_cluster(address/cluster_size, cluster_buffer)){
-				delete[] cluster_buffer;
-				return 0x05;
+			if (run > count){
+				run = count;
 			}
-			const Bit64u cluster_buffer_sector_offset = address & cluster_mask;
-			for (Bit64u i = 0; i < sector_size; i++){
-				cluster_buffer[cluster_buffer_sector_offset + i] = data[i];
+			if (0 != write_cluster_data(address, data, run * sector_size)){
+				flush();
+				return 0x05;
 			}
-			if (0 != write_data(data_cluster_offset, cluster_buffer, cluster_size)){
-				delete[] cluster_buffer;
+			data += run * sector_size;
+			sectnum += (Bit32u)run;
+			count -= (Bit32u)run;
+		}
+		return flush();
+	}
+
+
+//Public function to write out cached metadata. Each step only points to clusters whose
+//contents and refcounts are already in the file, so a write that is cut short leaks clusters
+//at worst instead of corrupting the image.
+	Bit8u QCow2Image::flush(){
+		if (0 != write_tables(refcount_cache)){
+			return 0x05;
+		}
+		while (!refcount_table_dirty.empty()){
+			const Bit64u index = *refcount_table_dirty.begin();
+			if (0 != write_table_entry(header.refcount_table_offset + (index << 3), host_read64(refcount_table[index]))){
 				return 0x05;
 			}
-			if (0 != update_reference_count(data_cluster_offset, cluster_buffer)){
-				delete[] cluster_buffer;
+			refcount_table_dirty.erase(refcount_table_dirty.begin());
+		}
+		if (0 != write_tables(l2_cache)){
+			return 0x05;
+		}
+		while (!l1_dirty.empty()){
+			const Bit64u index = *l1_dirty.begin();
+			if (0 != write_table_entry(header.l1_table_offset + (index << 3), host_read64(l1_table[index]))){
 				return 0x05;
 			}
-			delete[] cluster_buffer;
-			return 0;
+			l1_dirty.erase(l1_dirty.begin());
 		}
-		return write_data(data_cluster_offset + (address & cluster_mask), data, sector_size);
+		return 0;
 	}
 
 
@@ -199,6 +266,9 @@ using namespace std;
 	const Bit64u QCow2Image::copy_flag = 0x8000000000000000ULL;
 	const Bit64u QCow2Image::empty_mask = 0xFFFFFFFFFFFFFFFFULL;
 	const Bit64u QCow2Image::table_entry_mask = 0x00FFFFFFFFFFFFFFULL;
+	const Bitu QCow2Image::l2_cache_size = 16;
+	const Bitu QCow2Image::refcount_cache_size = 4;
+	const Bit64u QCow2Image::data_cache_bytes = 1024 * 1024;
 
 
 //Helper functions for endianness. QCOW format is big endian so we need different functions than those defined in mem.h.
@@ -250,6 +320,120 @@ using namespace std;
 	}
 
 
+//Append a cluster to the image file, filled with the given contents or zeros, and count a reference to it.
+	Bit8u QCow2Image::allocate_cluster(Bit64u& cluster_offset, const Bit8u* contents){
+		if (0 != pad_file(cluster_offset)){
+			return 0x05;
+		}
+		Bit8u result;
+		if (contents != NULL){
+			result = write_data(cluster_offset, (Bit8u*)contents, cluster_size);
+		} else {
+			std::vector<Bit8u> zeros(cluster_size, 0);
+			result = write_data(cluster_offset, &zeros[0], cluster_size);
+		}
+		if (0 != result){
+			return 0x05;
+		}
+		return update_reference_count(cluster_offset);
+	}
+
+
+//Look up a cache entry. Returns the entry holding key, or else the least recently used entry to replace.
+	QCow2Image::CacheEntry* QCow2Image::find_cache_entry(std::vector<CacheEntry>& cache, Bit64u key){
+		CacheEntry* victim = &cache[0];
+		for (size_t i = 0; i < cache.size(); i++){
+			if (cache[i].key == key){
+				cache[i].last_use = ++cache_clock;
+				return &cache[i];
+			}
+			if (cache[i].last_use < victim->last_use){
+				victim = &cache[i];
+			}
+		}
+		return victim;
+	}
+
+
+//Get the contents of the guest cluster holding address, wherever they come from. The data
+//cache is too large to scan like the table caches, it is indexed by cluster number and LRU order.
+	QCow2Image::CacheEntry* QCow2Image::get_cached_cluster(Bit64u address){
+		const Bit64u data_cluster_number = address >> header.cluster_bits;
+		std::map<Bit64u, size_t>::iterator found = data_cache_index.find(data_cluster_number);
+		if (found != data_cache_index.end()){
+			touch_cached_cluster(found->second);
+			return &data_cache[found->second];
+		}
+		size_t slot;
+		if (!data_cache_free.empty()){
+			slot = data_cache_free.back();
+			data_cache_free.pop_back();
+		} else {
+			slot = data_cache_lru.begin()->second;
+			data_cache_lru.erase(data_cache_lru.begin());
+			data_cache_index.erase(data_cache[slot].key);
+		}
+		CacheEntry* entry = &data_cache[slot];
+		entry->key = empty_mask;
+		entry->data.resize(cluster_size);
+		if (0 != read_cluster(data_cluster_number, &entry->data[0])){
+			data_cache_free.push_back(slot);
+			return NULL;
+		}
+		entry->key = data_cluster_number;
+		entry->last_use = ++cache_clock;
+		data_cache_index[data_cluster_number] = slot;
+		data_cache_lru[entry->last_use] = slot;
+		return entry;
+	}
+
+
+//Make a data cache slot the most recently used.
+	void QCow2Image::touch_cached_cluster(size_t slot){
+		CacheEntry& entry = data_cache[slot];
+		data_cache_lru.erase(entry.last_use);
+		entry.last_use = ++cache_clock;
+		data_cache_lru[entry.last_use] = slot;
+	}
+
+
+//Get an L2 table or refcount block. Fresh tables were just allocated and start out zeroed.
+	QCow2Image::CacheEntry* QCow2Image::get_table(std::vector<CacheEntry>& cache, Bit64u table_offset, bool fresh){
+		CacheEntry* entry = find_cache_entry(cache, table_offset);
+		if (entry->key == table_offset){
+			return entry;
+		}
+		//replacing a table with pending changes writes out everything, in order
+		if (entry->dirty_end != 0 && 0 != flush()){
+			return NULL;
+		}
+		entry->key = empty_mask;
+		entry->data.resize(cluster_size);
+		if (fresh){
+			std::fill(entry->data.begin(), entry->data.end(), 0);
+		} else if (0 != read_allocated_data(table_offset, &entry->data[0], cluster_size)){
+			return NULL;
+		}
+		entry->key = table_offset;
+		entry->last_use = ++cache_clock;
+		return entry;
+	}
+
+
+//Read a whole table of 64 bit entries, kept in file byte order.
+	Bit8u QCow2Image::load_table(Bit64u offset, Bit64u entries, std::vector<Bit64u>& table){
+		table.resize((size_t)entries);
+		if (entries == 0){
+			return 0;
+		}
+		if (0 != read_allocated_data(offset, (Bit8u*)&table[0], entries << 3)){
+			table.clear();
+			return 0x05;
+		}
+		return 0;
+	}
+
+
 //Pad a file with zeros if it doesn't end on a cluster boundary.
 	Bit8u QCow2Image::pad_file(Bit64u& new_file_length){
 		if (0 != fseeko64(file, 0, SEEK_END)){
@@ -307,34 +491,39 @@ using namespace std;
 	}
 
 
-//Read the L1 table to get the offset of the L2 table for a given address.
+//Get the offset of the L2 table for a given address from the L1 table.
 	inline Bit8u QCow2Image::read_l1_table(Bit64u address, Bit64u& l2_table_offset){
-		const Bit64u l1_entry_offset = header.l1_table_offset + ((address >> l1_bits) << 3);
-		return read_table(l1_entry_offset, table_entry_mask, l2_table_offset);
+		const Bit64u l1_index = address >> l1_bits;
+		if (l1_index >= l1_table.size()){
+			return 0x05;
+		}
+		l2_table_offset = host_read64(l1_table[(size_t)l1_index]) & table_entry_mask;
+		return 0;
 	}
 
 
 //Read an L2 table to get the offset of the data cluster for a given address.
 	inline Bit8u QCow2Image::read_l2_table(Bit64u l2_table_offset, Bit64u address, Bit64u& data_cluster_offset){
-		const Bit64u l2_entry_offset = l2_table_offset + (((address >> header.cluster_bits) & l2_mask) << 3);
-		return read_table(l2_entry_offset, table_entry_mask, data_cluster_offset);
+		CacheEntry* table = get_table(l2_cache, l2_table_offset, false);
+		if (table == NULL){
+			return 0x05;
+		}
+		const Bit64u l2_entry_offset = ((address >> header.cluster_bits) & l2_mask) << 3;
+		Bit64u buffer;
+		std::copy(&table->data[l2_entry_offset], &table->data[l2_entry_offset] + sizeof buffer, (Bit8u*)&buffer);
+		data_cluster_offset = host_read64(buffer) & table_entry_mask;
+		return 0;
 	}
 
 
-//Read the refcount table to get the offset of the refcount cluster for a given address.
+//Get the offset of the refcount cluster for a given address from the refcount table.
 	inline Bit8u QCow2Image::read_refcount_table(Bit64u data_cluster_offset, Bit64u& refcount_cluster_offset){
-		const Bit64u refcount_entry_offset = header.refcount_table_offset + (((data_cluster_offset/cluster_size) >> refcount_bits) << 3);
-		return read_table(refcount_entry_offset, empty_mask, refcount_cluster_offset);
-	}
-
-
-//Read a table entry at the given offset.
-	inline Bit8u QCow2Image::read_table(Bit64u entry_offset, Bit64u entry_mask, Bit64u& entry_value){
-		Bit64u buffer;
-		if (0 != read_allocated_data(entry_offset, (Bit8u*)&buffer, sizeof buffer)){
+		const Bit64u refcount_index = (data_cluster_offset/cluster_size) >> refcount_bits;
+		if (refcount_index >= refcount_table.size()){
+			LOG_MSG("QCow2 image needs a larger refcount table than it has");
 			return 0x05;
 		}
-		entry_value = host_read64(buffer) & table_entry_mask;
+		refcount_cluster_offset = host_read64(refcount_table[(size_t)refcount_index]) & table_entry_mask;
 		return 0;
 	}
 
@@ -346,33 +535,37 @@ using namespace std;
 			std::fill(data, data + cluster_size, 0);
 			return 0;
 		}
-		return backing_image->read_cluster(data_cluster_number, data);
-	}
-
-
-//Read a sector not currently allocated in the image file.
-	inline Bit8u QCow2Image::read_unallocated_sector(Bit32u sectnum, Bit8u* data){
-		if(backing_image == NULL){
-			std::fill(data, data+sector_size, 0);
+		//go by sectors, the backing image may use a different cluster size
+		const Bit64u address = data_cluster_number * cluster_size;
+		Bit64u count = sectors_per_cluster;
+		if (address + cluster_size > header.size){
+			count = (header.size - address) / sector_size;
+			std::fill(data + (count * sector_size), data + cluster_size, 0);
+		}
+		if (count == 0){
 			return 0;
 		}
-		return backing_image->read_sector(sectnum, data);
+		return backing_image->read_sectors((Bit32u)(address / sector_size), (Bit32u)count, data);
 	}
 
+
 //Update the reference count for a cluster.
-	Bit8u QCow2Image::update_reference_count(Bit64u cluster_offset, Bit8u* cluster_buffer){
+	Bit8u QCow2Image::update_reference_count(Bit64u cluster_offset){
 		Bit64u refcount_cluster_offset;
 		if (0 != read_refcount_table(cluster_offset, refcount_cluster_offset)){
 			return 0x05;
 		}
 		if (0 == refcount_cluster_offset){
 			refcount_cluster_offset = cluster_offset + cluster_size;
-			std::fill(cluster_buffer, cluster_buffer + cluster_size, 0);
-			if (0 != write_refcount_table_entry(cluster_offset, refcount_cluster_offset)){
+			std::vector<Bit8u> zeros(cluster_size, 0);
+			if (0 != write_data(refcount_cluster_offset, &zeros[0], cluster_size)){
 				return 0x05;
 			}
-			if (0 != write_data(refcount_cluster_offset, cluster_buffer, cluster_size)){
-			return 0x05;
+			if (NULL == get_table(refcount_cache, refcount_cluster_offset, true)){
+				return 0x05;
+			}
+			if (0 != write_refcount_table_entry(cluster_offset, refcount_cluster_offset)){
+				return 0x05;
 			}
 			if (0 != write_refcount(refcount_cluster_offset, refcount_cluster_offset, 0x1)){
 				return 0x05;
@@ -385,6 +578,71 @@ using namespace std;
 	}
 
 
+//Keep a cached copy of a guest cluster in step with data written to it.
+	void QCow2Image::update_cached_cluster(Bit64u address, const Bit8u* data, Bit64u data_size){
+		std::map<Bit64u, size_t>::iterator found = data_cache_index.find(address >> header.cluster_bits);
+		if (found != data_cache_index.end()){
+			std::copy(data, data + data_size, &data_cache[found->second].data[address & cluster_mask]);
+		}
+	}
+
+
+//Write data within one cluster, allocating the cluster and its L2 table if needed.
+	Bit8u QCow2Image::write_cluster_data(Bit64u address, Bit8u* data, Bit64u data_size){
+		Bit64u l2_table_offset;
+		if (0 != read_l1_table(address, l2_table_offset)){
+			return 0x05;
+		}
+		if (0 == l2_table_offset){
+			if (0 != allocate_cluster(l2_table_offset, NULL)){
+				return 0x05;
+			}
+			if (NULL == get_table(l2_cache, l2_table_offset, true)){
+				return 0x05;
+			}
+			if (0 != write_l1_table_entry(address, l2_table_offset)){
+				return 0x05;
+			}
+		}
+		Bit64u data_cluster_offset;
+		if (0 != read_l2_table(l2_table_offset, address, data_cluster_offset)){
+			return 0x05;
+		}
+		if (0 != data_cluster_offset){
+			if (0 != write_data(data_cluster_offset + (address & cluster_mask), data, data_size)){
+				return 0x05;
+			}
+		}
+		else if (data_size == cluster_size){
+			if (0 != allocate_cluster(data_cluster_offset, data)){
+				return 0x05;
+			}
+			if (0 != write_l2_table_entry(l2_table_offset, address, data_cluster_offset)){
+				return 0x05;
+			}
+		}
+		else {
+			//merge the new data into what the cluster read as so far
+			Bit8u* cluster_buffer = new Bit8u[cluster_size];
+			if (0 != read_unallocated_cluster(address >> header.cluster_bits, cluster_buffer)){
+				delete[] cluster_buffer;
+				return 0x05;
+			}
+			std::copy(data, data + data_size, cluster_buffer + (address & cluster_mask));
+			const Bit8u result = allocate_cluster(data_cluster_offset, cluster_buffer);
+			delete[] cluster_buffer;
+			if (0 != result){
+				return 0x05;
+			}
+			if (0 != write_l2_table_entry(l2_table_offset, address, data_cluster_offset)){
+				return 0x05;
+			}
+		}
+		update_cached_cluster(address, data, data_size);
+		return 0;
+	}
+
+
 //Write data of arbitrary length to the image file.
 	Bit8u QCow2Image::write_data(Bit64u file_offset, Bit8u* data, Bit64u data_size){
 		if (0 != fseeko64(file, file_offset, SEEK_SET)){
@@ -397,32 +655,55 @@ using namespace std;
 	}
 
 
-//Write an L2 table offset into the L1 table.
+//Put an L2 table offset into the L1 table, written out on the next flush.
 	inline Bit8u QCow2Image::write_l1_table_entry(Bit64u address, Bit64u l2_table_offset){
-		const Bit64u l1_entry_offset = header.l1_table_offset + ((address >> l1_bits) << 3);
-		return write_table_entry(l1_entry_offset, l2_table_offset | copy_flag);
+		const Bit64u l1_index = address >> l1_bits;
+		if (l1_index >= l1_table.size()){
+			return 0x05;
+		}
+		l1_table[(size_t)l1_index] = host_read64(l2_table_offset | copy_flag);
+		l1_dirty.insert(l1_index);
+		return 0;
 	}
 
 
-//Write a data cluster offset into an L2 table.
+//Put a data cluster offset into an L2 table, written out on the next flush.
 	inline Bit8u QCow2Image::write_l2_table_entry(Bit64u l2_table_offset, Bit64u address, Bit64u data_cluster_offset){
-		const Bit64u l2_entry_offset = l2_table_offset + (((address >> header.cluster_bits) & l2_mask) << 3);
-		return write_table_entry(l2_entry_offset, data_cluster_offset | copy_flag);
+		CacheEntry* table = get_table(l2_cache, l2_table_offset, false);
+		if (table == NULL){
+			return 0x05;
+		}
+		const Bit64u l2_entry_offset = ((address >> header.cluster_bits) & l2_mask) << 3;
+		Bit64u buffer = host_read64(data_cluster_offset | copy_flag);
+		std::copy((Bit8u*)&buffer, (Bit8u*)&buffer + sizeof buffer, &table->data[l2_entry_offset]);
+		table->set_dirty(l2_entry_offset, sizeof buffer);
+		return 0;
 	}
 
 
-//Write a refcount.
+//Set a refcount, written out on the next flush.
 	inline Bit8u QCow2Image::write_refcount(Bit64u cluster_offset, Bit64u refcount_cluster_offset, Bit16u refcount){
-		const Bit64u refcount_offset = refcount_cluster_offset + (((cluster_offset/cluster_size) & refcount_mask) << 1);
+		CacheEntry* block = get_table(refcount_cache, refcount_cluster_offset, false);
+		if (block == NULL){
+			return 0x05;
+		}
+		const Bit64u refcount_offset = ((cluster_offset/cluster_size) & refcount_mask) << 1;
 		Bit16u buffer = host_read16(refcount);
-		return write_data(refcount_offset, (Bit8u*)&buffer, sizeof buffer);
+		std::copy((Bit8u*)&buffer, (Bit8u*)&buffer + sizeof buffer, &block->data[refcount_offset]);
+		block->set_dirty(refcount_offset, sizeof buffer);
+		return 0;
 	}
 
 
-//Write a refcount table entry.
+//Put a refcount cluster offset into the refcount table, written out on the next flush.
 	inline Bit8u QCow2Image::write_refcount_table_entry(Bit64u cluster_offset, Bit64u refcount_cluster_offset){
-		const Bit64u refcount_entry_offset = header.refcount_table_offset + (((cluster_offset/cluster_size) >> refcount_bits) << 3);
-		return write_table_entry(refcount_entry_offset, refcount_cluster_offset);
+		const Bit64u refcount_index = (cluster_offset/cluster_size) >> refcount_bits;
+		if (refcount_index >= refcount_table.size()){
+			return 0x05;
+		}
+		refcount_table[(size_t)refcount_index] = host_read64(refcount_cluster_offset);
+		refcount_table_dirty.insert(refcount_index);
+		return 0;
 	}
 
 
@@ -433,6 +714,23 @@ using namespace std;
 	}
 
 
+//Write the changed part of every dirty table in a cache.
+	Bit8u QCow2Image::write_tables(std::vector<CacheEntry>& cache){
+		for (size_t i = 0; i < cache.size(); i++){
+			CacheEntry& entry = cache[i];
+			if (entry.dirty_end == 0){
+				continue;
+			}
+			if (0 != write_data(entry.key + entry.dirty_start, &entry.data[entry.dirty_start], entry.dirty_end - entry.dirty_start)){
+				return 0x05;
+			}
+			entry.dirty_start = 0;
+			entry.dirty_end = 0;
+		}
+		return 0;
+	}
+
+
 //Public Constructor.
 	QCow2Disk::QCow2Disk(QCow2Image::QCow2Header qcow2Header, FILE *qcow2File, Bit8u *imgName, Bit32u imgSizeK, Bit32u sectorSizeBytes, bool isHardDisk) : imageDisk(qcow2File, imgName, imgSizeK, isHardDisk), qcowImage(qcow2Header, qcow2File, (const char*) imgName, sectorSizeBytes){
 	}
@@ -440,6 +738,7 @@ using namespace std;
 
 //Public Destructor.
 	QCow2Disk::~QCow2Disk(){
+		DISKIO_Sync();
 	}
 
 
@@ -453,3 +752,15 @@ using namespace std;
 	Bit8u QCow2Disk::Write_AbsoluteSector(Bit32u sectnum, void* data){
 		return qcowImage.write_sector(sectnum, (Bit8u*)data);
 	}
+
+
+//Public function to read consecutive sectors.
+	Bit8u QCow2Disk::Read_Sectors(Bit32u sectnum, Bit32u count, void* data){
+		return qcowImage.read_sectors(sectnum, count, (Bit8u*)data);
+	}
+
+
+//Public function to write consecutive sectors.
+	Bit8u QCow2Disk::Write_Sectors(Bit32u sectnum, Bit32u count, void* data){
+		return qcowImage.write_sectors(sectnum, count, (Bit8u*)data);
+	}
@@ -277,7 +277,11 @@ dir_information* open_directory(const char* dirname) {
 	return dir.dir?&dir:NULL;
 }
 
-bool read_directory_first(dir_information* dirp, char* entry_name, bool& is_directory) {
+/* readdir() already fetches entries in batches (getdents64 on Linux), so the cost per entry
+ * is in finding out whether it is a directory. d_type answers that for free on most file
+ * systems; only when it can't (DT_UNKNOWN, symlinks) is the entry stat()ed, relative to the
+ * open directory so the kernel doesn't walk the whole path again. */
+static bool read_directory_entry(dir_information* dirp, char* entry_name, bool& is_directory) {
 	struct dirent* dentry = readdir(dirp->dir);
 	if (dentry==NULL) {
 		return false;
@@ -296,48 +300,28 @@ bool read_directory_first(dir_information* dirp, char* entry_name, bool& is_dire
 	}
 #endif
 
-	// probably use d_type here instead of a full stat()
+	struct stat status;
+#if defined(C_HAVE_FSTATAT)
+	if (fstatat(dirfd(dirp->dir),dentry->d_name,&status,0)==0) is_directory = (S_ISDIR(status.st_mode)>0);
+	else is_directory = false;
+#else
 	static char buffer[2*CROSS_LEN] = { 0 };
 	buffer[0] = 0;
 	strcpy(buffer,dirp->base_path);
 	strcat(buffer,entry_name);
-	struct stat status;
 	if (stat(buffer,&status)==0) is_directory = (S_ISDIR(status.st_mode)>0);
 	else is_directory = false;
+#endif
 
 	return true;
 }
 
-bool read_directory_next(dir_information* dirp, char* entry_name, bool& is_directory) {
-	struct dirent* dentry = readdir(dirp->dir);
-	if (dentry==NULL) {
-		return false;
-	}
-
-//	safe_strncpy(entry_name,dentry->d_name,(FILENAME_MAX<MAX_PATH)?FILENAME_MAX:MAX_PATH);	// [include stdio.h], maybe pathconf()
-	safe_strncpy(entry_name,dentry->d_name,CROSS_LEN);
-
-#ifdef DIRENT_HAS_D_TYPE
-	if(dentry->d_type == DT_DIR) {
-		is_directory = true;
-		return true;
-	} else if(dentry->d_type == DT_REG) {
-		is_directory = false;
-		return true;
-	}
-#endif
-
-	// probably use d_type here instead of a full stat()
-	static char buffer[2*CROSS_LEN] = { 0 };
-	buffer[0] = 0;
-	strcpy(buffer,dirp->base_path);
-	strcat(buffer,entry_name);
-	struct stat status;
-
-	if (stat(buffer,&status)==0) is_directory = (S_ISDIR(status.st_mode)>0);
-	else is_directory = false;
+bool read_directory_first(dir_information* dirp, char* entry_name, bool& is_directory) {
+	return read_directory_entry(dirp,entry_name,is_directory);
+}
 
-	return true;
+bool read_directory_next(dir_information* dirp, char* entry_name, bool& is_directory) {
+	return read_directory_entry(dirp,entry_name,is_directory);
 }
 
 void close_directory(dir_information* dirp) {
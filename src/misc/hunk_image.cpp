@@ -0,0 +1,311 @@
+/*
+ *  Copyright (C) 2002-2015  The DOSBox Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <string.h>
+#include "dosbox.h"
+#include "mem.h"
+#include "dos_inc.h"
+#include "hunk_image.h"
+
+#if defined(C_ZLIB)
+#include <zlib.h>
+#endif
+
+const char HunkImage::magic[8] = { 'H','U','N','K','I','M','G',0x1a };
+const Bit32u HunkImage::version;
+const Bit32u HunkImage::header_size;
+const Bit32u HunkImage::index_entry_size;
+const Bit32u HunkImage::min_hunk_size;
+const Bit32u HunkImage::max_hunk_size;
+const Bitu HunkImage::cache_hunks;
+
+bool HunkImage::IsHunkImage(FILE *f) {
+	char tmp[8];
+
+	if (f == NULL || fseeko64(f,0,SEEK_SET) != 0) return false;
+	if (fread(tmp,sizeof(tmp),1,f) != 1) return false;
+	return !memcmp(tmp,magic,sizeof(magic));
+}
+
+HunkImage::HunkImage(FILE *f) : file(f), file_size(0), size(0), hunk_size(0), cacheClock(0) {
+}
+
+HunkImage::~HunkImage() {
+	if (file != NULL) {
+		fclose(file);
+		file = NULL;
+	}
+}
+
+HunkImage* HunkImage::Open(FILE *f) {
+	Bit8u hdr[header_size];
+
+	if (f == NULL) return NULL;
+
+	HunkImage *img = new HunkImage(f);
+	if (fseeko64(f,0,SEEK_END) != 0) {
+		delete img;
+		return NULL;
+	}
+	img->file_size = (Bit64u)ftello64(f);
+
+	if (fseeko64(f,0,SEEK_SET) != 0 || fread(hdr,sizeof(hdr),1,f) != 1 || memcmp(hdr,magic,sizeof(magic))) {
+		delete img;
+		return NULL;
+	}
+	if (host_readd(hdr+8) != version) {
+		LOG_MSG("Hunk image: unsupported version %u",(unsigned int)host_readd(hdr+8));
+		delete img;
+		return NULL;
+	}
+
+	img->hunk_size = host_readd(hdr+12);
+	img->size = host_readq(hdr+16);
+	Bit32u hunk_count = host_readd(hdr+24);
+	Bit64u index_offset = host_readq(hdr+32);
+
+	if (img->hunk_size < min_hunk_size || img->hunk_size > max_hunk_size ||
+		hunk_count != (Bit32u)((img->size + img->hunk_size - 1) / img->hunk_size) ||
+		!img->ReadIndex(index_offset,hunk_count)) {
+		LOG_MSG("Hunk image: invalid header or index");
+		delete img;
+		return NULL;
+	}
+
+	img->cache.resize(cache_hunks);
+	for (Bitu i=0;i < img->cache.size();i++) {
+		img->cache[i].hunk = 0xFFFFFFFFu;
+		img->cache[i].lastUse = 0;
+	}
+	return img;
+}
+
+bool HunkImage::ReadIndex(Bit64u index_offset, Bit32u hunk_count) {
+	Bit64u index_len = (Bit64u)hunk_count * index_entry_size;
+	if (index_offset < header_size || index_offset > file_size || index_len > (file_size - index_offset))
+		return false;
+
+	std::vector<Bit8u> raw((size_t)index_len);
+	if (hunk_count != 0 && (fseeko64(file,index_offset,SEEK_SET) != 0 ||
+		fread(&raw[0],(size_t)index_len,1,file) != 1))
+		return false;
+
+	index.resize(hunk_count);
+	for (Bit32u i=0;i < hunk_count;i++) {
+		const Bit8u *p = &raw[(size_t)i * index_entry_size];
+		IndexEntry &ent = index[i];
+
+		ent.offset = host_readq(p);
+		ent.length = host_readd(p+8);
+		ent.type = host_readd(p+12);
+
+		/* validate once here so the read path does not have to */
+		switch (ent.type) {
+			case HUNK_ZERO:
+				break;
+			case HUNK_STORED:
+				if (ent.length != hunk_size) return false;
+				/* fall through */
+			case HUNK_ZLIB:
+				if (ent.length == 0 || ent.offset < header_size || ent.offset > file_size ||
+					ent.length > (file_size - ent.offset))
+					return false;
+				break;
+			default:
+				LOG_MSG("Hunk image: hunk %u has unknown type %u",(unsigned int)i,(unsigned int)ent.type);
+				return false;
+		}
+	}
+	return true;
+}
+
+bool HunkImage::Decompress(const IndexEntry &ent, Bit8u *dst) {
+	if (ent.type == HUNK_STORED)
+		return fseeko64(file,ent.offset,SEEK_SET) == 0 && fread(dst,hunk_size,1,file) == 1;
+
+#if defined(C_ZLIB)
+	if (compBuffer.size() < ent.length) compBuffer.resize(ent.length);
+	if (fseeko64(file,ent.offset,SEEK_SET) != 0 || fread(&compBuffer[0],ent.length,1,file) != 1)
+		return false;
+
+	uLongf dlen = hunk_size;
+	if (uncompress(dst,&dlen,&compBuffer[0],ent.length) != Z_OK || dlen != hunk_size) {
+		LOG_MSG("Hunk image: corrupt compressed hunk at offset %llu",(unsigned long long)ent.offset);
+		return false;
+	}
+	return true;
+#else
+	LOG_MSG("Hunk image: compressed hunk, but zlib support was not compiled in");
+	return false;
+#endif
+}
+
+const Bit8u* HunkImage::GetHunk(Bit32u hunk) {
+	std::map<Bit32u,Bitu>::iterator it = cacheIndex.find(hunk);
+	if (it != cacheIndex.end()) {
+		CacheSlot &slot = cache[it->second];
+		slot.lastUse = ++cacheClock;
+		return &slot.data[0];
+	}
+
+	/* evict the least recently used slot */
+	Bitu victim = 0;
+	for (Bitu i=1;i < cache.size();i++) {
+		if (cache[i].lastUse < cache[victim].lastUse) victim = i;
+	}
+
+	CacheSlot &slot = cache[victim];
+	if (slot.hunk != 0xFFFFFFFFu) {
+		cacheIndex.erase(slot.hunk);
+		slot.hunk = 0xFFFFFFFFu;
+	}
+	if (slot.data.size() != hunk_size) slot.data.resize(hunk_size);
+	if (!Decompress(index[hunk],&slot.data[0])) {
+		slot.lastUse = 0;
+		return NULL;
+	}
+
+	slot.hunk = hunk;
+	slot.lastUse = ++cacheClock;
+	cacheIndex[hunk] = victim;
+	return &slot.data[0];
+}
+
+bool HunkImage::Read(Bit64u offset, void *data, size_t len) {
+	Bit8u *dst = (Bit8u*)data;
+
+	if (offset > size || (Bit64u)len > (size - offset)) return false;
+
+	while (len > 0) {
+		Bit32u hunk = (Bit32u)(offset / hunk_size);
+		Bit32u within = (Bit32u)(offset % hunk_size);
+		size_t chunk = hunk_size - within;
+		if (chunk > len) chunk = len;
+
+		const IndexEntry &ent = index[hunk];
+		if (ent.type == HUNK_ZERO) {
+			memset(dst,0,chunk);
+		}
+		else if (ent.type == HUNK_STORED) {
+			/* uncompressed hunks are read straight into the caller's buffer */
+			if (fseeko64(file,(ent.offset + within),SEEK_SET) != 0 || fread(dst,chunk,1,file) != 1)
+				return false;
+		}
+		else {
+			const Bit8u *src = GetHunk(hunk);
+			if (src == NULL) return false;
+			memcpy(dst,src + within,chunk);
+		}
+
+		dst += chunk;
+		offset += chunk;
+		len -= chunk;
+	}
+	return true;
+}
+
+HunkImageWriter::HunkImageWriter() : file(NULL), size(0), hunk_size(0), hunk_count(0), data_end(0) {
+}
+
+HunkImageWriter::~HunkImageWriter() {
+	if (file != NULL) fclose(file);
+}
+
+bool HunkImageWriter::Create(const char *filename, Bit64u size, Bit32u hunk_size) {
+	if (file != NULL || hunk_size < HunkImage::min_hunk_size || hunk_size > HunkImage::max_hunk_size)
+		return false;
+
+	file = fopen64(filename,"wb");
+	if (file == NULL) return false;
+
+	this->size = size;
+	this->hunk_size = hunk_size;
+	hunk_count = 0;
+	index.clear();
+
+	/* the header is written last, once the index offset is known */
+	Bit8u hdr[HunkImage::header_size];
+	memset(hdr,0,sizeof(hdr));
+	if (fwrite(hdr,sizeof(hdr),1,file) != 1) return false;
+	data_end = HunkImage::header_size;
+	return true;
+}
+
+bool HunkImageWriter::AddHunk(const Bit8u *data) {
+	if (file == NULL) return false;
+
+	Bit8u ent[HunkImage::index_entry_size];
+	Bit32u type = HunkImage::HUNK_ZERO;
+	Bit32u length = 0;
+	const Bit8u *out = data;
+
+	for (Bit32u i=0;i < hunk_size;i++) {
+		if (data[i] != 0) {
+			type = HunkImage::HUNK_STORED;
+			length = hunk_size;
+			break;
+		}
+	}
+
+#if defined(C_ZLIB)
+	if (type == HunkImage::HUNK_STORED) {
+		uLongf clen = compressBound(hunk_size);
+		if (compBuffer.size() < clen) compBuffer.resize(clen);
+		if (compress2(&compBuffer[0],&clen,data,hunk_size,Z_BEST_COMPRESSION) == Z_OK && clen < hunk_size) {
+			type = HunkImage::HUNK_ZLIB;
+			length = (Bit32u)clen;
+			out = &compBuffer[0];
+		}
+	}
+#endif
+
+	host_writeq(ent,(type == HunkImage::HUNK_ZERO) ? 0 : data_end);
+	host_writed(ent+8,length);
+	host_writed(ent+12,type);
+	index.insert(index.end(),ent,ent+sizeof(ent));
+
+	if (length != 0) {
+		if (fwrite(out,length,1,file) != 1) return false;
+		data_end += length;
+	}
+	hunk_count++;
+	return true;
+}
+
+bool HunkImageWriter::Finish(void) {
+	if (file == NULL) return false;
+
+	bool ok = hunk_count == (Bit32u)((size + hunk_size - 1) / hunk_size);
+	Bit64u index_offset = data_end;
+	if (ok && !index.empty()) ok = fwrite(&index[0],index.size(),1,file) == 1;
+
+	Bit8u hdr[HunkImage::header_size];
+	memset(hdr,0,sizeof(hdr));
+	memcpy(hdr,HunkImage::magic,sizeof(HunkImage::magic));
+	host_writed(hdr+8,HunkImage::version);
+	host_writed(hdr+12,hunk_size);
+	host_writeq(hdr+16,size);
+	host_writed(hdr+24,hunk_count);
+	host_writed(hdr+28,0);
+	host_writeq(hdr+32,index_offset);
+	if (ok) ok = fseeko64(file,0,SEEK_SET) == 0 && fwrite(hdr,sizeof(hdr),1,file) == 1;
+
+	if (fclose(file) != 0) ok = false;
+	file = NULL;
+	return ok;
+}
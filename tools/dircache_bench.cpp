@@ -0,0 +1,174 @@
+/*
+ *  Copyright (C) 2002-2015  The DOSBox Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/* Times DOS_Drive_Cache on one large host directory: caching it in, which generates a
+ * short name for every entry, and walking it with FindFirst/FindNext. The directory is
+ * made up in memory, all names share one long stem so that every entry needs a STEM~N
+ * name, the worst case for CreateShortNameID.
+ *
+ * Not part of the build. From the top of a configured tree:
+ *
+ *   g++ -O2 -I. -Iinclude -Isrc -DHAVE_CONFIG_H -o dircache_bench \
+ *       tools/dircache_bench.cpp src/dos/drive_cache.cpp
+ *   ./dircache_bench [files]        (default 100000)
+ */
+
+#include "dosbox.h"
+#include "dos_system.h"
+#include "logging.h"
+#include "cross.h"
+#include "support.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <sys/time.h>
+
+/* the few things drive_cache.cpp needs from the rest of the emulator */
+_LogGroup loggrp[LOG_MAX];
+
+void LOG::operator() (char const* format, ...) {
+	va_list msg;
+	va_start(msg,format);
+	vfprintf(stderr,format,msg);
+	va_end(msg);
+	fputc('\n',stderr);
+}
+
+void E_Exit(const char* format, ...) {
+	va_list msg;
+	va_start(msg,format);
+	vfprintf(stderr,format,msg);
+	va_end(msg);
+	fputc('\n',stderr);
+	exit(1);
+}
+
+MachineType machine = MCH_VGA;
+
+char* upcase(char* str) {
+	for (char* p = str; *p; p++) *p = (char)toupper((unsigned char)*p);
+	return str;
+}
+
+char* shiftjis_upcase(char* str) {
+	return upcase(str);
+}
+
+void Set_Label(char const * const input, char * const output, bool cdrom) {
+	strcpy(output,input);
+}
+
+DOS_Drive::DOS_Drive() {
+	curdir[0] = 0;
+	info[0] = 0;
+	readonly = false;
+	nocachedir = false;
+}
+
+const char* DOS_Drive::GetInfo(void) {
+	return info;
+}
+
+char* DOS_Drive::GetBaseDir(void) {
+	return info;
+}
+
+/* a drive whose only directory is the base directory, holding count files */
+class BenchDrive : public DOS_Drive {
+public:
+	BenchDrive(Bitu count) : count(count), pos(0) { }
+
+	virtual bool FileOpen(DOS_File** file,const char* name,Bit32u flags) { return false; }
+	virtual bool FileCreate(DOS_File** file,const char* name,Bit16u attributes) { return false; }
+	virtual bool FileUnlink(const char* name) { return false; }
+	virtual bool RemoveDir(const char* dir) { return false; }
+	virtual bool MakeDir(const char* dir) { return false; }
+	virtual bool TestDir(const char* dir) { return false; }
+	virtual bool FindFirst(const char* dir,DOS_DTA& dta,bool fcb_findfirst) { return false; }
+	virtual bool FindNext(DOS_DTA& dta) { return false; }
+	virtual bool GetFileAttr(const char* name,Bit16u* attr) { return false; }
+	virtual bool Rename(const char* oldname,const char* newname) { return false; }
+	virtual bool AllocationInfo(Bit16u* bytes_sector,Bit8u* sectors_cluster,Bit16u* total_clusters,Bit16u* free_clusters) { return false; }
+	virtual bool FileExists(const char* name) { return false; }
+	virtual bool FileStat(const char* name,FileStat_Block* const stat_block) { return false; }
+	virtual Bit8u GetMediaByte(void) { return 0xF8; }
+	virtual bool isRemote(void) { return false; }
+	virtual bool isRemovable(void) { return false; }
+	virtual Bits UnMount(void) { return 0; }
+
+	virtual void* opendir(const char* dir) {
+		/* only the base directory exists */
+		if (strcmp(dir,BASE) != 0) return NULL;
+		pos = 0;
+		return this;
+	}
+	virtual void closedir(void* handle) { }
+	virtual bool read_directory_first(void* handle,char* entry_name,bool& is_directory) {
+		pos = 0;
+		return read_directory_next(handle,entry_name,is_directory);
+	}
+	virtual bool read_directory_next(void* handle,char* entry_name,bool& is_directory) {
+		if (pos >= count) return false;
+		sprintf(entry_name,"benchmark file %06lu.txt",(unsigned long)pos++);
+		is_directory = false;
+		return true;
+	}
+
+	static const char BASE[];
+private:
+	Bitu count,pos;
+};
+
+const char BenchDrive::BASE[] = "/bench/";
+
+static double Now(void) {
+	struct timeval tv;
+	gettimeofday(&tv,NULL);
+	return (double)tv.tv_sec + ((double)tv.tv_usec / 1000000.0);
+}
+
+int main(int argc,char** argv) {
+	Bitu count = 100000;
+	if (argc > 1) count = (Bitu)strtoul(argv[1],NULL,0);
+
+	BenchDrive drive(count);
+	drive.nocachedir = true; /* nothing to watch, the directory only exists in memory */
+
+	double t0 = Now();
+	DOS_Drive_Cache* cache = new DOS_Drive_Cache(BenchDrive::BASE,&drive);
+	double t1 = Now();
+
+	char path[CROSS_LEN];
+	strcpy(path,BenchDrive::BASE);
+	Bit16u id;
+	Bitu found = 0;
+	if (cache->FindFirst(path,id)) {
+		char* result;
+		while (cache->FindNext(id,result)) found++;
+	}
+	double t2 = Now();
+
+	delete cache;
+	double t3 = Now();
+
+	printf("%lu files: cache in %.3fs, FindFirst/FindNext of %lu entries %.3fs, cache out %.3fs\n",
+		(unsigned long)count,t1 - t0,(unsigned long)found,t2 - t1,t3 - t2);
+	return found == count ? 0 : 1;
+}
@@ -0,0 +1,250 @@
+/*
+ *  Copyright (C) 2002-2015  The DOSBox Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/* Exercises QCow2Image against an in-memory copy of the disk. Makes a blank version 2
+ * image with 512 byte clusters, so that a few MB already need many L2 tables, refcount
+ * blocks and more clusters than the data cache holds, then does random single and
+ * multi sector reads and writes, comparing every read with the copy. After each round
+ * the image is closed, reopened and read back in full, and the refcount of every
+ * cluster in the file is checked against the tables that point at it. The same is
+ * then done on an overlay image that uses the first one as its backing file.
+ *
+ * Not part of the build. From the top of a configured tree:
+ *
+ *   g++ -O2 -I. -Iinclude -Isrc -DHAVE_CONFIG_H -o qcow2_check \
+ *       tools/qcow2_check.cpp src/ints/qcow2_disk.cpp
+ *   ./qcow2_check [directory for the images]        (default .)
+ */
+
+#include "dosbox.h"
+#include "bios_disk.h"
+#include "qcow2_disk.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <map>
+
+/* the few things qcow2_disk.cpp needs from the rest of the emulator */
+void DEBUG_ShowMsg(char const* format, ...) {
+	va_list msg;
+	va_start(msg,format);
+	vfprintf(stderr,format,msg);
+	va_end(msg);
+	fputc('\n',stderr);
+}
+
+void DISKIO_Sync(void) { }
+
+imageDisk::imageDisk(FILE* imgFile, Bit8u* imgName, Bit32u imgSizeK, bool isHardDisk) { }
+imageDisk::~imageDisk() { }
+Bit8u imageDisk::GetBiosType(void) { return 0; }
+Bit8u imageDisk::Read_Sector(Bit32u head,Bit32u cylinder,Bit32u sector,void* data,unsigned int req_sector_size) { return 5; }
+Bit8u imageDisk::Write_Sector(Bit32u head,Bit32u cylinder,Bit32u sector,void* data,unsigned int req_sector_size) { return 5; }
+Bit8u imageDisk::Read_AbsoluteSector(Bit32u sectnum, void* data) { return 5; }
+Bit8u imageDisk::Write_AbsoluteSector(Bit32u sectnum, void* data) { return 5; }
+Bit8u imageDisk::Read_Sectors(Bit32u sectnum, Bit32u count, void* data) { return 5; }
+Bit8u imageDisk::Write_Sectors(Bit32u sectnum, Bit32u count, void* data) { return 5; }
+Bit32u imageDisk::getSectSize(void) { return 512; }
+void imageDisk::Get_Geometry(Bit32u* getHeads, Bit32u* getCyl, Bit32u* getSect, Bit32u* getSectSize) { }
+void imageDisk::Set_Geometry(Bit32u setHeads, Bit32u setCyl, Bit32u setSect, Bit32u setSectSize) { }
+Bit32u imageDisk::Get_Reserved_Cylinders() { return 0; }
+void imageDisk::Set_Reserved_Cylinders(Bitu resCyl) { }
+
+static const Bit32u CLUSTER = 512;
+static const Bit32u SECTOR = 512;
+static const Bit32u SECTORS = 8192;		/* 4MB */
+static const Bit32u MAX_COUNT = 64;
+static const int OPS = 20000;
+
+static void put16(std::vector<Bit8u>& d, size_t at, Bit16u v) {
+	d[at] = (Bit8u)(v >> 8);
+	d[at + 1] = (Bit8u)v;
+}
+
+static void put32(std::vector<Bit8u>& d, size_t at, Bit32u v) {
+	put16(d,at,(Bit16u)(v >> 16));
+	put16(d,at + 2,(Bit16u)v);
+}
+
+static void put64(std::vector<Bit8u>& d, size_t at, Bit64u v) {
+	put32(d,at,(Bit32u)(v >> 32));
+	put32(d,at + 4,(Bit32u)v);
+}
+
+static Bit16u get16(const std::vector<Bit8u>& d, Bit64u at) {
+	return (Bit16u)((d[at] << 8) | d[at + 1]);
+}
+
+static Bit32u get32(const std::vector<Bit8u>& d, Bit64u at) {
+	return ((Bit32u)get16(d,at) << 16) | get16(d,at + 2);
+}
+
+static Bit64u get64(const std::vector<Bit8u>& d, Bit64u at) {
+	return ((Bit64u)get32(d,at) << 32) | get32(d,at + 4);
+}
+
+/* header, one refcount table cluster, one refcount block and the L1 table: 128 entries
+ * of 64 L2 entries of one 512 byte cluster each cover the 4MB */
+static bool MakeImage(const std::string& name, const std::string& backing) {
+	std::vector<Bit8u> img(5 * CLUSTER,0);
+	put32(img,0,0x514649FB);
+	put32(img,4,2);
+	if (!backing.empty()) {
+		put64(img,8,200);
+		put32(img,16,(Bit32u)backing.size());
+		memcpy(&img[200],backing.c_str(),backing.size());
+	}
+	put32(img,20,9);					/* cluster bits */
+	put64(img,24,(Bit64u)SECTORS * SECTOR);
+	put32(img,36,128);					/* L1 size */
+	put64(img,40,3 * CLUSTER);				/* L1 table */
+	put64(img,48,CLUSTER);					/* refcount table */
+	put32(img,56,1);
+	put64(img,CLUSTER,2 * CLUSTER);				/* refcount block */
+	for (size_t i = 0; i < 5; i++) put16(img,2 * CLUSTER + 2 * i,1);
+	FILE* f = fopen(name.c_str(),"wb");
+	if (f == NULL) return false;
+	bool ok = fwrite(&img[0],img.size(),1,f) == 1;
+	return fclose(f) == 0 && ok;
+}
+
+static void Use(std::map<Bit64u,Bitu>& used, Bit64u offset) {
+	used[offset / CLUSTER]++;
+}
+
+/* every cluster's refcount has to match the number of places that point at it */
+static bool CheckRefcounts(const std::string& name) {
+	FILE* f = fopen(name.c_str(),"rb");
+	if (f == NULL) return false;
+	fseek(f,0,SEEK_END);
+	long length = ftell(f);
+	std::vector<Bit8u> d((size_t)length);
+	fseek(f,0,SEEK_SET);
+	bool ok = length > 0 && fread(&d[0],d.size(),1,f) == 1;
+	fclose(f);
+	if (!ok) return false;
+
+	const Bit64u mask = 0x00FFFFFFFFFFFE00ULL;
+	Bit32u l1_size = get32(d,36);
+	Bit64u l1_offset = get64(d,40);
+	Bit64u rt_offset = get64(d,48);
+	Bit32u rt_clusters = get32(d,56);
+	std::map<Bit64u,Bitu> used;
+	Use(used,0);
+	for (Bit32u c = 0; c < rt_clusters; c++) Use(used,rt_offset + (Bit64u)c * CLUSTER);
+	for (Bit64u c = 0; c < ((Bit64u)l1_size * 8 + CLUSTER - 1) / CLUSTER; c++) Use(used,l1_offset + c * CLUSTER);
+	for (Bit64u i = 0; i < (Bit64u)rt_clusters * CLUSTER / 8; i++) {
+		Bit64u block = get64(d,rt_offset + 8 * i);
+		if (block) Use(used,block);
+	}
+	for (Bit32u i = 0; i < l1_size; i++) {
+		Bit64u l2 = get64(d,l1_offset + 8 * i) & mask;
+		if (!l2) continue;
+		Use(used,l2);
+		for (Bit32u j = 0; j < CLUSTER / 8; j++) {
+			Bit64u data = get64(d,l2 + 8 * j) & mask;
+			if (data) Use(used,data);
+		}
+	}
+	Bitu bad = 0;
+	Bit64u clusters = d.size() / CLUSTER;
+	for (Bit64u c = 0; c < clusters; c++) {
+		Bit64u block = get64(d,rt_offset + 8 * (c / (CLUSTER / 2)));
+		Bit16u refcount = block ? get16(d,block + 2 * (c % (CLUSTER / 2))) : 0;
+		Bitu expected = used.count(c) ? used[c] : 0;
+		if (refcount != expected && bad++ < 10) {
+			printf("%s: cluster %lu has refcount %u, used %lu times\n",name.c_str(),
+				(unsigned long)c,refcount,(unsigned long)expected);
+		}
+	}
+	printf("%s: %lu clusters, %lu refcount mismatches\n",name.c_str(),(unsigned long)clusters,(unsigned long)bad);
+	return bad == 0;
+}
+
+static bool Exercise(const std::string& name, std::vector<Bit8u>& model) {
+	std::vector<Bit8u> buf(MAX_COUNT * SECTOR);
+	for (int round = 0; round < 2; round++) {
+		FILE* f = fopen(name.c_str(),"rb+");
+		if (f == NULL) return false;
+		QCow2Image* image = new QCow2Image(QCow2Image::read_header(f),f,name.c_str(),SECTOR);
+		for (int op = 0; op < OPS; op++) {
+			/* mostly one or two sectors, sometimes a run over several clusters */
+			Bit32u count = 1 + rand() % ((rand() % 4) ? 2 : MAX_COUNT);
+			Bit32u sector = rand() % (SECTORS - count + 1);
+			bool single = count == 1 && (rand() % 2);
+			if (rand() % 2) {
+				for (Bit32u i = 0; i < count * SECTOR; i++) buf[i] = (Bit8u)rand();
+				Bit8u result = single ? image->write_sector(sector,&buf[0]) : image->write_sectors(sector,count,&buf[0]);
+				if (result) {
+					printf("%s: write of %u sectors at %u failed\n",name.c_str(),count,sector);
+					return false;
+				}
+				memcpy(&model[sector * SECTOR],&buf[0],count * SECTOR);
+			} else {
+				Bit8u result = single ? image->read_sector(sector,&buf[0]) : image->read_sectors(sector,count,&buf[0]);
+				if (result || memcmp(&model[sector * SECTOR],&buf[0],count * SECTOR) != 0) {
+					printf("%s: read of %u sectors at %u differs (op %d)\n",name.c_str(),count,sector,op);
+					return false;
+				}
+			}
+		}
+		/* the image does not close its own file, only that of a backing image */
+		delete image;
+		fclose(f);
+
+		f = fopen(name.c_str(),"rb");
+		if (f == NULL) return false;
+		image = new QCow2Image(QCow2Image::read_header(f),f,name.c_str(),SECTOR);
+		bool same = true;
+		for (Bit32u sector = 0; same && sector < SECTORS; sector += MAX_COUNT) {
+			if (image->read_sectors(sector,MAX_COUNT,&buf[0]) ||
+				memcmp(&model[sector * SECTOR],&buf[0],MAX_COUNT * SECTOR) != 0) {
+				printf("%s: reopened image differs at sector %u\n",name.c_str(),sector);
+				same = false;
+			}
+		}
+		delete image;
+		fclose(f);
+		if (!same || !CheckRefcounts(name)) return false;
+		printf("%s: round %d ok\n",name.c_str(),round);
+	}
+	return true;
+}
+
+int main(int argc,char** argv) {
+	std::string dir = argc > 1 ? argv[1] : ".";
+	std::string base = dir + "/qcow2_check_base.qcow2";
+	std::string overlay = dir + "/qcow2_check_overlay.qcow2";
+	std::vector<Bit8u> model((size_t)SECTORS * SECTOR,0);
+
+	srand(1);
+	if (!MakeImage(base,"") || !Exercise(base,model)) return 1;
+
+	/* the overlay starts out reading through to the base image */
+	srand(2);
+	if (!MakeImage(overlay,"qcow2_check_base.qcow2") || !Exercise(overlay,model)) return 1;
+
+	remove(overlay.c_str());
+	remove(base.c_str());
+	printf("all ok\n");
+	return 0;
+}